@@ -0,0 +1,298 @@
+/*
+//
+//  ADOBE SYSTEMS INCORPORATED
+//  Copyright (C) 2000-2003 Adobe Systems Incorporated
+//  All rights reserved.
+//
+//  NOTICE: Adobe permits you to use, modify, and distribute this file
+//  in accordance with the terms of the Adobe license agreement
+//  accompanying it. If you have received this file from a source other
+//  than Adobe, then your use, modification, or distribution of it
+//  requires the prior written permission of Adobe.
+//
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "MappedFileSys.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MappedFileError(code) ErrBuildCode(ErrAlways, ErrSysASFile, code)
+
+// Set once, from the command line, before any worker starts
+static bool usingMappedInput = false;
+static MappedAccess mappedInputAccess = MappedAccessNormal;
+
+// An open file: the mapping of the whole file, and the position of the next read.
+typedef struct {
+	char *data;
+	ASUns64 size;
+	ASUns64 position;
+} MappedFile;
+
+static ACCB1 ASErrorCode ACCB2 mappedOpen(ASPathName pathName, ASFileMode mode, ASMDFile *fP)
+{
+	*fP = NULL;
+	if (mode & (ASFILE_WRITE | ASFILE_CREATE))
+		return MappedFileError(fileErrWrite);
+
+	MappedFile *file = static_cast<MappedFile *>(malloc(sizeof(MappedFile)));
+	file->data = NULL;
+	file->size = 0;
+	file->position = 0;
+
+#ifdef WIN_PLATFORM
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (mappedInputAccess == MappedAccessSequential)
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	else if (mappedInputAccess == MappedAccessRandom)
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+	HANDLE handle = CreateFileA((char *)pathName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		free(file);
+		return MappedFileError(fileErrFNF);
+	}
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(handle, &fileSize);
+	file->size = fileSize.QuadPart;
+	if (file->size > 0) {
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			file->data = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(handle);
+#else
+	int fd = open((char *)pathName, O_RDONLY);
+	if (fd < 0) {
+		free(file);
+		return MappedFileError(fileErrFNF);
+	}
+	struct stat fileStat;
+	fstat(fd, &fileStat);
+	file->size = fileStat.st_size;
+	if (file->size > 0) {
+		void *data = mmap(NULL, (size_t)file->size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED) {
+			file->data = (char *)data;
+			if (mappedInputAccess == MappedAccessSequential)
+				madvise(data, (size_t)file->size, MADV_SEQUENTIAL);
+			else if (mappedInputAccess == MappedAccessRandom)
+				madvise(data, (size_t)file->size, MADV_RANDOM);
+		}
+	}
+	close(fd);
+#endif
+
+	// An empty file has nothing to map, any other file must be mapped
+	if (file->size > 0 && file->data == NULL) {
+		free(file);
+		return MappedFileError(fileErrIO);
+	}
+	*fP = (ASMDFile)file;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedClose(ASMDFile f)
+{
+	MappedFile *file = (MappedFile *)f;
+	if (file->data) {
+#ifdef WIN_PLATFORM
+		UnmapViewOfFile(file->data);
+#else
+		munmap(file->data, (size_t)file->size);
+#endif
+	}
+	free(file);
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedFlush(ASMDFile f)
+{
+	return 0;
+}
+
+static ACCB1 ASSize_t ACCB2 mappedRead(void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+	MappedFile *file = (MappedFile *)f;
+	ASUns64 wanted = (ASUns64)size * count;
+	ASUns64 available = (file->position < file->size) ? file->size - file->position : 0;
+	if (wanted > available)
+		wanted = available;
+	if (wanted)
+		memcpy(ptr, file->data + file->position, (size_t)wanted);
+	file->position += wanted;
+	*pError = 0;
+	return (ASSize_t)wanted;
+}
+
+static ACCB1 ASSize_t ACCB2 mappedWrite(void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+	*pError = MappedFileError(fileErrWrite);
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedSetPos(ASMDFile f, ASFilePos pos)
+{
+	((MappedFile *)f)->position = (ASUns64)pos;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedGetPos(ASMDFile f, ASFilePos *pos)
+{
+	*pos = (ASFilePos)((MappedFile *)f)->position;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedSetEof(ASMDFile f, ASFilePos pos)
+{
+	return MappedFileError(fileErrWrite);
+}
+
+static ACCB1 ASInt32 ACCB2 mappedGetEof(ASMDFile f, ASFilePos *pos)
+{
+	*pos = (ASFilePos)((MappedFile *)f)->size;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedSetPos64(ASMDFile f, ASFilePos64 pos)
+{
+	((MappedFile *)f)->position = (ASUns64)pos;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedGetPos64(ASMDFile f, ASFilePos64 *pos)
+{
+	*pos = (ASFilePos64)((MappedFile *)f)->position;
+	return 0;
+}
+
+static ACCB1 ASInt32 ACCB2 mappedSetEof64(ASMDFile f, ASFilePos64 pos)
+{
+	return MappedFileError(fileErrWrite);
+}
+
+static ACCB1 ASInt32 ACCB2 mappedGetEof64(ASMDFile f, ASFilePos64 *pos)
+{
+	*pos = (ASFilePos64)((MappedFile *)f)->size;
+	return 0;
+}
+
+// A path name is a copy of the C string file name
+static ACCB1 ASPathName ACCB2 mappedCopyPathName(ASPathName pathName)
+{
+	char *copy = static_cast<char *>(malloc(strlen((char *)pathName) + 1));
+	strcpy(copy, (char *)pathName);
+	return (ASPathName)copy;
+}
+
+static ACCB1 void ACCB2 mappedDisposePathName(ASPathName pathName)
+{
+	free(pathName);
+}
+
+static ACCB1 ASInt32 ACCB2 mappedGetName(ASPathName pathName, char *name, ASInt32 maxLength)
+{
+	char *fileName = (char *)pathName;
+	for (char *scan = fileName; *scan; scan++)
+		if (*scan == '/' || *scan == '\\')
+			fileName = scan + 1;
+	if (name && maxLength > 0) {
+		strncpy(name, fileName, maxLength - 1);
+		name[maxLength - 1] = 0;
+	}
+	return (ASInt32)strlen(fileName);
+}
+
+static ACCB1 char * ACCB2 mappedDisplayStringFromPath(ASPathName pathName)
+{
+	char *display = static_cast<char *>(ASmalloc(strlen((char *)pathName) + 1));
+	strcpy(display, (char *)pathName);
+	return display;
+}
+
+static ACCB1 ASBool ACCB2 mappedIsSameFile(ASMDFile f, ASPathName pathName, ASPathName newPathName)
+{
+	return !strcmp((char *)pathName, (char *)newPathName);
+}
+
+static ACCB1 ASAtom ACCB2 mappedGetFileSysName(void)
+{
+	return ASAtomFromString("MappedFileSys");
+}
+
+// The record is filled in before main() runs, so threads may share it freely.
+static ASFileSysRec BuildMappedFileSys()
+{
+	ASFileSysRec fileSys;
+	memset(&fileSys, 0, sizeof(ASFileSysRec));
+	fileSys.size = sizeof(ASFileSysRec);
+	fileSys.open = mappedOpen;
+	fileSys.open64 = mappedOpen;
+	fileSys.close = mappedClose;
+	fileSys.flush = mappedFlush;
+	fileSys.read = mappedRead;
+	fileSys.write = mappedWrite;
+	fileSys.setpos = mappedSetPos;
+	fileSys.getpos = mappedGetPos;
+	fileSys.seteof = mappedSetEof;
+	fileSys.geteof = mappedGetEof;
+	fileSys.setpos64 = mappedSetPos64;
+	fileSys.getpos64 = mappedGetPos64;
+	fileSys.seteof64 = mappedSetEof64;
+	fileSys.geteof64 = mappedGetEof64;
+	fileSys.copyPathName = mappedCopyPathName;
+	fileSys.disposePathName = mappedDisposePathName;
+	fileSys.getName = mappedGetName;
+	fileSys.displayStringFromPath = mappedDisplayStringFromPath;
+	fileSys.isSameFile = mappedIsSameFile;
+	fileSys.getFileSysName = mappedGetFileSysName;
+	return fileSys;
+}
+
+static ASFileSysRec mappedFileSys = BuildMappedFileSys();
+
+ASFileSys MappedFileSys()
+{
+	return &mappedFileSys;
+}
+
+ASPathName MappedFileSysPathName(const char *name)
+{
+	return mappedCopyPathName((ASPathName)name);
+}
+
+void SetMappedInputOptions(int argc, char *argv[])
+{
+	for (int arg = 1; arg < argc; arg++) {
+		if (strncmp(argv[arg], "MappedInput=", 12) == 0)
+			usingMappedInput = (strcmp(argv[arg] + 12, "true") == 0);
+		else if (strncmp(argv[arg], "MappedInputAccess=", 18) == 0) {
+			const char *access = argv[arg] + 18;
+			if (strcmp(access, "sequential") == 0)
+				mappedInputAccess = MappedAccessSequential;
+			else if (strcmp(access, "random") == 0)
+				mappedInputAccess = MappedAccessRandom;
+			else
+				mappedInputAccess = MappedAccessNormal;
+		}
+	}
+}
+
+bool UsingMappedInput()
+{
+	return usingMappedInput;
+}
+
+MappedAccess MappedInputAccess()
+{
+	return mappedInputAccess;
+}
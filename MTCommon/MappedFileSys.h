@@ -0,0 +1,57 @@
+/*
+//
+//  ADOBE SYSTEMS INCORPORATED
+//  Copyright (C) 2000-2003 Adobe Systems Incorporated
+//  All rights reserved.
+//
+//  NOTICE: Adobe permits you to use, modify, and distribute this file
+//  in accordance with the terms of the Adobe license agreement
+//  accompanying it. If you have received this file from a source other
+//  than Adobe, then your use, modification, or distribution of it
+//  requires the prior written permission of Adobe.
+//
+*/
+#ifndef _MappedFileSys_h_
+#define _MappedFileSys_h_
+
+#include "ASCalls.h"
+
+// The access pattern given to the system for mapped input documents, to control read ahead.
+typedef enum {
+	MappedAccessNormal,
+	MappedAccessSequential,
+	MappedAccessRandom
+} MappedAccess;
+
+/** Read the mapped input options from the command line. "MappedInput=true" opens
+	input documents through the memory mapped file system below, rather than the
+	default file system. "MappedInputAccess=normal", "sequential" or "random" sets
+	the access pattern of the mappings. Call this before any worker is started.
+	@param argc IN the count of arguments, as given to main.
+	@param argv IN the arguments, as given to main.
+*/
+void SetMappedInputOptions(int argc, char *argv[]);
+
+/** @return true if input documents are to be opened through MappedFileSys().
+*/
+bool UsingMappedInput();
+
+/** @return the access pattern given to the system for mapped input documents.
+*/
+MappedAccess MappedInputAccess();
+
+/** A read only file system, which maps each file it opens into memory.
+	Reads are served from the mapping, which is backed directly by the page cache,
+	so there is no read system call and no second, buffered, copy of the file.
+	This suits large input documents. Files cannot be written or created.
+	@return the mapped file system, for use with PDDocOpen.
+*/
+ASFileSys MappedFileSys();
+
+/** Create a path name in the mapped file system.
+	@param name IN the platform path of the file, as a C string.
+	@return the path name. Release it with ASFileSysReleasePath(MappedFileSys(), path).
+*/
+ASPathName MappedFileSysPathName(const char *name);
+
+#endif //_MappedFileSys_h_
@@ -0,0 +1,218 @@
+/*
+//
+//  ADOBE SYSTEMS INCORPORATED
+//  Copyright (C) 2000-2003 Adobe Systems Incorporated
+//  All rights reserved.
+//
+//  NOTICE: Adobe permits you to use, modify, and distribute this file
+//  in accordance with the terms of the Adobe license agreement
+//  accompanying it. If you have received this file from a source other
+//  than Adobe, then your use, modification, or distribution of it
+//  requires the prior written permission of Adobe.
+//
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "WatchSampler.h"
+
+#ifdef WIN_PLATFORM
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+// A monotonic clock, in seconds, for the sampler
+static double sampleClock()
+{
+#ifdef WIN_PLATFORM
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return ((now.QuadPart * 1.0) / frequency.QuadPart);
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec + ((now.tv_nsec * 1.0) / 1000000000.0));
+#endif
+}
+
+// The sampler thread writes a line at each interval, polling so that it stops promptly
+#ifdef WIN_PLATFORM
+static DWORD WINAPI samplerMain(LPVOID arg)
+#else
+static void * samplerMain(void * arg)
+#endif
+{
+	WatchSampler * sampler = static_cast<WatchSampler *>(arg);
+	ASInt32 interval = sampler->getInterval();
+	double next = sampleClock() + (interval / 1000.0);
+	while (!sampler->stopping){
+		if (sampleClock() >= next){
+			sampler->writeSample();
+			next += interval / 1000.0;
+		}
+#ifdef WIN_PLATFORM
+		Sleep(interval < 100 ? 1 : 10);
+#else
+		usleep(interval < 100 ? 1000 : 10000);
+#endif
+	}
+	return 0;
+}
+
+WatchSampler::WatchSampler(){
+	this->stopping = false;
+	this->filesStarted = 0;
+	this->filesDone = 0;
+	this->sampleFile = NULL;
+	this->sampleInterval = 0;
+	InitCS(this->countMutex);
+}
+
+WatchSampler::~WatchSampler(){
+	this->stop();
+	DestroyCS(this->countMutex);
+}
+
+void 
+WatchSampler::start(int argc, char *argv[]){
+	ASInt32 sampleInterval = 0;
+	const char * sampleFile = "samples.csv";
+	for (int arg = 1; arg < argc; arg++){
+		if (strncmp(argv[arg], "SampleInterval=", 15) == 0)
+			sampleInterval = atoi(argv[arg] + 15);
+		else if (strncmp(argv[arg], "SampleFile=", 11) == 0)
+			sampleFile = argv[arg] + 11;
+	}
+	this->start(sampleFile, sampleInterval);
+}
+
+void 
+WatchSampler::start(const char * fileName, ASInt32 intervalMs){
+	if (intervalMs <= 0)
+		return;
+	this->sampleFile = fopen(fileName, "w");
+	if (this->sampleFile == NULL){
+		fprintf(stderr, "Cannot open the sample file %s\n", fileName);
+		return;
+	}
+	fprintf(this->sampleFile, "seconds,files,filesPerSecond,inProgress,cpuSeconds,residentMB,minorFaults,majorFaults,contextSwitches,heapMB\n");
+	printf("Sampling every %d milliseconds into %s\n", intervalMs, fileName);
+
+	this->sampleInterval = intervalMs;
+	this->sampleStart = sampleClock();
+	this->lastSampleTime = 0;
+	this->lastSampleDone = 0;
+	this->stopping = false;
+	this->writeSample();
+#ifdef WIN_PLATFORM
+	this->samplerThread = CreateThread(NULL, 0, samplerMain, this, 0, NULL);
+	if (this->samplerThread == NULL)
+		this->sampleInterval = 0;
+#else
+	if (pthread_create(&this->samplerThread, NULL, samplerMain, this) != 0)
+		this->sampleInterval = 0;
+#endif
+	if (this->sampleInterval == 0){
+		fclose(this->sampleFile);
+		this->sampleFile = NULL;
+	}
+}
+
+void 
+WatchSampler::stop(){
+	if (this->sampleFile == NULL)
+		return;
+	this->stopping = true;
+#ifdef WIN_PLATFORM
+	WaitForSingleObject(this->samplerThread, INFINITE);
+	CloseHandle(this->samplerThread);
+#else
+	pthread_join(this->samplerThread, NULL);
+#endif
+	this->writeSample();
+	fclose(this->sampleFile);
+	this->sampleFile = NULL;
+	this->sampleInterval = 0;
+}
+
+ASInt32 
+WatchSampler::fileStarted(){
+	EnterCS(this->countMutex);
+	ASInt32 started = ++this->filesStarted;
+	LeaveCS(this->countMutex);
+	return started;
+}
+
+void 
+WatchSampler::fileDone(){
+	EnterCS(this->countMutex);
+	this->filesDone++;
+	watchFolderProbe1(done, this->filesDone);
+	LeaveCS(this->countMutex);
+}
+
+ASInt32 WatchSampler::getInterval()
+{
+	return this->sampleInterval;
+}
+
+void 
+WatchSampler::writeSample(){
+	double seconds = sampleClock() - this->sampleStart;
+	EnterCS(this->countMutex);
+	ASInt32 done = this->filesDone;
+	ASInt32 inProgress = this->filesStarted - this->filesDone;
+	LeaveCS(this->countMutex);
+	double rate = 0;
+	if (seconds > this->lastSampleTime)
+		rate = (done - this->lastSampleDone) / (seconds - this->lastSampleTime);
+	this->lastSampleTime = seconds;
+	this->lastSampleDone = done;
+
+	// the process as a whole, fields which cannot be found are left at zero
+	double cpuSeconds = 0, residentMB = 0, heapMB = 0;
+	unsigned long long minorFaults = 0, majorFaults = 0, contextSwitches = 0;
+#ifdef WIN_PLATFORM
+	FILETIME created, exited, kernel, user;
+	if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+		cpuSeconds = ((*((unsigned long long *)&kernel) + *((unsigned long long *)&user)) * 1.0) / 10000000;
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		residentMB = counters.WorkingSetSize / (1024.0 * 1024.0);
+		minorFaults = counters.PageFaultCount;
+	}
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ((usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0);
+	minorFaults = usage.ru_minflt;
+	majorFaults = usage.ru_majflt;
+	contextSwitches = usage.ru_nvcsw + usage.ru_nivcsw;
+	FILE * statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL){
+		unsigned long long size = 0, resident = 0;
+		if (fscanf(statm, "%llu %llu", &size, &resident) == 2)
+			residentMB = (resident * (double)sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+		fclose(statm);
+	}
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+	heapMB = (info.uordblks + info.hblkhd) / (1024.0 * 1024.0);
+#elif defined(__GLIBC__)
+	struct mallinfo info = mallinfo();
+	heapMB = ((unsigned int)info.uordblks + (unsigned int)info.hblkhd) / (1024.0 * 1024.0);
+#endif
+#endif
+
+	fprintf(this->sampleFile, "%0.3f,%d,%0.5g,%d,%0.5g,%0.5g,%llu,%llu,%llu,%0.5g\n",
+		seconds, done, rate, inProgress, cpuSeconds, residentMB, minorFaults, majorFaults, contextSwitches, heapMB);
+	fflush(this->sampleFile);
+}
@@ -0,0 +1,116 @@
+/*
+//
+//  ADOBE SYSTEMS INCORPORATED
+//  Copyright (C) 2000-2003 Adobe Systems Incorporated
+//  All rights reserved.
+//
+//  NOTICE: Adobe permits you to use, modify, and distribute this file
+//  in accordance with the terms of the Adobe license agreement
+//  accompanying it. If you have received this file from a source other
+//  than Adobe, then your use, modification, or distribution of it
+//  requires the prior written permission of Adobe.
+//
+*/
+#ifndef _WatchSampler_h_
+#define _WatchSampler_h_
+
+#include <stdio.h>
+
+#include "ASCalls.h"
+#include "SDKThreads.h"
+#ifndef WIN_PLATFORM
+#include <pthread.h>
+#endif
+
+// Static probes (USDT) for perf and bpftrace, where <sys/sdt.h> is installed (On Linux).
+// Each is a single nop until a tracer attaches to it. In the provider "watchfolder":
+//   enqueue (path, queued)             a new file is added to the list to be converted
+//   dequeue (path, queued, started)    a worker thread takes a file, started counts from one
+//   done (completed)                   a worker thread has finished with it's file
+#if !defined(NO_PROBES) && defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WATCHFOLDER_PROBES
+#endif
+#endif
+#ifdef WATCHFOLDER_PROBES
+#define watchFolderProbe1(name, a) DTRACE_PROBE1(watchfolder, name, a)
+#define watchFolderProbe2(name, a, b) DTRACE_PROBE2(watchfolder, name, a, b)
+#define watchFolderProbe3(name, a, b, c) DTRACE_PROBE3(watchfolder, name, a, b, c)
+#else
+#define watchFolderProbe1(name, a) do { } while (0)
+#define watchFolderProbe2(name, a, b) do { } while (0)
+#define watchFolderProbe3(name, a, b, c) do { } while (0)
+#endif
+
+/** Writes a time series of a watched folder service to a file, so the progress of
+	the service may be seen over time. A thread writes a line of comma separated
+	values every interval. Each line gives the seconds since the sampler started,
+	the files completed, files per second since the last line, files in progress,
+	and the CPU seconds, resident MB, minor and major page faults, context switches,
+	and heap MB in use of the process. Fields which cannot be found on a platform
+	are zero.
+*/
+class WatchSampler {
+public:
+	WatchSampler();
+	/** dtor, stops the sampler thread if it is running */
+	virtual ~WatchSampler();
+
+	/** Starts the sampler thread, as given on the command line. "SampleInterval=milliseconds"
+		sets the interval between lines, and "SampleFile=name" (default samples.csv) the
+		file to write. Without "SampleInterval=", nothing is started.
+		@param argc IN the count of arguments, as given to main.
+		@param argv IN the arguments, as given to main.
+	*/
+	void start(int argc, char *argv[]);
+	/** Starts the sampler thread. An interval of zero starts nothing.
+		@param fileName IN the file to write, it is replaced if it exists
+		@param intervalMs IN the milliseconds between lines
+	*/
+	void start(const char * fileName, ASInt32 intervalMs);
+	/** Stops the sampler thread, if it was started, after writing a last line.
+	*/
+	void stop();
+
+	/** Called when a worker thread is given a file.
+		@return the count of files started, from one.
+	*/
+	ASInt32 fileStarted();
+	/** Called when a worker thread has finished with it's file.
+	*/
+	void fileDone();
+
+	/** Writes one line of the time series. Called by the sampler thread.
+	*/
+	void writeSample();
+	/** The milliseconds between lines, zero if the sampler is not running.
+	*/
+	ASInt32 getInterval();
+
+	/** The sampler thread stops when this is set.
+	*/
+	volatile bool stopping;
+
+private:
+	/** Protects the counts of files, which worker threads update.
+	*/
+	CSMutex countMutex;
+	ASInt32 filesStarted;
+	ASInt32 filesDone;
+
+	/** The time series file, the interval between lines, and the sampler thread.
+	*/
+	FILE * sampleFile;
+	ASInt32 sampleInterval;
+	double sampleStart;
+	double lastSampleTime;
+	ASInt32 lastSampleDone;
+#ifdef WIN_PLATFORM
+	HANDLE samplerThread;
+#else
+	pthread_t samplerThread;
+#endif
+};
+
+#endif //_WatchSampler_h_
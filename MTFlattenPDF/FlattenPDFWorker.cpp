@@ -22,6 +22,7 @@
 #include "SmartPDPage.h"
 #include "PDFLExpT.h"
 #include "ASExtraCalls.h"
+#include "../MTCommon/MappedFileSys.h"
 
 
 ////////////////////
@@ -116,6 +117,8 @@ ThreadFuncReturnType FlattenPDF(ThreadArgs *pArgs)
         DisplayError(ERRORCODE);
         END_HANDLER
 
+        // let the watched folder count the file as done
+        theWF->fileDone();
 	}
 	
 	RELEASE_AUTO_POOL(autoReleasePool); /* Required only on MAC platform */
@@ -160,7 +163,20 @@ void FlattenPDFMain(const char * input, char * output, FlattenProgressMonitor, v
     char *pathnm = static_cast<char *>(ASmalloc(filename.length() + 1));
     sprintf_safe(pathnm, filename.length() + 1, "%s", filename.c_str());
 
-    pddoc = MyPDDocOpen(pathnm);
+    if (UsingMappedInput())
+    {
+        // Open the input through the memory mapped file system
+        ASPathName mappedPath = MappedFileSysPathName(pathnm);
+        DURING
+            pddoc = PDDocOpen(mappedPath, MappedFileSys(), NULL, true);
+        HANDLER
+            ASFileSysReleasePath(MappedFileSys(), mappedPath);
+            RERAISE();
+        END_HANDLER
+        ASFileSysReleasePath(MappedFileSys(), mappedPath);
+    }
+    else
+        pddoc = MyPDDocOpen(pathnm);
     CSmartPDPage onePage;
 
     if (0)
@@ -14,6 +14,7 @@
 
 #include "WatchFolder.h"
 #include "FlattenPDFWorker.h"
+#include "../MTCommon/MappedFileSys.h"
 #ifndef WIN_PLATFORM
 #include "stdio.h"
 #include <fcntl.h>
@@ -188,6 +189,13 @@ int MainProc(int argc, char *argv[] )
 	WatchFolder * myWF = new WatchFolder(folderToWatch, outdir, numFiles);
 	ASFileSysReleasePath(NULL, folderToWatch);
 
+	// "SampleInterval=milliseconds" on the command line writes a time series of the
+	// run into "SampleFile=name" (default samples.csv), see WatchSampler
+	myWF->startSampler(argc, argv);
+
+	// "MappedInput=true" opens input documents through the memory mapped file system
+	SetMappedInputOptions(argc, argv);
+
 	// Allocate the thread block
 	myThreads = static_cast<ThreadInfo *>(ASmalloc( sizeof( ThreadInfo ) * numThreads));
 
@@ -251,6 +259,7 @@ int MainProc(int argc, char *argv[] )
 		destroyThread(myThreads[j]);
 		ASfree(myThreadArgs[j].tName);
 	}
+	myWF->stopSampler();
 
 /* DLADD */
 #ifndef WIN32
@@ -19,6 +19,7 @@
 #include "CosCalls.h"
 #include "PDCalls.h"
 #include "PDFProcessorCalls.h"
+#include "../MTCommon/MappedFileSys.h"
 
 ThreadFuncReturnType DoWork(ThreadArgs *pArgs)
 {
@@ -82,13 +83,22 @@ ThreadFuncReturnType DoWork(ThreadArgs *pArgs)
 			HANDLER
 				ASRaise(ASRegisterErrorString(ErrAlways,"Cannot get DI path"));
 			END_HANDLER;
+			ASFileSys inputFileSys = NULL;
+			if (UsingMappedInput()) {
+				// Open the PDF file through the memory mapped file system, by it's platform path
+				char *platformPath = ASFileSysDisplayStringFromPath(NULL, filePath);
+				ASFileSysReleasePath(NULL, filePath);
+				filePath = MappedFileSysPathName(platformPath);
+				ASfree(platformPath);
+				inputFileSys = MappedFileSys();
+			}
 			// Open the PDF file. If cannot be opened, raise
-			if ((docP = PDDocOpen(filePath,NULL,NULL,true))==NULL) {
+			if ((docP = PDDocOpen(filePath,inputFileSys,NULL,true))==NULL) {
 				char buffer[400];
 				sprintf_safe(buffer,sizeof(buffer),"%s cannot open %s",pArgs->tName,fileToProcess);
 				ASRaise(ASRegisterErrorString(ErrAlways,buffer));
 			}
-			ASFileSysReleasePath( NULL, filePath );
+			ASFileSysReleasePath( inputFileSys, filePath );
 
 			CosDoc cosPDFDoc = PDDocGetCosDoc(docP);
 			CosObj DocRoot = CosDocGetRoot(cosPDFDoc);
@@ -138,6 +148,9 @@ ThreadFuncReturnType DoWork(ThreadArgs *pArgs)
 				docP = NULL;
 			}
 
+			// let the watched folder count the file as done
+			theWF->fileDone();
+
 
 			//PDFProcessorTerminate();
 			//MyPDFLTerm();
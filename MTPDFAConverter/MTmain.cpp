@@ -15,6 +15,7 @@
 
 #include "WatchFolder.h"
 #include "MTWorker.h"
+#include "../MTCommon/MappedFileSys.h"
 #include "stdio.h"
 #ifndef WIN_PLATFORM
 #include <fcntl.h>
@@ -65,9 +66,19 @@ int MainProc(int argc, char *argv[] )
 #endif
 	ASInt32 numFiles = 20;
 	ASInt32 numThreads = 20;
-	if (argc > 5) {
-		printf( "Usage: %s folderPath outdir [numfiles [numthreads]]\n", argv[0] );
+	// options, as "SampleInterval=100", may follow the positional arguments in any number
+	int positional = 0;
+	for (int arg = 1; arg < argc; arg++)
+		if (strchr(argv[arg], '=') == NULL)
+			positional++;
+	if (positional > 4) {
+		printf( "Usage: %s folderPath outdir [numfiles [numthreads]] [options]\n", argv[0] );
 		printf("The folder path must be absolute\n");
+		printf("Options:\n");
+		printf("  SampleInterval=milliseconds  write a time series of the run (default none)\n");
+		printf("  SampleFile=name              the file for the time series (default samples.csv)\n");
+		printf("  MappedInput=true             open input documents through a memory mapped file system\n");
+		printf("  MappedInputAccess=mode       normal, sequential or random read ahead for mapped input\n");
 		return 0;
 	}	
 	folderName = "indir";
@@ -192,6 +203,13 @@ out_error:
 	WatchFolder * myWF = new WatchFolder(folderToWatch, outdir, numFiles);
 	ASFileSysReleasePath(NULL, folderToWatch);
 
+	// "SampleInterval=milliseconds" on the command line writes a time series of the
+	// run into "SampleFile=name" (default samples.csv), see WatchSampler
+	myWF->startSampler(argc, argv);
+
+	// "MappedInput=true" opens input documents through the memory mapped file system
+	SetMappedInputOptions(argc, argv);
+
 	// Allocate the thread block
 	myThreads = static_cast<ThreadInfo *>(ASmalloc( sizeof( ThreadInfo ) * numThreads));
 
@@ -256,6 +274,7 @@ out_error:
 		destroyThread(myThreads[j]);
 		ASfree(myThreadArgs[j].tName);
 	}
+	myWF->stopSampler();
 
 /* DLADD */
 #ifndef WIN32
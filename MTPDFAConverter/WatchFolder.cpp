@@ -65,6 +65,8 @@ WatchFolder::WatchFolder(ASPathName folderToWatch, const char * outDir, ASInt32
 }
 
 WatchFolder::~WatchFolder(){
+	this->sampler.stop();
+
 	// clean out the vectors
 
 	while(dirContents.size()>0){
@@ -185,6 +187,7 @@ WatchFolder::addFile(ASPathName newPath){
 			// debug:printf("Adding new file %s\n",ASFileSysDIPathFromPath(NULL,newPath,NULL));
 			EnterCS(this->watchFolderMutex);
 			dirContents.push_back(pathToTest);
+			watchFolderProbe2(enqueue, pathToTest, (int)dirContents.size());
 			LeaveCS(this->watchFolderMutex);
 		}
 	}
@@ -234,8 +237,23 @@ WatchFolder::getFile(){
 	
 	// update the number of files still to be handled
 	this->numToReturn--;
+	ASInt32 started = this->sampler.fileStarted();
+	watchFolderProbe3(dequeue, tmp, (int)dirContents.size(), started);
 	LeaveCS(this->watchFolderMutex);
 	return tmp;
 }
 
+void 
+WatchFolder::fileDone(){
+	this->sampler.fileDone();
+}
+
+void 
+WatchFolder::startSampler(int argc, char *argv[]){
+	this->sampler.start(argc, argv);
+}
 
+void 
+WatchFolder::stopSampler(){
+	this->sampler.stop();
+}
@@ -184,6 +184,10 @@ int MainProc(int argc, char *argv[] )
 	WatchFolder * myWF = new WatchFolder(folderToWatch, outdir, numFiles);
 	ASFileSysReleasePath(NULL, folderToWatch);
 
+	// "SampleInterval=milliseconds" on the command line writes a time series of the
+	// run into "SampleFile=name" (default samples.csv), see WatchSampler
+	myWF->startSampler(argc, argv);
+
 	// Allocate the thread block
 	myThreads = static_cast<ThreadInfo *>(ASmalloc( sizeof( ThreadInfo ) * numThreads));
 
@@ -247,6 +251,7 @@ int MainProc(int argc, char *argv[] )
 		destroyThread(myThreads[j]);
 		ASfree(myThreadArgs[j].tName);
 	}
+	myWF->stopSampler();
 
 /* DLADD */
 #ifndef WIN32
@@ -18,10 +18,12 @@
 #include <vector>
 #include <string>
 #include <string.h>
+#include <stdio.h>
 
 #include "ASCalls.h"
 #include "PDCalls.h"
 #include "SDKThreads.h"
+#include "../MTCommon/WatchSampler.h"
 class WatchFolder;
 
 typedef struct ThreadArgs {
@@ -102,6 +104,19 @@ public:
 	*/
 	void watchFolder();
 
+	/** Starts the sampler, which writes a time series of the service to a file,
+		as given on the command line ("SampleInterval=" and "SampleFile=").
+		@see WatchSampler
+	*/
+	void startSampler(int argc, char *argv[]);
+	/** Stops the sampler, if it was started, after writing a last line.
+	*/
+	void stopSampler();
+	/** Called by a worker thread when it has finished with a file returned by
+		getFile, so the sampler can count files completed and in progress.
+	*/
+	void fileDone();
+
 private:
 	/** Adds work (new files). Called with a path of a file to be processed. This 
 		call does not guarantee the file will be processed, if the limit of files
@@ -137,6 +152,11 @@ private:
 
 	const char * outputFolder;
 
+	/** Counts the files returned by getFile and finished with, and writes
+		the time series of the service.
+	*/
+	WatchSampler sampler;
+
 public:
 	/** The number of files to return to the calling client. Once this limit is reached, NULL is	
 		returned.
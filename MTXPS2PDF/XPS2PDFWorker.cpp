@@ -39,7 +39,8 @@
 #define PLATFORM_LANGUAGE "ENU"
 #define JOB_OPTIONS_NAME "../../Resource/joboptions/Standard.joboptions"
 
-int XPSToPDFMain(char* input, char*output);
+int XPSToPDFMain(ASCab settingsCab, char* input, char*output);
+ASCab XPSToPDFSettings();
 
 ThreadFuncReturnType OneXPS2PDF(ThreadArgs *pArgs)
 {
@@ -55,6 +56,8 @@ ThreadFuncReturnType OneXPS2PDF(ThreadArgs *pArgs)
         fprintf(stderr, "Error initializing XPS2PDF Plugin -- aborting\n");
         return NULL;
     }
+    // the conversion settings are the same for every file, so build them once per thread
+    ASCab settingsCab = XPSToPDFSettings();
     printf("Begin to convert one XPS 2 PDF ... \n");
 	while (1){
 		
@@ -68,7 +71,9 @@ ThreadFuncReturnType OneXPS2PDF(ThreadArgs *pArgs)
 		// we terminate the main loop if the watchFolder abstraction
 		// gives us a NULL token. This thread can now die.
 		if (fileToExtract == NULL) {
-            //Terminate XPS2PDF plugin
+            //release the conversion settings, and terminate XPS2PDF plugin
+            if (settingsCab)
+                ASCabDestroy(settingsCab);
             XPS2PDFTerminate();
 			MyPDFLTerm();
 			/////break;
@@ -111,32 +116,44 @@ ThreadFuncReturnType OneXPS2PDF(ThreadArgs *pArgs)
         //XPS2PDF using API with Callback
         printf("\nConverting XPS2PDF (with Callback)\n");
 
-        XPSToPDFMain(inputbuffer, outputbuffer);
+        XPSToPDFMain(settingsCab, inputbuffer, outputbuffer);
 
         HANDLER
         printf("MainProc has thrown an exception...\n");
         DisplayError(ERRORCODE);
         END_HANDLER
 
+        // let the watched folder count the file as done
+        theWF->fileDone();
 	}
 	
 	RELEASE_AUTO_POOL(autoReleasePool); /* Required only on MAC platform */
 	
 	return 0;
 }
-int XPSToPDFMain(char* input, char*output)
+// build the conversion settings used for every file converted by a thread
+ASCab XPSToPDFSettings()
 {
-	ASInt32 ret_val = 0;
-	PDDoc outPDDoc = NULL;
+	ASCab settingsCab = NULL;
 	DURING
-		ASCab settingsCab = ASCabNew();
+		settingsCab = ASCabNew();
 	// DLADD kshahn 4Aug2009 - Next two lines: convert second param to ASHostEncoding
 	ASText langText = ASTextFromEncoded(PLATFORM_LANGUAGE, ASScriptToHostEncoding(kASRomanScript));
 	ASText joNameText = ASTextFromEncoded(JOB_OPTIONS_NAME, ASScriptToHostEncoding(kASRomanScript));
 
 	ASCabPutText(settingsCab, XPS_CONVERSION_OPTION_KEYLANG, langText);
 	ASCabPutText(settingsCab, XPS_CONVERSION_OPTION_KEY, joNameText);
+	HANDLER
+		DisplayError(ERRORCODE);
+	END_HANDLER
+		return settingsCab;
+}
 
+int XPSToPDFMain(ASCab settingsCab, char* input, char*output)
+{
+	ASInt32 ret_val = 0;
+	PDDoc outPDDoc = NULL;
+	DURING
 	ASFileSys asFileSys = ASGetDefaultFileSys();
     ASPathName asInPathName = ASFileSysCreatePathName(NULL, ASAtomFromString("Cstring"), input, 0);
     ASPathName asOutPathName = ASFileSysCreatePathName(NULL, ASAtomFromString("Cstring"), output, 0);
@@ -153,7 +170,6 @@ int XPSToPDFMain(char* input, char*output)
         printf("file %s conversion failed\n", input);
 
 	//clean up args when done
-	ASCabDestroy(settingsCab);
 	ASFileSysReleasePath(NULL, asInPathName);
 	ASFileSysReleasePath(NULL, asOutPathName);
 	HANDLER
@@ -57,6 +57,7 @@ void AccessWorker::WorkerThread (ThreadInfo *info)
         size_t pageCount = PDDocGetNumPages (inDoc);
 
         /* Foreach page in the document */
+        SetWorkerPhase (PhaseExtract);
         for (size_t index = 0; index < pageCount; index++)
         {
             /* Acauire the page */
@@ -74,9 +75,10 @@ void AccessWorker::WorkerThread (ThreadInfo *info)
             /* Release the Page */
             PDPageRelease (page);
         }
+        SetWorkerPhase (PhaseOther);
 
         /* Close the document */
-        PDDocClose (inDoc);
+        CloseSampleFile (inDoc);
 
     HANDLER
         info->result = 1;
@@ -0,0 +1,517 @@
+//=====================================================================
+// AllocatorBench - Measures the memory managers of the MultiThreadingSample
+//                  framework alone, without APDFL.
+//
+//   Each thread allocates, reallocates and frees blocks through a memory
+//   manager's TKAllocatorProcs, with sizes spread as APDFL's are (mostly small
+//   objects, some buffers, a few large blocks), holding a set of live blocks.
+//   When "CrossThread=true" is given, some blocks are handed to the next
+//   thread to be freed, as happens when documents or caches are shared.
+//
+//   It is built with "make allocbench", and takes attributes as the sample does:
+//   "Allocators=" The memory managers to measure. Default is [malloc, slab, arena].
+//                 Any name accepted by "MemoryManager=" may be given, except "None".
+//   "Threads="    The number of threads. Default is 4.
+//   "Operations=" The number of allocations made by each thread. Default is 1000000.
+//   "Live="       The number of blocks each thread holds. Default is 1000.
+//   "CrossThread=" May be true or false. Default is false.
+//   "MemoryManagerLibrary=" As for the sample.
+//   "PinThreads=" As for the sample. Threads are always pinned for "numa".
+//
+//   When "Replay=" names a trace recorded by the sample ("AllocationTrace="), the
+//   trace is replayed instead, against each of the "Allocators=". Each thread in
+//   the trace is replayed by a thread of it's own, making the same calls in the same
+//   order. A block freed by a thread other than the one that allocated it is waited
+//   for, until the allocating thread has reached that point in the trace.
+//=====================================================================
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "MTHeader.h"
+#include "malloc_memory.h"
+#include "tcmalloc_memory.h"
+#include "jemalloc_memory.h"
+#include "mimalloc_memory.h"
+#include "rpmalloc_memory.h"
+#include "arena_memory.h"
+#include "slab_memory.h"
+#include "numa_memory.h"
+#include "loadable_memory.h"
+#include "allocation_trace.h"
+#include "latency_histogram.h"
+#include "option_names.h"
+
+/* A memory manager to measure, and what each thread must do to use it */
+typedef struct benchAllocator
+{
+    TKAllocatorProcs   *procs;
+    bool                perThread;              /* The allocator is made by each thread (arena) */
+    bool                numa;                   /* Each thread's arena is on it's NUMA node */
+    bool                rpmalloc;               /* rpmalloc needs each thread initialized */
+    bool                slab;                   /* slab threads return their magazines as they end */
+} BenchAllocator;
+
+/* Blocks handed from one thread to the next, when CrossThread=true */
+typedef struct benchInbox
+{
+    CSMutex             lock;
+    void              **blocks;
+    int                 count, size;
+} BenchInbox;
+
+typedef struct benchThread
+{
+    SDKThreadID         threadID;
+    int                 threadNumber;
+    TKAllocatorProcs   *procs;
+    BenchAllocator     *allocator;
+    BenchInbox          inbox;
+    struct benchThread *next;                   /* Thread to hand blocks to */
+    bool                threadCompleted;
+} BenchThread;
+
+static int      benchOperations = 1000000;
+static int      benchLive = 1000;
+static bool     benchCrossThread = false;
+static volatile bool benchStart = false;
+
+
+/* A size, spread as APDFL's are: 70% up to 128 bytes, 25% up to 2K, 5% up to 64K */
+static size_t BenchSize (unsigned int *seed)
+{
+    *seed = (*seed * 1103515245) + 12345;
+    unsigned int value = *seed >> 8;
+    int kind = value % 100;
+    value /= 100;
+    if (kind < 70)
+        return (16 + (value % 113));
+    if (kind < 95)
+        return (128 + (value % 1921));
+    return (2048 + (value % 63489));
+}
+
+/* Free the blocks other threads have handed to this one */
+static void DrainInbox (BenchThread *thread)
+{
+    EnterCS (thread->inbox.lock);
+    for (int index = 0; index < thread->inbox.count; index++)
+        thread->procs->freeProc (thread->procs->clientData, thread->inbox.blocks[index]);
+    thread->inbox.count = 0;
+    LeaveCS (thread->inbox.lock);
+}
+
+/* Hand a block to the next thread, or free it here if that thread's inbox is full */
+static void HandOff (BenchThread *thread, void *block)
+{
+    BenchInbox *inbox = &thread->next->inbox;
+    EnterCS (inbox->lock);
+    bool handed = (inbox->count < inbox->size);
+    if (handed)
+        inbox->blocks[inbox->count++] = block;
+    LeaveCS (inbox->lock);
+    if (!handed)
+        thread->procs->freeProc (thread->procs->clientData, block);
+}
+
+/* Prepare a thread to use the allocator, and return the interface it should use */
+static TKAllocatorProcs *BenchThreadStart (BenchAllocator *allocator, int threadNumber)
+{
+    numa_pin_thread (threadNumber);
+#ifndef MAC_ENV
+    if (allocator->rpmalloc)
+        rpmalloc_init ();
+#endif
+    TKAllocatorProcs *arena = NULL;
+    if (allocator->numa)
+        arena = arena_create_on_node (numa_current_node ());
+    else if (allocator->perThread)
+        arena = arena_create ();
+    else
+        return (allocator->procs);
+    if (!arena)
+    {
+        printf ("An arena could not be allocated for thread %01d.\n", threadNumber + 1);
+        exit (-1);
+    }
+    return (arena);
+}
+
+/* Release what a thread kept for the allocator (An arena is released later, by the main line) */
+static void BenchThreadEnd (BenchAllocator *allocator)
+{
+    if (allocator->slab)
+        slab_thread_finalize ();
+#ifndef MAC_ENV
+    if (allocator->rpmalloc)
+        rpmalloc_term ();
+#endif
+}
+
+ThreadFuncReturnType benchWorker (BenchThread *thread)
+{
+    thread->procs = BenchThreadStart (thread->allocator, thread->threadNumber);
+
+    while (!benchStart)
+        ThreadSleep (1);
+
+    TKAllocatorProcs *procs = thread->procs;
+    void **live = (void **)calloc (benchLive, sizeof (void *));
+    unsigned int seed = 12345 + thread->threadNumber;
+    for (int operation = 0; operation < benchOperations; operation++)
+    {
+        int slot = (seed >> 4) % benchLive;
+        if (live[slot])
+        {
+            /* One block in eight is reallocated, and then freed, rather than just freed */
+            if ((seed & 7) == 0)
+                live[slot] = procs->reallocProc (procs->clientData, live[slot], BenchSize (&seed));
+            if (benchCrossThread && (seed & 1))
+                HandOff (thread, live[slot]);
+            else
+                procs->freeProc (procs->clientData, live[slot]);
+        }
+        size_t size = BenchSize (&seed);
+        live[slot] = procs->allocProc (procs->clientData, size);
+        memset (live[slot], 0, size < 64 ? size : 64);
+
+        if (benchCrossThread && ((operation & 255) == 0))
+            DrainInbox (thread);
+    }
+
+    for (int slot = 0; slot < benchLive; slot++)
+        if (live[slot])
+            procs->freeProc (procs->clientData, live[slot]);
+    free (live);
+    BenchThreadEnd (thread->allocator);
+
+    thread->threadCompleted = true;
+    return (0);
+}
+
+/* Find a memory manager by name. Returns false if it is not known, or cannot be loaded */
+static bool SelectBenchAllocator (char *name, BenchAllocator *allocator)
+{
+    memset (allocator, 0, sizeof (BenchAllocator));
+    if (OptionIs (name, "MALLOC"))
+        allocator->procs = malloc_access ();
+    else if (OptionIs (name, "TCMALLOC"))
+        allocator->procs = tcmalloc_access ();
+    else if (OptionIs (name, "JEMALLOC"))
+        allocator->procs = jemalloc_access ();
+    else if (OptionIs (name, "MIMALLOC"))
+        allocator->procs = mimalloc_access ();
+    else if (OptionIs (name, "SLAB"))
+    {
+        allocator->procs = slab_access ();
+        allocator->slab = true;
+    }
+    else if (OptionIs (name, "ARENA"))
+        allocator->perThread = true;
+    else if (OptionIs (name, "NUMA"))
+        allocator->perThread = allocator->numa = true;
+#ifndef MAC_ENV
+    else if (OptionIs (name, "RPMALLOC"))
+    {
+        allocator->procs = rpmalloc_access ();
+        allocator->rpmalloc = true;
+    }
+#endif
+
+    if (!allocator->procs && !allocator->perThread)
+    {
+        printf ("%-10s  Not available.\n", name);
+        return (false);
+    }
+    return (true);
+}
+
+/* Run the benchmark for one memory manager */
+static void RunBench (char *name, int threadCount)
+{
+    BenchAllocator allocator;
+    if (!SelectBenchAllocator (name, &allocator))
+        return;
+
+    BenchThread *threads = (BenchThread *)calloc (threadCount, sizeof (BenchThread));
+    benchStart = false;
+    for (int index = 0; index < threadCount; index++)
+    {
+        threads[index].threadNumber = index;
+        threads[index].allocator = &allocator;
+        threads[index].next = &threads[(index + 1) % threadCount];
+        InitCS (threads[index].inbox.lock);
+        threads[index].inbox.size = benchLive;
+        threads[index].inbox.blocks = (void **)malloc (benchLive * sizeof (void *));
+    }
+    for (int index = 0; index < threadCount; index++)
+        createThread (benchWorker, threads[index]);
+
+    double start = LatencyClock ();
+    benchStart = true;
+    for (int index = 0; index < threadCount; index++)
+        while (!threads[index].threadCompleted)
+            ThreadSleep (1);
+    double seconds = LatencyClock () - start;
+
+    /* Free anything still handed off, and end the threads. Every inbox is drained before 
+    ** any arena is released, as an inbox may hold blocks from the arena of another thread.
+    */
+    for (int index = 0; index < threadCount; index++)
+        DrainInbox (&threads[index]);
+    for (int index = 0; index < threadCount; index++)
+    {
+        if (allocator.perThread)
+            arena_release (threads[index].procs);
+        destroyThread ((&threads[index]));
+        DestroyCS (threads[index].inbox.lock);
+        free (threads[index].inbox.blocks);
+    }
+    free (threads);
+
+    double operations = (double)benchOperations * threadCount;
+    printf ("%-10s  %8.3f seconds  %8.3f million allocations per second  %8.1f ns per allocation\n",
+        name, seconds, (operations / seconds) / 1000000.0, (seconds * 1000000000.0 * threadCount) / operations);
+}
+
+/* A trace being replayed. Records are indexed by block serial number, so the
+** block pointers can be shared by the threads replaying it.
+*/
+typedef struct replayThread
+{
+    SDKThreadID         threadID;
+    int                 threadNumber;
+    ASUns64            *records;                /* Indexes of this thread's records, in order */
+    ASUns64             count;
+    BenchAllocator     *allocator;
+    ASUns64             waits, skipped;         /* Blocks waited for, and given up on */
+    bool                threadCompleted;
+} ReplayThread;
+
+static AllocationRecord    *replayRecords = NULL;
+static ASUns64              replayCount = 0, replayBlocks = 0;
+static int                  replayThreadCount = 0;
+static ReplayThread        *replayThreads = NULL;
+static void * volatile     *replayPointers = NULL;
+
+/* Read a trace, and divide it's records among the threads that made them */
+static bool LoadTrace (char *name)
+{
+    FILE *file = fopen (name, "rb");
+    if (!file)
+    {
+        printf ("The trace \"%s\" cannot be opened.\n", name);
+        return (false);
+    }
+
+    AllocationTraceHeader header;
+    if ((fread (&header, sizeof (header), 1, file) != 1) || memcmp (header.magic, AllocationTraceMagic, 4) ||
+        (header.version != AllocationTraceVersion) || (header.recordSize != sizeof (AllocationRecord)))
+    {
+        printf ("\"%s\" is not an allocation trace, or was written by another version.\n", name);
+        fclose (file);
+        return (false);
+    }
+
+    fseek (file, 0, SEEK_END);
+    replayCount = (ftell (file) - sizeof (header)) / sizeof (AllocationRecord);
+    fseek (file, sizeof (header), SEEK_SET);
+    replayRecords = (AllocationRecord *)malloc ((size_t)(replayCount ? replayCount : 1) * sizeof (AllocationRecord));
+    replayCount = fread (replayRecords, sizeof (AllocationRecord), (size_t)replayCount, file);
+    fclose (file);
+
+    for (ASUns64 index = 0; index < replayCount; index++)
+    {
+        if ((int)replayRecords[index].thread > replayThreadCount)
+            replayThreadCount = replayRecords[index].thread;
+        if (replayRecords[index].block > replayBlocks)
+            replayBlocks = replayRecords[index].block;
+    }
+
+    replayThreads = (ReplayThread *)calloc (replayThreadCount + 1, sizeof (ReplayThread));
+    for (ASUns64 index = 0; index < replayCount; index++)
+        replayThreads[replayRecords[index].thread].count++;
+    for (int thread = 0; thread <= replayThreadCount; thread++)
+    {
+        replayThreads[thread].records = (ASUns64 *)malloc ((size_t)(replayThreads[thread].count + 1) * sizeof (ASUns64));
+        replayThreads[thread].count = 0;
+    }
+    for (ASUns64 index = 0; index < replayCount; index++)
+    {
+        ReplayThread *thread = &replayThreads[replayRecords[index].thread];
+        thread->records[thread->count++] = index;
+    }
+    return (true);
+}
+
+/* Wait for another thread to allocate a block. Returns NULL if it is not allocated within a second */
+static void *ReplayWait (ReplayThread *thread, ASUns64 block)
+{
+    void *pointer = replayPointers[block];
+    if (pointer)
+        return (pointer);
+
+    thread->waits++;
+    for (int waited = 0; !pointer && (waited < 1000); waited++)
+    {
+        ThreadSleep (1);
+        pointer = replayPointers[block];
+    }
+    if (!pointer)
+        thread->skipped++;
+    return (pointer);
+}
+
+ThreadFuncReturnType replayWorker (ReplayThread *thread)
+{
+    TKAllocatorProcs *procs = BenchThreadStart (thread->allocator, thread->threadNumber);
+    while (!benchStart)
+        ThreadSleep (1);
+
+    for (ASUns64 index = 0; index < thread->count; index++)
+    {
+        AllocationRecord *record = &replayRecords[thread->records[index]];
+        void *pointer;
+        switch (record->operation)
+        {
+        case TraceAllocate:
+            pointer = procs->allocProc (procs->clientData, record->size);
+            memset (pointer, 0, record->size < 64 ? record->size : 64);
+            replayPointers[record->block] = pointer;
+            break;
+        case TraceReallocate:
+            pointer = ReplayWait (thread, record->block);
+            if (pointer)
+                replayPointers[record->block] = procs->reallocProc (procs->clientData, pointer, record->size);
+            break;
+        case TraceFree:
+            pointer = ReplayWait (thread, record->block);
+            if (pointer)
+            {
+                replayPointers[record->block] = NULL;
+                procs->freeProc (procs->clientData, pointer);
+            }
+            break;
+        }
+    }
+
+    /* An arena is kept until every thread is done, as other threads may hold it's blocks */
+    if (thread->allocator->perThread)
+        thread->allocator->procs = procs;
+    BenchThreadEnd (thread->allocator);
+    thread->threadCompleted = true;
+    return (0);
+}
+
+/* Replay the trace against one memory manager */
+static void RunReplay (char *name)
+{
+    BenchAllocator allocator;
+    if (!SelectBenchAllocator (name, &allocator))
+        return;
+
+    replayPointers = (void * volatile *)calloc ((size_t)replayBlocks + 1, sizeof (void *));
+    BenchAllocator *threadAllocators = (BenchAllocator *)calloc (replayThreadCount + 1, sizeof (BenchAllocator));
+    benchStart = false;
+    for (int index = 0; index <= replayThreadCount; index++)
+    {
+        ReplayThread *thread = &replayThreads[index];
+        threadAllocators[index] = allocator;
+        thread->allocator = &threadAllocators[index];
+        thread->threadNumber = index;
+        thread->waits = thread->skipped = 0;
+        thread->threadCompleted = false;
+        createThread (replayWorker, replayThreads[index]);
+    }
+
+    double start = LatencyClock ();
+    benchStart = true;
+    ASUns64 waits = 0, skipped = 0;
+    for (int index = 0; index <= replayThreadCount; index++)
+    {
+        while (!replayThreads[index].threadCompleted)
+            ThreadSleep (1);
+        waits += replayThreads[index].waits;
+        skipped += replayThreads[index].skipped;
+    }
+    double seconds = LatencyClock () - start;
+
+    /* Free the blocks the trace left allocated, then end the threads. Blocks in an arena are released with it. */
+    if (!allocator.perThread)
+        for (ASUns64 block = 1; block <= replayBlocks; block++)
+            if (replayPointers[block])
+                allocator.procs->freeProc (allocator.procs->clientData, replayPointers[block]);
+    for (int index = 0; index <= replayThreadCount; index++)
+    {
+        if (allocator.perThread)
+            arena_release (threadAllocators[index].procs);
+        destroyThread ((&replayThreads[index]));
+    }
+    free (threadAllocators);
+    free ((void *)replayPointers);
+
+    printf ("%-10s  %8.3f seconds  %8.3f million calls per second  %01llu blocks waited for from another thread, %01llu given up.\n",
+        name, seconds, (replayCount / seconds) / 1000000.0, (unsigned long long)waits, (unsigned long long)skipped);
+}
+
+int main (int argc, char **argv)
+{
+    attributes benchAttributes (argc, argv);
+
+    int threadCount = 4;
+    if (benchAttributes.IsKeyPresent ("Threads"))
+        threadCount = benchAttributes.GetKeyValueInt ("Threads");
+    if (benchAttributes.IsKeyPresent ("Operations"))
+        benchOperations = benchAttributes.GetKeyValueInt ("Operations");
+    if (benchAttributes.IsKeyPresent ("Live"))
+        benchLive = benchAttributes.GetKeyValueInt ("Live");
+    benchCrossThread = benchAttributes.GetKeyValueBool ("CrossThread");
+    if (benchAttributes.IsKeyPresent ("MemoryManagerLibrary"))
+        loadable_set_library (benchAttributes.GetKeyValue ("MemoryManagerLibrary")->value (0));
+
+#ifndef MAC_ENV
+    rpmalloc_master_initialize ();
+#endif
+    arena_master_initialize ();
+    slab_master_initialize ();
+
+    /* Threads are pinned if any allocator measured is numa */
+    bool numa = false;
+    valuelist *allocatorList = benchAttributes.GetKeyValue ("Allocators");
+    for (int index = 0; allocatorList && index < allocatorList->size (); index++)
+        numa |= OptionIs (allocatorList->value (index), "NUMA");
+    numa_master_initialize (&benchAttributes, numa);
+
+    bool replay = benchAttributes.IsKeyPresent ("Replay");
+    if (replay)
+    {
+        if (!LoadTrace (benchAttributes.GetKeyValue ("Replay")->value (0)))
+            return (-1);
+        printf ("Replaying %01llu calls, for %01llu blocks, made by %01d threads.\n\n",
+            (unsigned long long)replayCount, (unsigned long long)replayBlocks, replayThreadCount);
+    }
+    else
+        printf ("%01d threads, %01d allocations each, %01d blocks live in each thread%s.\n\n",
+            threadCount, benchOperations, benchLive, benchCrossThread ? ", some freed by another thread" : "");
+
+    char *defaultAllocators[3] = { (char *)"malloc", (char *)"slab", (char *)"arena" };
+    valuelist *allocators = benchAttributes.GetKeyValue ("Allocators");
+    int allocatorCount = allocators ? allocators->size () : 3;
+    for (int index = 0; index < allocatorCount; index++)
+    {
+        char *name = allocators ? allocators->value (index) : defaultAllocators[index];
+        if (replay)
+            RunReplay (name);
+        else
+            RunBench (name, threadCount);
+    }
+
+    numa_report (stdout);
+    numa_master_finalize ();
+    slab_master_finalize ();
+    arena_master_finalize ();
+#ifndef MAC_ENV
+    rpmalloc_master_finalize ();
+#endif
+    return (0);
+}
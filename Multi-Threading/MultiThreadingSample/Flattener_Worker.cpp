@@ -11,6 +11,7 @@
 **                   noAPDFL=false                                      When true, we will NOT init/term the library for each thread
 */
 #include "Flattener_Worker.h"
+#include "trace_events.h"
 
 #include "PDFlattenerCalls.h"
 #include "ASExtraCalls.h"
@@ -47,6 +48,80 @@ void FlattenWorker::ParseOptions (attributes *FrameAttributes, WorkerType *worke
         saveOutput = threadAttributes->GetKeyValueBool ("SaveOutput");
 };
 
+/* The flattener settings which do not change from job to job.
+** These are built once for each plugin session.
+*/
+typedef struct flattenerSession
+{
+    PDFlattenRec    flattener;
+    ASText          profileDesc;
+} FlattenerSession;
+
+/* Start a PDFlattener plugin session, and build the flattener settings
+** used by every job in the session.
+*/
+bool FlattenWorker::StartSession (void **sessionData)
+{
+    /* Initialize the HFT for the plugin */
+    gPDFlattenerHFT = InitPDFlattenerHFT;;
+
+    //initialize PDFlattener plugin
+    *sessionData = NULL;
+    if (!PDFlattenerInitialize ())
+        return (false);
+
+    FlattenerSession *session = (FlattenerSession *)malloc (sizeof (FlattenerSession));
+
+    //A profiled color space to use for transparent objects. For CMYK, use "U.S. Web Coated (SWOP)v2".
+    session->profileDesc = ASTextFromUnicode ((ASUTF16Val*)"sRGB IEC61966-2.1", kUTF8);
+
+    // Tile flattening options
+    PDFlattenRec *flattener = &session->flattener;
+    memset (flattener, 0, sizeof (PDFlattenRec));
+    flattener->size = sizeof (PDFlattenRec);
+
+    flattener->tilingMode = kPDNoTiling;
+    flattener->tileSizePts = 0;
+
+    //Resolution for flattening the interior of an atomic region.
+    flattener->internalDPI = 800.0f;
+    //Resolution for flattening edges of atomic regions.
+    flattener->externalDPI = 200.0f;
+
+    flattener->clipComplexRegions = false;
+    //If we convert stroked elements to filled elements.
+    flattener->strokeToFill = true;
+    //If we use rastered text instead of native text.
+    flattener->useTextOutlines = false;
+    //If we attempt to preserve overprint
+    flattener->preserveOverprint = true;
+
+    flattener->allowShadingOutput = true;
+    flattener->allowLevel3ShadingOutput = true;
+
+    //Maximum image size while flattening. 0 is default.
+    flattener->maxFltnrImageSize = 0;
+    //Adaptive flattening threshold. Doesn't matter, since we're not doing adaptive tiling. See tilingMode.
+    flattener->adaptiveThreshold = 0;
+
+    *sessionData = session;
+    return (true);
+}
+
+/* End a PDFlattener plugin session, releasing the session settings */
+void FlattenWorker::EndSession (void *sessionData)
+{
+    FlattenerSession *session = (FlattenerSession *)sessionData;
+    if (session)
+    {
+        ASTextDestroy (session->profileDesc);
+        free (session);
+    }
+
+    /* terminate the plugin */
+    PDFlattenerTerminate ();
+}
+
 void FlattenWorker::WorkerThread (ThreadInfo *info)
 {
     int sequence = info->sequence;
@@ -64,22 +139,21 @@ void FlattenWorker::WorkerThread (ThreadInfo *info)
         /* Free the input file names */
         free (fullFileName);
 
-        /* Initialize the HFT for the plugin */
-        gPDFlattenerHFT = InitPDFlattenerHFT;;
-
-        //initialize PDFProcessor plugin
-        if (!PDFlattenerInitialize ())
+        /* Start (or reuse) the PDFlattener plugin session */
+        if (!OpenSession (info))
             /* If the plugin cannot be initilized! */
             info->result = 1;
         else
         {
+            FlattenerSession *session = (FlattenerSession *)SessionData (info);
+
             /* COnstruct the user params recor for the flattening */
             PDFlattenerUserParamsRec flattenParams;
 
             memset (&flattenParams, 0, sizeof (PDFlattenerUserParamsRec));
             flattenParams.size = sizeof (PDFlattenerUserParamsRec);
-            //A profiled color space to use for transparent objects. For CMYK, use "U.S. Web Coated (SWOP)v2".
-            flattenParams.profileDesc = ASTextFromUnicode ((ASUTF16Val*)"sRGB IEC61966-2.1", kUTF8);
+            //A profiled color space to use for transparent objects (Built with the session).
+            flattenParams.profileDesc = session->profileDesc;
             //The ZIP compression scheme (Flate encoding) for images.
             flattenParams.colorCompression = kPDFlattenerZipCompression;
             //Raster/Vector balance. Use 0.00f for no vectors.
@@ -98,46 +172,20 @@ void FlattenWorker::WorkerThread (ThreadInfo *info)
             //The progress monitor callback function.
             if (useProgressMonitor)
                 flattenParams.flattenProgress = flattenerProgMon;
-            // Tile flattening options
-
-            PDFlattenRec flattener;
-            memset (&flattener, 0, sizeof (PDFlattenRec));
-            flattener.size = sizeof (PDFlattenRec);
-
-            flattener.tilingMode = kPDNoTiling;
-            flattener.tileSizePts = 0;
 
-            //Resolution for flattening the interior of an atomic region.
-            flattener.internalDPI = 800.0f;
-            //Resolution for flattening edges of atomic regions.
-            flattener.externalDPI = 200.0f;
-
-            flattener.clipComplexRegions = false;
-            //If we convert stroked elements to filled elements.
-            flattener.strokeToFill = true;
-            //If we use rastered text instead of native text.
-            flattener.useTextOutlines = false;
-            //If we attempt to preserve overprint
-            flattener.preserveOverprint = true;
-
-            flattener.allowShadingOutput = true;
-            flattener.allowLevel3ShadingOutput = true;
-
-            //Maximum image size while flattening. 0 is default.
-            flattener.maxFltnrImageSize = 0;
-            //Adaptive flattening threshold. Doesn't matter, since we're not doing adaptive tiling. See tilingMode.
-            flattener.adaptiveThreshold = 0;
-
-            flattenParams.flattenParams = &flattener;
+            // Tile flattening options (Built with the session).
+            flattenParams.flattenParams = &session->flattener;
 
             /* Perform the flatten document */
             ASUns32 numFlattened = 0;
+            SetWorkerPhase (PhaseConvert);
             ASInt32 flattenResult = PDFlattenerConvertEx2 (inDoc,      //The document whose pages we wish to flatten.
                 0,                     //The first page to flatten.
                 PDDocGetNumPages (inDoc) - 1,   //The last page to flatten.
                 &numFlattened,         //PDFlattener sets this to the number of pages
                 // it flattened. It will not flatten pages that do not contain transparent elements.
                 &flattenParams);             //Flattener options.
+            SetWorkerPhase (PhaseOther);
             if (flattenResult)
             {
                 if (!silent)
@@ -158,16 +206,16 @@ void FlattenWorker::WorkerThread (ThreadInfo *info)
 
             /* Release the output file name */
             free (fullOutputFileName);
-            ASTextDestroy (flattenParams.profileDesc);
 
             /* Close the input document */
-            PDDocClose (inDoc);
+            CloseSampleFile (inDoc);
 
-            /* terminate the plugin */
-            PDFlattenerTerminate ();
+            /* End the plugin session (A pool thread will keep it for the next job) */
+            CloseSession (info);
         }
     HANDLER
         info->result = 2;
+        CloseSession (info);
     END_HANDLER
 
         if (!silent)
@@ -186,6 +234,9 @@ ASBool flattenerProgMon (ASInt32 pageNum, ASInt32 totalPages, float current, ASI
             //Print the completion percentage.
             fprintf (data->logFile, "[%0.06g%%] Flattening page %01d of %01d.\n", current, pageNum + 1, totalPages);
 
+        //Mark the page on the timeline.
+        TraceProgress ("flatten page", pageNum, totalPages, current);
+
         //Update previous page.
         data->prevPage = pageNum;
     }
@@ -0,0 +1,524 @@
+/* This is a read only APDFL file system, used to open input documents from memory.
+**
+** File systems are accomplished through the APDFL interface element ASFileSysRec.
+** This structure identifies methods to be used for opening, reading, positioning
+** and closing files, and for managing the path names used to find them. Only the
+** methods needed to open and read a document are provided, the rest are left NULL.
+**
+** A path name in this file system is simply a copy of the C string file name.
+** An open file is the shared buffer for that name, and a position within it.
+**
+** Buffers are read (or mapped) once, and never changed after they are loaded.
+** The reference count for each buffer (one for the cache, and one for each open file)
+** is protected by the cache mutex.
+**
+** The cache mutex is not held while a file is read. The first thread to open a file
+** places an empty buffer in the cache, with the buffer's own lock held, and loads it.
+** Other threads opening the same file wait on that buffer's lock alone, so files which
+** are already loaded, or are being loaded by other threads, may still be opened.
+*/
+
+#include <stdlib.h>
+#include "InputFileSys.h"
+#include "option_names.h"
+#include "ASCalls.h"
+
+#ifndef WIN_PLATFORM
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+/* Errors returned by the file system procedures */
+#define InputFileError(code) ErrBuildCode (ErrAlways, ErrSysASFile, code)
+
+/* One cached input file */
+typedef struct inputBuffer
+{
+    char           *name;               /* File name, as given to OpenSampleFile */
+    char           *data;               /* Contents of the file */
+    ASUns64         size;               /* Size of the file, in bytes */
+    bool            mapped;             /* True if data is a file mapping, rather than allocated */
+    bool            loaded;             /* True once the contents are read, false if they could not be */
+    CSMutex         loadLock;           /* Held by the thread loading the buffer, until it is loaded */
+    ASInt32         references;         /* One for the cache, and one for each open file */
+} InputBuffer;
+
+/* One open file */
+typedef struct inputFile
+{
+    InputBuffer    *buffer;             /* Buffer the file is read from */
+    ASUns64         position;           /* Position of the next read */
+} InputFile;
+
+static const char *inputModeNames[NumberOfInputModes] =
+{ "DISK", "MEMORY", "MMAP" };
+
+static const char *inputAccessNames[NumberOfInputAccess] =
+{ "NORMAL", "SEQUENTIAL", "RANDOM" };
+
+typedef std::map<std::string, InputBuffer *> InputCacheDict;
+
+static InputModes       inputMode = InputFromDisk;
+static InputAccess      inputAccess = InputAccessNormal;
+static ASFileSysRec     inputFileSysRec;
+static CSMutex          inputCacheLock;
+static InputCacheDict   inputCache;
+
+/* Usage counts, for the report at the end of the run */
+static ASInt32          inputFilesLoaded = 0;
+static ASInt32          inputFilesOpened = 0;
+static ASUns64          inputBytesLoaded = 0;
+
+
+/* Allocate a buffer, and copy the file name into it */
+static InputBuffer *NewInputBuffer (char *name)
+{
+    InputBuffer *buffer = (InputBuffer *)malloc (sizeof (InputBuffer));
+    buffer->name = (char *)malloc (strlen (name) + 1);
+    strcpy (buffer->name, name);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->mapped = false;
+    buffer->loaded = false;
+    InitCS (buffer->loadLock);
+    buffer->references = 1;
+    return (buffer);
+}
+
+/* Release the contents of a buffer, and the buffer itself */
+static void FreeInputBuffer (InputBuffer *buffer)
+{
+    if (buffer->mapped)
+    {
+#ifdef WIN_PLATFORM
+        UnmapViewOfFile (buffer->data);
+#else
+        munmap (buffer->data, (size_t)buffer->size);
+#endif
+    }
+    else
+        free (buffer->data);
+    DestroyCS (buffer->loadLock);
+    free (buffer->name);
+    free (buffer);
+}
+
+/* Map a file, read only, into a buffer.
+** Returns false if the file cannot be mapped.
+**
+** The mapping is backed directly by the page cache, so there is no private copy of
+** the file, and reads do not need a system call. The access pattern given by
+** "InputAccess=" is passed on to the kernel, to control read ahead.
+*/
+static bool MapInputBuffer (InputBuffer *buffer)
+{
+    char *name = buffer->name;
+
+#ifdef WIN_PLATFORM
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (inputAccess == InputAccessSequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if (inputAccess == InputAccessRandom)
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+
+    HANDLE file = CreateFileA (name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return (false);
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx (file, &fileSize);
+    buffer->size = fileSize.QuadPart;
+    if (buffer->size > 0)
+    {
+        HANDLE mapping = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+        {
+            buffer->data = (char *)MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle (mapping);
+        }
+        buffer->mapped = (buffer->data != NULL);
+    }
+    CloseHandle (file);
+#else
+    int file = open (name, O_RDONLY);
+    if (file < 0)
+        return (false);
+    struct stat fileStat;
+    fstat (file, &fileStat);
+    buffer->size = fileStat.st_size;
+    if (buffer->size > 0)
+    {
+        void *data = mmap (NULL, (size_t)buffer->size, PROT_READ, MAP_SHARED, file, 0);
+        if (data != MAP_FAILED)
+        {
+            buffer->data = (char *)data;
+            buffer->mapped = true;
+            if (inputAccess == InputAccessSequential)
+                madvise (data, (size_t)buffer->size, MADV_SEQUENTIAL);
+            else if (inputAccess == InputAccessRandom)
+                madvise (data, (size_t)buffer->size, MADV_RANDOM);
+        }
+    }
+    close (file);
+#endif
+
+    /* An empty file cannot be mapped, it gets an empty buffer instead */
+    if (buffer->size == 0)
+        buffer->data = (char *)malloc (1);
+    return (buffer->size == 0 || buffer->mapped);
+}
+
+/* Read a file from disc into a buffer.
+** Returns false if the file cannot be read.
+*/
+static bool LoadInputBuffer (InputBuffer *buffer)
+{
+    if (inputMode == InputFromMap)
+        return (MapInputBuffer (buffer));
+
+    FILE *file = fopen (buffer->name, "rb");
+    if (!file)
+        return (false);
+
+    fseek (file, 0, SEEK_END);
+    size_t fileSize = ftell (file);
+    fseek (file, 0, SEEK_SET);
+
+    buffer->size = fileSize;
+    buffer->data = (char *)malloc (fileSize ? fileSize : 1);
+    bool read = (buffer->data && fread (buffer->data, 1, fileSize, file) == fileSize);
+    fclose (file);
+    return (read);
+}
+
+/* Find a file in the cache, loading it if this is the first time it is opened.
+** The buffer returned carries a reference for the caller.
+*/
+static InputBuffer *AcquireInputBuffer (char *name)
+{
+    InputBuffer *buffer = NULL;
+
+    EnterCS (inputCacheLock);
+    InputCacheDict::iterator found = inputCache.find (std::string (name));
+    bool loading = (found == inputCache.end ());
+    if (loading)
+    {
+        /* Place an empty buffer in the cache, locked until this thread has loaded it */
+        buffer = NewInputBuffer (name);
+        EnterCS (buffer->loadLock);
+        inputCache.insert (std::pair<std::string, InputBuffer *> (std::string (name), buffer));
+    }
+    else
+        buffer = found->second;
+    buffer->references++;
+    LeaveCS (inputCacheLock);
+
+    if (loading)
+    {
+        buffer->loaded = LoadInputBuffer (buffer);
+        LeaveCS (buffer->loadLock);
+    }
+    else
+    {
+        /* Wait for the thread loading this buffer, if it has not finished */
+        EnterCS (buffer->loadLock);
+        LeaveCS (buffer->loadLock);
+    }
+
+    bool loaded = buffer->loaded;
+    bool last = false;
+    EnterCS (inputCacheLock);
+    if (loading && loaded)
+    {
+        inputFilesLoaded++;
+        inputBytesLoaded += buffer->size;
+    }
+    else if (loading)
+    {
+        /* Take the buffer out of the cache, so the next open of the file tries again */
+        inputCache.erase (std::string (name));
+        buffer->references--;
+    }
+    if (loaded)
+        inputFilesOpened++;
+    else
+        last = (--buffer->references == 0);
+    LeaveCS (inputCacheLock);
+
+    if (last)
+        FreeInputBuffer (buffer);
+    return (loaded ? buffer : NULL);
+}
+
+/* Release a reference to a buffer, freeing it when the last reference is gone */
+static void ReleaseInputBuffer (InputBuffer *buffer)
+{
+    EnterCS (inputCacheLock);
+    bool last = (--buffer->references == 0);
+    LeaveCS (inputCacheLock);
+
+    if (last)
+        FreeInputBuffer (buffer);
+}
+
+
+/* The file system procedures */
+static ACCB1 ASErrorCode ACCB2 inputOpen (ASPathName pathName, ASFileMode mode, ASMDFile *fP)
+{
+    *fP = NULL;
+
+    /* This is a read only file system */
+    if (mode & (ASFILE_WRITE | ASFILE_CREATE))
+        return (InputFileError (fileErrWrite));
+
+    InputBuffer *buffer = AcquireInputBuffer ((char *)pathName);
+    if (!buffer)
+        return (InputFileError (fileErrFNF));
+
+    InputFile *file = (InputFile *)malloc (sizeof (InputFile));
+    file->buffer = buffer;
+    file->position = 0;
+    *fP = (ASMDFile)file;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputClose (ASMDFile f)
+{
+    InputFile *file = (InputFile *)f;
+    ReleaseInputBuffer (file->buffer);
+    free (file);
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputFlush (ASMDFile f)
+{
+    return (0);
+}
+
+static ACCB1 ASSize_t ACCB2 inputRead (void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+    InputFile *file = (InputFile *)f;
+    ASUns64 wanted = (ASUns64)size * count;
+    ASUns64 available = (file->position < file->buffer->size) ? file->buffer->size - file->position : 0;
+    if (wanted > available)
+        wanted = available;
+
+    memcpy (ptr, file->buffer->data + file->position, (size_t)wanted);
+    file->position += wanted;
+    *pError = 0;
+    return ((ASSize_t)wanted);
+}
+
+static ACCB1 ASSize_t ACCB2 inputWrite (void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+    *pError = InputFileError (fileErrWrite);
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputSetPos (ASMDFile f, ASFilePos pos)
+{
+    ((InputFile *)f)->position = (ASUns64)pos;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputGetPos (ASMDFile f, ASFilePos *pos)
+{
+    *pos = (ASFilePos)((InputFile *)f)->position;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputGetEof (ASMDFile f, ASFilePos *pos)
+{
+    *pos = (ASFilePos)((InputFile *)f)->buffer->size;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputSetEof (ASMDFile f, ASFilePos pos)
+{
+    return (InputFileError (fileErrWrite));
+}
+
+static ACCB1 ASInt32 ACCB2 inputSetPos64 (ASMDFile f, ASFilePos64 pos)
+{
+    ((InputFile *)f)->position = (ASUns64)pos;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputGetPos64 (ASMDFile f, ASFilePos64 *pos)
+{
+    *pos = (ASFilePos64)((InputFile *)f)->position;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputGetEof64 (ASMDFile f, ASFilePos64 *pos)
+{
+    *pos = (ASFilePos64)((InputFile *)f)->buffer->size;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 inputSetEof64 (ASMDFile f, ASFilePos64 pos)
+{
+    return (InputFileError (fileErrWrite));
+}
+
+static ACCB1 ASPathName ACCB2 inputCopyPathName (ASPathName pathName)
+{
+    char *copy = (char *)malloc (strlen ((char *)pathName) + 1);
+    strcpy (copy, (char *)pathName);
+    return ((ASPathName)copy);
+}
+
+static ACCB1 void ACCB2 inputDisposePathName (ASPathName pathName)
+{
+    free (pathName);
+}
+
+static ACCB1 ASInt32 ACCB2 inputGetName (ASPathName pathName, char *name, ASInt32 maxLength)
+{
+    char *fullName = (char *)pathName;
+    char *fileName = strrchr (fullName, PathSep);
+    fileName = fileName ? fileName + 1 : fullName;
+    if (name && maxLength > 0)
+    {
+        strncpy (name, fileName, maxLength - 1);
+        name[maxLength - 1] = 0;
+    }
+    return ((ASInt32)strlen (fileName));
+}
+
+static ACCB1 char * ACCB2 inputDisplayStringFromPath (ASPathName pathName)
+{
+    char *display = (char *)ASmalloc (strlen ((char *)pathName) + 1);
+    strcpy (display, (char *)pathName);
+    return (display);
+}
+
+static ACCB1 ASBool ACCB2 inputIsSameFile (ASMDFile f, ASPathName pathName, ASPathName newPathName)
+{
+    return (!strcmp ((char *)pathName, (char *)newPathName));
+}
+
+static ACCB1 ASAtom ACCB2 inputGetFileSysName (void)
+{
+    return (ASAtomFromString ("MTInputFileSys"));
+}
+
+
+/* Select the input mode, and fill in the file system record */
+bool InitializeInputFileSys (attributes *FrameAttributes)
+{
+    inputMode = InputFromDisk;
+    if (FrameAttributes->IsKeyPresent ("InputCache"))
+    {
+        inputMode = (InputModes)OptionIndex (FrameAttributes->GetKeyValue ("InputCache")->value (0), inputModeNames, NumberOfInputModes);
+        if (inputMode == NumberOfInputModes)
+        {
+            inputMode = InputFromDisk;
+            return (false);
+        }
+    }
+
+    inputAccess = InputAccessNormal;
+    if (FrameAttributes->IsKeyPresent ("InputAccess"))
+    {
+        inputAccess = (InputAccess)OptionIndex (FrameAttributes->GetKeyValue ("InputAccess")->value (0), inputAccessNames, NumberOfInputAccess);
+        if (inputAccess == NumberOfInputAccess)
+        {
+            inputAccess = InputAccessNormal;
+            inputMode = InputFromDisk;
+            return (false);
+        }
+    }
+
+    if (inputMode == InputFromDisk)
+        return (true);
+
+    InitCS (inputCacheLock);
+
+    memset (&inputFileSysRec, 0, sizeof (ASFileSysRec));
+    inputFileSysRec.size = sizeof (ASFileSysRec);
+    inputFileSysRec.open = inputOpen;
+    inputFileSysRec.open64 = inputOpen;
+    inputFileSysRec.close = inputClose;
+    inputFileSysRec.flush = inputFlush;
+    inputFileSysRec.read = inputRead;
+    inputFileSysRec.write = inputWrite;
+    inputFileSysRec.setpos = inputSetPos;
+    inputFileSysRec.getpos = inputGetPos;
+    inputFileSysRec.seteof = inputSetEof;
+    inputFileSysRec.geteof = inputGetEof;
+    inputFileSysRec.setpos64 = inputSetPos64;
+    inputFileSysRec.getpos64 = inputGetPos64;
+    inputFileSysRec.seteof64 = inputSetEof64;
+    inputFileSysRec.geteof64 = inputGetEof64;
+    inputFileSysRec.copyPathName = inputCopyPathName;
+    inputFileSysRec.disposePathName = inputDisposePathName;
+    inputFileSysRec.getName = inputGetName;
+    inputFileSysRec.displayStringFromPath = inputDisplayStringFromPath;
+    inputFileSysRec.isSameFile = inputIsSameFile;
+    inputFileSysRec.getFileSysName = inputGetFileSysName;
+
+    return (true);
+}
+
+/* Release the cache's reference to every buffer. Buffers still open
+** (there should be none) are released when they are closed.
+*/
+void FinalizeInputFileSys ()
+{
+    if (inputMode == InputFromDisk)
+        return;
+
+    std::vector<InputBuffer *> buffers;
+    EnterCS (inputCacheLock);
+    for (InputCacheDict::iterator entry = inputCache.begin (); entry != inputCache.end (); entry++)
+        buffers.push_back (entry->second);
+    inputCache.clear ();
+    LeaveCS (inputCacheLock);
+
+    for (size_t index = 0; index < buffers.size (); index++)
+        ReleaseInputBuffer (buffers[index]);
+
+    DestroyCS (inputCacheLock);
+}
+
+InputModes GetInputMode ()
+{
+    return (inputMode);
+}
+
+const char *InputModeName (InputModes mode)
+{
+    return (inputModeNames[mode]);
+}
+
+InputAccess GetInputAccess ()
+{
+    return (inputAccess);
+}
+
+const char *InputAccessName (InputAccess access)
+{
+    return (inputAccessNames[access]);
+}
+
+ASFileSys GetInputFileSys ()
+{
+    if (inputMode == InputFromDisk)
+        return (NULL);
+    return (&inputFileSysRec);
+}
+
+ASPathName InputFileSysPathName (char *name)
+{
+    return (inputCopyPathName ((ASPathName)name));
+}
+
+void ReportInputFileSys (FILE *logFile)
+{
+    if (inputMode == InputFromDisk)
+        return;
+
+    fprintf (logFile, "Input cache (%s): %01d files (%0.5g MB) were %s once, and opened %01d times.\n",
+        inputModeNames[inputMode], inputFilesLoaded, inputBytesLoaded / (1024.0 * 1024.0),
+        (inputMode == InputFromMap) ? "mapped" : "read", inputFilesOpened);
+}
@@ -0,0 +1,82 @@
+/* This is a read only APDFL file system, used to open input documents from memory.
+**
+** File systems are accomplished through the APDFL interface element ASFileSysRec.
+** This structure identifies methods to be used for opening, reading, positioning
+** and closing files, and for managing the path names used to find them.
+**
+** When "InputCache=memory" is given, each distinct input file is read from disc once,
+** into an immutable buffer. That buffer is shared by every thread that opens the
+** file, and is reference counted, so that it is released only after the last
+** document opened from it is closed, and the cache itself is released.
+**
+** Reads are served from the shared buffer, with a file position kept for each
+** open file, so there is no need for a mutex while reading. Only finding (or
+** loading) a file in the cache, and releasing it, are protected by a mutex.
+**
+** When "InputCache=mmap" is given, each distinct input file is mapped, read only, into
+** memory instead, and shared in the same way. Reads are served straight from the
+** page cache, so there is no read system call, and no second copy of the file in
+** the process. "InputAccess=" may be normal, sequential or random, and is passed
+** to the kernel (madvise, or the Windows file flags) to control read ahead.
+**
+** The cache removes disc and page cache contention from the measurement of
+** the workers, much as a production service does when it downloads it's inputs
+** into memory before processing them.
+*/
+#ifndef INPUTFILESYS_H
+#define INPUTFILESYS_H
+
+#include "MTHeader.h"
+#include "ASExpT.h"
+
+/* The ways in which input documents may be read */
+typedef enum inputModes
+{
+    InputFromDisk,                  /* The default file system */
+    InputFromMemory,                /* Read once into a shared memory buffer (InputCache=memory) */
+    InputFromMap,                   /* Mapped once into memory, and shared (InputCache=mmap) */
+    NumberOfInputModes
+} InputModes;
+
+/* The access pattern expected for mapped inputs */
+typedef enum inputAccess
+{
+    InputAccessNormal,              /* Let the system decide (InputAccess=normal) */
+    InputAccessSequential,          /* Read ahead aggressively (InputAccess=sequential) */
+    InputAccessRandom,              /* Do not read ahead (InputAccess=random) */
+    NumberOfInputAccess
+} InputAccess;
+
+/* Select the input mode from the framework attributes ("InputCache=" and "InputAccess=").
+** Call this once, from the main line, before any worker threads are started.
+** Returns false if a value given is not known.
+*/
+bool InitializeInputFileSys (attributes *FrameAttributes);
+
+/* Release every cached input, after all worker threads are complete */
+void FinalizeInputFileSys ();
+
+/* Return the input mode in use */
+InputModes GetInputMode ();
+
+/* Return the name of an input mode */
+const char *InputModeName (InputModes mode);
+
+/* Return the access pattern in use, and it's name */
+InputAccess GetInputAccess ();
+const char *InputAccessName (InputAccess access);
+
+/* Return the file system to open inputs with, or NULL when the default
+** file system should be used.
+*/
+ASFileSys GetInputFileSys ();
+
+/* Create a path name in the input file system, for a C string file name.
+** Release it with ASFileSysReleasePath (GetInputFileSys (), path).
+*/
+ASPathName InputFileSysPathName (char *name);
+
+/* Write a line describing the use of the input cache to the log */
+void ReportInputFileSys (FILE *logFile);
+
+#endif
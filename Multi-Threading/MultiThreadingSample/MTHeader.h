@@ -163,6 +163,11 @@ public:
 */
 class attributes
 {
+private:
+    /* The value lists belong to the dictionary, so it may not be copied */
+    attributes (const attributes &);
+    attributes &operator= (const attributes &);
+
 public:
     typedef std::map<std::string, valuelist *> attributeDict;
     attributeDict keys;
@@ -196,7 +201,7 @@ public:
                 FILE *commandFile = fopen (argv[1], "r");
                 fseek (commandFile, 0, SEEK_END);
                 size_t fileSize = ftell (commandFile);
-                char *buffer = (char *)malloc (fileSize + 10);
+                buffer = (char *)malloc (fileSize + 10);
                 fseek (commandFile, 0, SEEK_SET);
                 memset (buffer, 0, fileSize + 10);
                 fread (buffer, 1, fileSize, commandFile);
@@ -239,10 +244,10 @@ public:
                 /* Attribute zero is always the path of the
                 ** executible being run.
                 */
-                key = (char *)malloc (12);
-                strcpy (key, "ProcessPath");
                 if (argv[0] == NULL)
                     continue;
+                key = (char *)malloc (12);
+                strcpy (key, "ProcessPath");
                 value = (char *)malloc (strlen (argv[0]) + 1);
                 strcpy (value, argv[0]);
             }
@@ -341,7 +346,7 @@ public:
                     /* There is no value associated with this keyword */
                     key = (char *)malloc (strlen (argv[count]) + 1);
                     value = (char *)malloc (1);
-                    value = NULL;
+                    value[0] = 0;
                     strcpy (key, argv[count]);
                 }
             }
@@ -349,6 +354,10 @@ public:
                 key[index] = toupper (key[index]);
             valuelist *values = new valuelist (value);
             AddKeyValue (key, values);
+
+            /* The dictionary keeps copies of both */
+            free (key);
+            free (value);
         }
 
         /* If we parsed a file, 
@@ -363,17 +372,20 @@ public:
 
     ~attributes ()
     {
+        for (attributeDict::iterator entry = keys.begin (); entry != keys.end (); entry++)
+            delete entry->second;
     }
 
+    /* The dictionary owns it's value lists. A key given twice keeps it's first value. */
     void AddKeyValue (char *key, valuelist *value)
     {
         std::string newKey(key);
 
-        keys.insert(std::pair<std::string, valuelist*>(newKey, value));
-
+        if (!keys.insert(std::pair<std::string, valuelist*>(newKey, value)).second)
+            delete value;
     }
 
-    valuelist *GetKeyValue (char *key)
+    valuelist *GetKeyValue (const char *key)
     {
         char localKey[100];
         strcpy (localKey, key);
@@ -390,7 +402,7 @@ public:
             return (NULL);
     }
 
-    bool IsKeyPresent (char *key)
+    bool IsKeyPresent (const char *key)
     {
         char localKey[100];
         strcpy (localKey, key);
@@ -402,7 +414,7 @@ public:
         return (found != keys.end());
     }
 
-    bool GetKeyValueBool (char *key)
+    bool GetKeyValueBool (const char *key)
     {
         if (IsKeyPresent (key))
         {
@@ -422,7 +434,7 @@ public:
             return false;
     }
 
-    int GetKeyValueInt (char *key)
+    int GetKeyValueInt (const char *key)
     {
         if (IsKeyPresent (key))
         {
@@ -436,7 +448,7 @@ public:
             return 0;
     }
 
-    double GetKeyValueDouble (char *key)
+    double GetKeyValueDouble (const char *key)
     {
         if (IsKeyPresent (key))
         {
@@ -474,6 +486,14 @@ typedef ThreadFuncReturnType ThreadFuncType (ThreadFuncArgType);
 #define WaitForAnyThreadComplete(list, size) \
     WaitForMultipleObjects (size < MAXIMUM_WAIT_OBJECTS ? size : MAXIMUM_WAIT_OBJECTS, (HANDLE *)list, false, INFINITE) - WAIT_OBJECT_0;
 
+#define ThreadSleep( milliseconds ) Sleep( milliseconds )
+
+/* Storage class for a variable with a separate value in each thread (Simple types only) */
+#define ThreadLocal __declspec( thread )
+
+/* Add to a 64 bit integer shared by threads, without a lock. Returns the new value */
+#define AtomicAdd64( target, value ) (InterlockedExchangeAdd64( (volatile LONGLONG *)(target), (value) ) + (value))
+
         
 
 typedef CRITICAL_SECTION CSMutex;
@@ -493,6 +513,14 @@ typedef ThreadFuncReturnType ThreadFuncType (ThreadFuncArgType);
 #define createThread( func, tinfo ) (pthread_create( &tinfo.threadID, NULL, (ThreadFuncType *)func, &tinfo) == 0)
 #define destroyThread( tinfo ) pthread_detach( tinfo->threadID )
 
+#define ThreadSleep( milliseconds ) usleep( (milliseconds) * 1000 )
+
+/* Storage class for a variable with a separate value in each thread (Simple types only) */
+#define ThreadLocal __thread
+
+/* Add to a 64 bit integer shared by threads, without a lock. Returns the new value */
+#define AtomicAdd64( target, value ) __sync_add_and_fetch( (target), (value) )
+
 
 typedef pthread_mutex_t *CSMutex;
 #define InitCS( CSMutex ) do { \
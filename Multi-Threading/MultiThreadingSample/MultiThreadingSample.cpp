@@ -23,6 +23,10 @@
 #include "PDPageDrawM.h"
 #include "DLExtrasCalls.h"
 
+#ifndef WIN_PLATFORM
+#include <sys/resource.h>
+#endif
+
 
 /* There will be an expandable collection of thread worker method classes that may be run. 
 ** Each class will have an initialization method, that will set it's unique variables, from a command line array.
@@ -41,6 +45,15 @@
 **  "StatisticsFile=" Gives the name of a file to hold a line of performance statistics. When present, we will to this line:
                     Input File Name, ThreadClass, APDFLVersion, 
                     Total Threads, ActiveThreads, Total Wall Time, Total CPU Time, Concurrency, Per Thread Avg Wall Time, Per Thread Avg CPU Time.
+                    Then the p50, p90, p99, p99.9 and Max of the Job Wall Time, of the Job CPU Time, and of the Job Queue Time (Seconds, See latency_histogram.h).
+                    Then the Allocations, Frees, Reallocations, MB Allocated, Highest Job High Water MB, Mean Job High Water MB,
+                    Mean MB Live At Close, Most MB Live At Close, and Mean Allocations Per Job (Empty unless "InstrumentMemory=true").
+                    Then the Instructions Per Cycle, and Cache Misses Per Page (Empty unless "PerfCounters=true", and counters could
+                    be read; zero where a counter was not).
+                    Every column is always written, so that lines from runs with different options line up.
+                    Then the User and System CPU Time, Voluntary and Involuntary Context Switches, and Seconds Waiting For A Processor
+                    (Linux only) of the run (See process_metrics.h).
+                    Last are the Minor and Major Page Faults taken by the process (Zero on Windows).
 **
 **  "TotalThreads=" gives the total number of threads to run. Default is 100 threads.
 **                  While this value, like any other, maybe a list, only the first value will be used.
@@ -78,10 +91,61 @@
 **              are to be run. There may be only one, or there may be many. A given process name can be included in the list
 **              more than once. Threads will be started in the order given here, repeating as the list is exhausted.
 **
+**  "ThreadPool=" may be true or false. Default is false. 
+**              When false, each job (TotalThreads of them) is run in a thread of it's own, which initializes and terminates the library,
+**              and any plugin the job uses. 
+**              When true, "ActiveThreads" pool threads are started once, and each of them runs job after job, as the pump releases them.
+**              The library is initialized once in each pool thread, and plugin sessions (PDFProcessor, PDFlattener, XPS2PDF), with any
+**              conversion settings which do not change from job to job, are started by the first job to use each plugin in the thread,
+**              and reused by every later job using it. This mirrors the MT* services, where a worker thread processes many files. 
+**              The time spent starting and ending plugin sessions, and the time saved by reusing them, is reported in the log.
+**
 **  "TempMemFileSys=" may be true or false. If true, set default temp file sys to ASMemFileSys at startup.
 **
 **              You may wish to use this option if a point of contention is access to a disc drive for storing temporary files.
 **
+**  "InputCache=" may be disk, memory or mmap. Default is disk.
+**              When memory, each distinct input file is read from disc once, into a buffer shared by every thread that opens it,
+**              and documents are opened from that buffer through a read only file system (See InputFileSys.h). This removes disc
+**              and page cache contention from the measurement. The number of files cached, and of times they were opened, is reported in the log.
+**              When mmap, each distinct input file is mapped into memory instead of read, and reads are served from the page cache,
+**              without a system call or a private copy of the file. This suits large inputs.
+**
+**  "InputAccess=" may be normal, sequential or random. Default is normal. This is the access pattern given to the system for
+**              mapped inputs (InputCache=mmap), to control read ahead.
+**
+**  "OutputSink=" may be disk, null, memory or writebehind. Default is disk.
+**              When null, output documents are saved through a file system which counts, and discards, every byte written.
+**              When memory, output documents are saved into a buffer kept by each thread, and reused for each save (See OutputFileSys.h).
+**              Comparing either to a run saving to disk separates the cost of conversion from the cost of writing to storage.
+**              When writebehind, output documents are saved into memory, and written to disc by a small pool of I/O threads,
+**              each batch made durable with fsync, and renamed into place (See WriteBehind.h). Workers wait only when the 
+**              budget for bytes waiting to be written is used up. "WriteBehindThreads=" (Default 2), "WriteBehindBudget=" 
+**              (megabytes, default 256) and "WriteBehindBatch=" (Default 8) control the I/O threads. Flush latency is reported.
+**
+**  "SoakMinutes=" When given, the list of jobs is run over and over, until this many minutes have passed, while a thread samples the
+**              resident size, the live bytes reported by the allocator, and the open file descriptors of the process, every 
+**              "SoakSampleSeconds=" (Default 60). A line is fitted to each, after "SoakWarmupMinutes=" (Default a tenth of the run), 
+**              and the run fails (With code 10) if memory grows more than "SoakGrowthLimit=" MB an hour (Default 16), or descriptors
+**              more than "SoakDescriptorLimit=" an hour (Default 10). "SoakTrim=true" returns free heap to the system after each job,
+**              to separate fragmentation from leaks. "SoakFile=" names a file to write the samples to (See soak_monitor.h).
+**
+**  "SampleInterval=" When given, a thread writes a line of comma separated values every this many milliseconds, into "SampleFile="
+**              (Default samples.csv): the jobs completed, jobs per second, jobs running, process CPU time, resident size, page
+**              faults, context switches and the live bytes of the allocator. So bursts, library start storms, and memory which
+**              creeps up over the run may be seen, where the summary hides them (See run_sampler.h).
+**
+**  "TraceFile=" When given, a timeline of the run is written to this file as a Chrome trace (Open it in chrome://tracing or
+**              ui.perfetto.dev). Each thread has a track, with a span for each job, and for each phase of it, including the library
+**              start and end, and a mark for each page reported by a progress monitor. The pump's track counts the jobs running
+**              and queued. So it may be seen where threads wait on each other (See trace_events.h).
+**
+**  "PerfCounters=" May be true or false. Default is false. When true, hardware performance counters (cycles, instructions, last level
+**              cache misses, branch misses) and software ones (context switches, CPU migrations) are read around the work of each
+**              job (Linux only). The log gives, for each type of worker, the instructions per cycle, and the misses per page. So it
+**              may be seen whether a run which stops scaling is short of memory bandwidth, thrashing the cache, or blocked. Counters
+**              the host does not allow are reported, and left out (See perf_counters.h).
+**
 **  "Silent=" may be true or false. If true, this silences messages written from the framework (Though not, neccessarily from worker threads).
 **          this defaults to true if logfile is not used, and false if logfile is used. Primarily, you may want this set to true to deaden
 **          extranious I/O operations while testing. 
@@ -98,7 +162,42 @@
 ** In studying mutli-threading behaviour, it is useful to lok at changes in behaviour as different memory allocators are used.
 ** For this reason, we can change the memory allocator used by setting a command line value for MemoryManger. The list of 
 ** valid memory managers is maintained in Utilities.h, with the code to effect the change in utilities.cpp.
-**   MemoryManger                   Which memory manager should APDFL Use? (Currently "None" (default), "malloc", "tcmalloc" (unimplemented), and "rpmalloc")
+**   MemoryManger                   Which memory manager should APDFL Use? (Currently "None" (default), "malloc", "tcmalloc", "jemalloc", "mimalloc", "rpmalloc", "arena", "slab" and "numa")
+**                                  rpmalloc keeps a cache for each thread, which is set up and released as each worker thread starts and ends.
+**                                  It's global and thread statistics are written to the log.
+**                                  tcmalloc, jemalloc and mimalloc are loaded from their shared libraries at run time, so they need not be linked in.
+**                                  arena gives each library instance an arena of it's own, which is released at once when the 
+**                                  library is terminated (See arena_memory.h). It suits runs in which each thread starts a library.
+**                                  slab takes small blocks from 64K slabs of one size class each, through lock free magazines kept by
+**                                  each thread, and a shared depot (See slab_memory.h).
+**                                  The memory managers may be compared without APDFL, with "make allocbench" (See AllocatorBench.cpp).
+**                                  numa gives each library instance an arena, mapped on the NUMA node of the processor it's thread
+**                                  is pinned to (See numa_memory.h). It pins threads, as PinThreads does.
+**   PinThreads                     May be true or false. Default is false. When true, each thread is pinned to a processor, taking the
+**                                  NUMA nodes in turn, so memory it touches first is on it's own node. The placement of memory is logged.
+**   MemoryManagerLibrary           The shared library to load for tcmalloc, jemalloc or mimalloc, when it cannot be found by it's usual name.
+**   InstrumentMemory               May be true or false. Default is false. When true, the memory manager is wrapped by one which counts 
+**                                  allocations, frees, reallocations, bytes, allocation sizes and the high water mark for each job 
+**                                  (See instrumented_memory.h). Each job's counts are written to the log, with the totals for the run.
+**                                  The peak, the bytes still live as the input document is closed, and the allocations of each job
+**                                  are totalled for each type of job and each input document, for capacity planning.
+**   MemoryBudget                   Megabytes APDFL may use. When given, the bytes in use are tracked exactly, and APDFL is told the memory
+**                                  left in the budget when it asks how much is available, so it trims it's caches as the budget is 
+**                                  approached (See memory_budget.h). Allocations are never refused.
+**   MemoryBudgetScope              May be thread or process. Default is process. With thread, each library instance has a budget of it's own.
+**   AllocationTrace                The name of a file in which to record every allocation, reallocation and free made by APDFL, in a
+**                                  compact binary form (See allocation_trace.h). AllocatorBench replays the trace ("Replay=") against
+**                                  any memory manager, without APDFL.
+**   AllocationSampling             When given a number N, one in N allocations made by APDFL captures a backtrace, which is attributed to
+**                                  the phase the thread is in (open, convert, draw, extract, save, and so on). The places memory is 
+**                                  allocated from are written as folded stacks, weighted by bytes and by count (See allocation_profile.h).
+**   LargeBuffers                   May be none, pages, transparent or hugetlb. Default is none. When not none, page bitmaps drawn by the
+**                                  rasterizers, and APDFL allocations, of LargeBufferThreshold and over are mapped for themselves, aligned to
+**                                  64 bytes, with ordinary pages, transparent huge pages, or from the huge page pool, and returned to the
+**                                  system as soon as they are freed (See large_memory.h). Page faults are written to the log, to measure the effect.
+**   LargeBufferThreshold           The smallest buffer, in kilobytes, to map for itself. Default is 1024.
+**   AllocationProfile              The prefix of the folded stack files. Default is "AllocationProfile", giving 
+**                                  AllocationProfile.bytes.folded and AllocationProfile.count.folded.
 **
 **  Each type of worker may have a set of options specified for it.
 **    These are specified as a comma seperated series of keyword/value pairs, inside a set of brackets. The names should
@@ -128,6 +227,13 @@
 **  "LoadPlugins=" may be true of false. Default is per worker class (Workers[]).
 **
 **          If your thread does not need to use plugins, setting this option true can save some time and contention in the Init/Term logic. 
+**
+**  "MemoryManager=" names the memory manager (As MemoryManager, above) the libraries of this type of worker are started with, in place
+**          of the run's. So, in a mixed run, Rasterizer threads may map their large buffers while TextExtract threads use slab.
+**          When more than one process is run, the throughput of each type of job is written to the log, with the memory manager it used.
+**          With ThreadPool=true, a pool thread runs every type of job in one library, so this is used only when every process names
+**          the same memory manager. Otherwise every library uses the run's memory manager, each type's choice that is set aside is
+**          written to the log, and the throughput lines name the manager actually used.
 */
 
 /* This is the current set of known workers 
@@ -137,9 +243,19 @@
 **               Add a value to the enumertor in Worker.h (These must be a solid set of numbers,
 **                  The last number must be "NumberOfWorkers".)
 **               Add a class to the switch in OuterWorker()**
+**               If the worker uses a plugin session (StartSession/EndSession), add it to the switches in
+**                  callStartSession(), callEndSession() and callSessionPlugin()
 **               Create and initialize an instance of the worker class in the main procedure.
 
 */
+#include "InputFileSys.h"           /* The shared input cache */
+#include "OutputFileSys.h"          /* The output sinks */
+#include "soak_monitor.h"           /* Soak runs */
+#include "latency_histogram.h"       /* The tail of job times */
+#include "run_sampler.h"             /* The time series of the run */
+#include "process_metrics.h"         /* The resources used by the run */
+#include "trace_events.h"            /* The timeline of the run */
+#include "Probes.h"                  /* Static probes for perf and bpftrace */
 #include "Worker.h"                 /* The base worker class */
 #include "NonAPDFL_Worker.h"
 #include "PDFA_Worker.h"
@@ -216,6 +332,92 @@ void callWorker (ThreadInfo *info)
     return;
 }
 
+/* These procedures start and end the plugin session of a worker, based on 
+** the GetWorkerClass method. Workers which do not use a plugin session 
+** need not be listed.
+**
+** These must be updated for every new worker type that has a plugin session!
+*/
+bool callStartSession (workerclass *baseObject, void **sessionData)
+{
+    switch (baseObject->GetWorkerClass ())
+    {
+    case PDFA:
+        return ((PDFaWorker *)baseObject)->StartSession (sessionData);
+    case PDFX:
+        return ((PDFxWorker *)baseObject)->StartSession (sessionData);
+    case XPS2PDF:
+        return ((XPS2PDFWorker *)baseObject)->StartSession (sessionData);
+    case Flattener:
+        return ((FlattenWorker *)baseObject)->StartSession (sessionData);
+    default:
+        *sessionData = NULL;
+        return (true);
+    }
+}
+
+void callEndSession (workerclass *baseObject, void *sessionData)
+{
+    switch (baseObject->GetWorkerClass ())
+    {
+    case PDFA:
+        ((PDFaWorker *)baseObject)->EndSession (sessionData);
+        break;
+    case PDFX:
+        ((PDFxWorker *)baseObject)->EndSession (sessionData);
+        break;
+    case XPS2PDF:
+        ((XPS2PDFWorker *)baseObject)->EndSession (sessionData);
+        break;
+    case Flattener:
+        ((FlattenWorker *)baseObject)->EndSession (sessionData);
+        break;
+    default:
+        break;
+    }
+}
+
+EnumOfPlugins callSessionPlugin (workerclass *baseObject)
+{
+    switch (baseObject->GetWorkerClass ())
+    {
+    case XPS2PDF:
+        return (XPS2PDFPlugin);
+    case Flattener:
+        return (FlattenerPlugin);
+    case PDFA:
+    case PDFX:
+    default:
+        return (PDFProcessorPlugin);
+    }
+}
+
+/* Call the worker for one job. 
+** If anyone raises, for any reason,inside of a job, and it is not caught in the worker,
+** Catch it here. Do nothing about it, just make sure we execute the job termination.
+*/
+void runWorker (ThreadInfo *info)
+{
+    StartJobPerfCounters ();
+    try         
+    {
+        if (info->noAPDFL)
+            callWorker (info);
+        else
+        {
+            DURING
+                callWorker (info);
+            HANDLER
+            END_HANDLER
+        }
+    }
+    catch (...) { };
+    TakeJobPerfCounters (&info->counters);
+
+    /* A phase may be left set where an error was raised through it */
+    SetWorkerPhase (PhaseOther);
+}
+
 /* This procedure is the one called by all threads!
 **  it uses the workerclass object to create the library, and 
 ** collect startup information, then call the WorkerThread of the 
@@ -227,47 +429,406 @@ int outerWorker (ThreadInfo *info)
 {
     workerclass *baseObject = (workerclass *)(info->object);
    
+    if (Tracing ())
+    {
+        char trackName[64];
+        sprintf (trackName, "job %01d", info->threadNumber + 1);
+        TraceThreadName (trackName);
+    }
 
     baseObject->startThreadWorker (info);
 
-    /* If anyone raises, for any reason,inside of a thread, and it is not caught in the thread,
-    ** Catch it here. Do nothing about it, just make sure we execute the thread termination.
-    */
-    try         
+    runWorker (info);
+
+    baseObject->endThreadWorker (info);
+
+    return (info->result);
+}
+
+/* When ThreadPool=true, jobs are passed to the pool threads through this queue.
+** The pump never releases more than ActiveThreads jobs at a time, so the queue
+** is short, and pool threads simply poll it.
+*/
+typedef struct jobqueue
+{
+    CSMutex         lock;
+    ThreadInfo    **jobs;                               /* Every job, in the order released by the pump */
+    int             size;                               /* Entries in jobs (A soak run reuses them, in turn) */
+    int             queued;                             /* Number of jobs released by the pump */
+    int             taken;                              /* Number of jobs taken by pool threads */
+    bool            closed;                             /* Set when there will be no more jobs */
+} JobQueue;
+
+JobQueue jobQueue;
+
+/* Release a job to the pool threads */
+void QueueJob (ThreadInfo *job)
+{
+    EnterCS (jobQueue.lock);
+    jobQueue.jobs[jobQueue.queued++ % jobQueue.size] = job;
+    TraceCounter ("queued", jobQueue.queued - jobQueue.taken);
+    Probe2 (queue__push, job->threadNumber + 1, jobQueue.queued - jobQueue.taken);
+    LeaveCS (jobQueue.lock);
+}
+
+/* Take the next job from the queue, waiting for one to be released.
+** Returns NULL when the queue is empty, and closed.
+*/
+ThreadInfo *NextJob ()
+{
+    while (1)
     {
-        if (info->noAPDFL)
-            callWorker (info);
-        else
+        ThreadInfo *job = NULL;
+        EnterCS (jobQueue.lock);
+        if (jobQueue.taken < jobQueue.queued)
+        {
+            job = jobQueue.jobs[jobQueue.taken++ % jobQueue.size];
+            TraceCounter ("queued", jobQueue.queued - jobQueue.taken);
+            Probe2 (queue__pop, job->threadNumber + 1, jobQueue.queued - jobQueue.taken);
+        }
+        bool closed = jobQueue.closed;
+        LeaveCS (jobQueue.lock);
+
+        if (job || closed)
+            return (job);
+        ThreadSleep (1);
+    }
+}
+
+/* This procedure is the one called by all pool threads (ThreadPool=true)
+** It initializes the library once, then runs jobs from the queue until it is closed.
+** The plugin sessions opened by those jobs are kept open, and only ended here,
+** after the last job, just before the library is closed. 
+*/
+int poolWorker (PoolThread *pool)
+{
+    if (Tracing ())
+    {
+        char trackName[64];
+        sprintf (trackName, "pool thread %01d", pool->poolNumber + 1);
+        TraceThreadName (trackName);
+    }
+
+    numa_pin_thread (pool->poolNumber);
+    InitializeThreadMemoryManager (pool->memoryManager);
+
+    if (!pool->noAPDFL)
+    {
+        ScopedPhase phase (PhaseStart);
+        ASUns32 flags = 0;
+        if (!pool->LoadPlugins)
+            flags |= kDontLoadPlugIns;
+        Probe1 (lib__init__start, 0);
+        pool->instance = new APDFLib (flags, pool->frameAttributes, pool->memoryManagerName);
+        Probe1 (lib__init__done, 0);
+        if (pool->UseTempMemFileSys)
+            ASSetTempFileSys (ASGetRamFileSys ());
+    }
+
+    ThreadInfo *info;
+    while ((info = NextJob ()) != NULL)
+    {
+        workerclass *baseObject = (workerclass *)(info->object);
+
+        baseObject->startPooledJob (info, pool);
+
+        runWorker (info);
+
+        baseObject->endPooledJob (info);
+    }
+
+    /* End the plugin sessions left open by the jobs */
+    SetWorkerPhase (PhaseEnd);
+    double start = LatencyClock ();
+    for (int index = 0; index < NumberOfPlugins; index++)
+    {
+        if (pool->sessionOwner[index])
         {
             DURING
-                callWorker (info);
+                callEndSession (pool->sessionOwner[index], pool->sessionData[index]);
             HANDLER
             END_HANDLER
+            pool->sessionOwner[index] = NULL;
         }
     }
-    catch (...) { };
+    pool->sessionTime = LatencyClock () - start;
 
-    baseObject->endThreadWorker (info);
+    if (pool->instance)
+    {
+        Probe1 (lib__term__start, 0);
+        delete pool->instance;
+        Probe1 (lib__term__done, 0);
+    }
 
-    return (info->result);
+    /* Pass this thread's output buffer (If any) on */
+    ReleaseThreadOutputBuffer ();
+
+    FinalizeThreadMemoryManager ();
+    SetWorkerPhase (PhaseOther);
+
+    pool->threadCompleted = true;
+    return (0);
+}
+
+/* In a soak run, the list of jobs is run over and over. Make a job's entry ready to run
+** again, as the next job, keeping the worker and options it was given.
+*/
+void RearmThreadInfo (ThreadInfo *info, int jobNumber, int processes)
+{
+    ThreadInfo fresh;
+    memset ((char *)&fresh, 0, sizeof (ThreadInfo));
+    fresh.threadNumber = jobNumber;
+    fresh.sequence = jobNumber / processes;
+    fresh.object = info->object;
+    fresh.logFile = info->logFile;
+    fresh.logFileSet = info->logFileSet;
+    fresh.LoadPlugins = info->LoadPlugins;
+    fresh.UseTempMemFileSys = info->UseTempMemFileSys;
+    *info = fresh;
+}
+
+/* The wall, CPU and queue times of the jobs of each type, and (in the last entry) of the whole run.
+** Static, as they are large.
+*/
+static LatencyHistogram jobLatency[NumberOfWorkers + 1][NumberOfLatencies];
+static const char *latencyNames[NumberOfLatencies] = { "wall", "CPU", "queue" };
+
+/* The time the jobs of each type spent in each phase */
+static PhaseTimes jobPhases[NumberOfWorkers];
+
+/* The performance counters of the jobs of each type, and (in the last entry) of the whole run */
+static PerfCounts jobCounters[NumberOfWorkers + 1];
+
+/* The resources used by the jobs of each type, and (in the last entry) of the whole run */
+static ResourceUse jobResources[NumberOfWorkers + 1];
+
+/* Record the times of a completed job */
+void RecordJobTimes (EnumOfWorkers type, ThreadInfo *info)
+{
+    AddPhaseTimes (&jobPhases[type], &info->phases);
+    AddPerfCounts (&jobCounters[type], &info->counters);
+    AddPerfCounts (&jobCounters[NumberOfWorkers], &info->counters);
+    AddResourceUse (&jobResources[type], &info->resources);
+    AddResourceUse (&jobResources[NumberOfWorkers], &info->resources);
+
+    double times[NumberOfLatencies] = { info->wallTimeUsed, info->cpuTimeUsed, info->queueTime };
+    for (int latency = 0; latency < NumberOfLatencies; latency++)
+    {
+        RecordLatency (&jobLatency[type][latency], times[latency]);
+        RecordLatency (&jobLatency[NumberOfWorkers][latency], times[latency]);
+    }
+}
+
+/* Write the percentiles of the job times to the log, for the run, then each type of job run,
+** the resources, and the time in each phase, each type of job used, and it's performance counters
+*/
+void ReportJobTimes (FILE *logFile)
+{
+    char name[128];
+    fprintf (logFile, "\nJob times:\n");
+    for (int latency = 0; latency < NumberOfLatencies; latency++)
+    {
+        sprintf (name, "All jobs, %s", latencyNames[latency]);
+        ReportLatency (logFile, name, &jobLatency[NumberOfWorkers][latency]);
+    }
+    for (int type = 0; type < NumberOfWorkers; type++)
+        for (int latency = 0; latency < NumberOfLatencies; latency++)
+        {
+            sprintf (name, "%s, %s", workers[type].name, latencyNames[latency]);
+            ReportLatency (logFile, name, &jobLatency[type][latency]);
+        }
+
+    fprintf (logFile, "\nJob resources (Per job):\n");
+    ReportResourceUse (logFile, "All jobs", &jobResources[NumberOfWorkers], (int)jobLatency[NumberOfWorkers][LatencyWall].total);
+    for (int type = 0; type < NumberOfWorkers; type++)
+        ReportResourceUse (logFile, workers[type].name, &jobResources[type], (int)jobLatency[type][LatencyWall].total);
+
+    fprintf (logFile, "\nJob phases:\n");
+    for (int type = 0; type < NumberOfWorkers; type++)
+        ReportPhaseTimes (logFile, workers[type].name, &jobPhases[type], (int)jobLatency[type][LatencyWall].total);
+
+    if (CountingPerf ())
+    {
+        fprintf (logFile, "\nPerformance counters (Around the work of each job):\n");
+        ReportPerfCounts (logFile, "All jobs", &jobCounters[NumberOfWorkers]);
+        for (int type = 0; type < NumberOfWorkers; type++)
+            ReportPerfCounts (logFile, workers[type].name, &jobCounters[type]);
+    }
 }
 
+/* The memory managers used in this run, by the run as a whole, or by some type of worker,
+** so that the statistics of each may be reported.
+*/
+static bool memoryManagerUsed[NumberOfMemManager];
+
 /* Some of the memory managers require initialization and termination.
 **
 ** If the newly added manager does, add it to these routines
 */
-void InitializeAllMemoryManagers ()
+void InitializeAllMemoryManagers (attributes *FrameAttributes, FILE *logFile)
 {
-#ifndef __APPLE__
+#ifndef MAC_ENV
     rpmalloc_master_initialize ();
 #endif
+    arena_master_initialize ();
+    slab_master_initialize ();
+    InitializeInstrumentedMemory (FrameAttributes);
+    if (!InitializeMemoryBudget (FrameAttributes))
+    {
+        fprintf (logFile, "  The MemoryBudgetScope value is not known. Use thread or process.\n");
+        exit (-1);
+    }
+    if (!InitializeAllocationTrace (FrameAttributes))
+    {
+        fprintf (logFile, "  The AllocationTrace file \"%s\" cannot be created.\n", FrameAttributes->GetKeyValue ("AllocationTrace")->value (0));
+        exit (-1);
+    }
+    if (!InitializeAllocationProfile (FrameAttributes))
+    {
+        fprintf (logFile, "  The AllocationProfile files \"%s.*.folded\" cannot be created.\n", AllocationProfilePrefix ());
+        exit (-1);
+    }
+    if (!InitializeLargeBuffers (FrameAttributes))
+    {
+        fprintf (logFile, "  The LargeBuffers value is not known. Use none, pages, transparent or hugetlb.\n");
+        exit (-1);
+    }
+    if (UsingLargeBuffers ())
+        fprintf (logFile, "  We will map buffers of %01d KB and over for themselves (%s).\n\n",
+            FrameAttributes->IsKeyPresent ("LargeBufferThreshold") ? FrameAttributes->GetKeyValueInt ("LargeBufferThreshold") : 1024,
+            FrameAttributes->GetKeyValue ("LargeBuffers")->value (0));
+    if (ProfilingAllocations ())
+        fprintf (logFile, "  We will sample one in %01d allocations, and write the places they were made from as folded stacks.\n\n",
+            FrameAttributes->GetKeyValueInt ("AllocationSampling"));
+    if (RecordingAllocations ())
+        fprintf (logFile, "  We will record every allocation in %s.\n\n", FrameAttributes->GetKeyValue ("AllocationTrace")->value (0));
+    if (UsingMemoryBudget ())
+        fprintf (logFile, "  We will hold APDFL to a memory budget of %01d MB %s.\n\n", FrameAttributes->GetKeyValueInt ("MemoryBudget"),
+            FrameAttributes->IsKeyPresent ("MemoryBudgetScope") ? FrameAttributes->GetKeyValue ("MemoryBudgetScope")->value (0) : "process");
+
+    /* Memory managers in shared libraries are loaded now, once, before any library is started.
+    ** If the one asked for cannot be loaded, stop, rather than measure the wrong allocator.
+    */
+    if (FrameAttributes->IsKeyPresent ("MemoryManagerLibrary"))
+        loadable_set_library (FrameAttributes->GetKeyValue ("MemoryManagerLibrary")->value (0));
+
+    memset (memoryManagerUsed, 0, sizeof (memoryManagerUsed));
+    if (FrameAttributes->IsKeyPresent ("MemoryManager"))
+    {
+        MemoryManagers id;
+        TKAllocatorProcs *procs = StringToMemManager (FrameAttributes->GetKeyValue ("MemoryManager")->value (0), &id);
+        SelectMemoryManager (id);
+        if (id < NumberOfMemManager)
+            memoryManagerUsed[id] = true;
+        const char *description = DescribeMemoryManager (id);
+        if (description)
+        {
+            fprintf (logFile, "  %s\n\n", description);
+            if (!procs)
+                exit (-1);
+        }
+    }
+
+    if (InstrumentingMemory ())
+        fprintf (logFile, "  We will count the memory used by each job.\n\n");
+}
+
+/* Each type of worker may name a memory manager of it's own ("MemoryManager=" in it's options), to 
+** replace the run's for the libraries it starts. Log those used by the processes to be run, and load 
+** any in shared libraries, then pin threads if asked, or if any library will use numa arenas.
+** Call this after the worker options are parsed, and before any thread is started.
+*/
+void InitializeWorkerMemoryManagers (attributes *FrameAttributes, int *workerTypeList, int processes, FILE *logFile)
+{
+    bool numaArenas = (SelectedMemoryManager () == numa_memory_manager);
+    bool named = false;
+    for (int index = 0; index < processes; index++)
+    {
+        /* A worker type may appear in the process list more than once */
+        bool logged = false;
+        for (int earlier = 0; earlier < index; earlier++)
+            if (workerTypeList[earlier] == workerTypeList[index])
+                logged = true;
+
+        workerclass *worker = (workerclass *)workerClasses[workerTypeList[index]].NonAPDFL;
+        if (logged || !worker->memoryManagerName)
+            continue;
+
+        named = true;
+        fprintf (logFile, "  The %s workers will use the Memory Manager %s.\n", workers[workerTypeList[index]].name, worker->memoryManagerName);
+        MemoryManagers id;
+        TKAllocatorProcs *procs = StringToMemManager (worker->memoryManagerName, &id);
+        if (id < NumberOfMemManager)
+            memoryManagerUsed[id] = true;
+        if (id == numa_memory_manager)
+            numaArenas = true;
+        const char *description = DescribeMemoryManager (id);
+        if (description)
+        {
+            fprintf (logFile, "  %s\n", description);
+            if (!procs)
+                exit (-1);
+        }
+    }
+    if (named)
+        fprintf (logFile, "\n");
+
+    /* Malloc's figures are the bytes live only when every library allocates from it (See run_sampler.h) */
+    bool mallocLive = !UsingLargeBuffers ();
+    for (int id = 0; id < NumberOfMemManager; id++)
+        if (memoryManagerUsed[id] && id != no_memoryManager && id != malloc_memoryManager)
+            mallocLive = false;
+    NoteMallocLive (mallocLive);
+
+    /* Threads are pinned when asked, and always for numa arenas */
+    numa_master_initialize (FrameAttributes, numaArenas);
+    if (numaArenas || FrameAttributes->GetKeyValueBool ("PinThreads"))
+        fprintf (logFile, "  We will pin each thread to a processor, taking the NUMA nodes in turn.\n\n");
+}
+
+/* Write any statistics kept by the memory managers used to the log.
+** Call this after all threads are complete, before FinalizeAllMemoryManagers.
+*/
+void ReportAllMemoryManagers (attributes *FrameAttributes, FILE *logFile)
+{
+    if (FrameAttributes->GetKeyValueBool ("PinThreads") || numa_pinning ())
+        numa_report (logFile);
+
+    /* Each memory manager used, by the run or by a type of worker, is reported once */
+    for (int id = 0; id < NumberOfMemManager; id++)
+    {
+        if (!memoryManagerUsed[id])
+            continue;
+        switch (id)
+        {
+#ifndef MAC_ENV
+        case rpmalloc_memory_manager:
+            rpmalloc_report (logFile);
+            break;
+#endif
+        case arena_memory_manager:
+            arena_report (logFile);
+            break;
+        case slab_memory_manager:
+            slab_report (logFile);
+            break;
+        default:
+            break;
+        }
+    }
 }
 
 void FinalizeAllMemoryManagers ()
 { 
-#ifndef __APPLE__
+#ifndef MAC_ENV
     rpmalloc_master_finalize ();
 #endif
+    arena_master_finalize ();
+    slab_master_finalize ();
+    numa_master_finalize ();
+    FinalizeMemoryBudget ();
+    FinalizeAllocationTrace ();
+    FinalizeAllocationProfile ();
 }
 
 /* program takes the following command line attributes:
@@ -290,7 +851,7 @@ int main(int argc, char** argv)
     int errCode = 0;                /* return code tho the user */
 
     /* Parse the comand line */
-    attributes SampleAttributes = attributes (argc, argv);
+    attributes SampleAttributes (argc, argv);
 
     /* Establish a file to log output to */
     FILE *logFile = stdout;;
@@ -349,12 +910,42 @@ int main(int argc, char** argv)
     else
         fprintf (logFile, "  We will NOT initialize the library on the base thread.\n");
 
+    bool useThreadPool = SampleAttributes.GetKeyValueBool ("ThreadPool");
+    if (useThreadPool)
+        fprintf (logFile, "  We will run jobs in a pool of %01d threads, reusing the library and plugin sessions.\n", activeThreads);
+
     bool UseTempMemFileSys = SampleAttributes.GetKeyValueBool ("TempMemFileSys");
     if (UseTempMemFileSys)
         fprintf (logFile, "  We will use RamFileSys for temporary files.\n");
     else
         fprintf (logFile, "  We will NOT use RamFileSys for temporary files.\n");
 
+    if (!InitializeInputFileSys (&SampleAttributes))
+    {
+        fprintf (logFile, "  The InputCache or InputAccess value is not known. Use InputCache=disk, memory or mmap, and InputAccess=normal, sequential or random.\n");
+        exit (-1);
+    }
+    if (GetInputMode () == InputFromMemory)
+        fprintf (logFile, "  We will read each input file once, into a shared memory cache.\n");
+    if (!InitializeOutputFileSys (&SampleAttributes))
+    {
+        fprintf (logFile, "  The OutputSink value \"%s\" is not known. Use disk, null, memory or writebehind.\n", SampleAttributes.GetKeyValue ("OutputSink")->value (0));
+        exit (-1);
+    }
+    if (GetOutputSink () == OutputToNull)
+        fprintf (logFile, "  We will discard output documents, counting the bytes written.\n");
+    if (GetOutputSink () == OutputToMemory)
+        fprintf (logFile, "  We will save output documents into a memory buffer for each thread.\n");
+    if (GetOutputSink () == OutputToWriteBehind)
+        fprintf (logFile, "  We will save output documents into memory, and write them to disc from I/O threads.\n");
+    if (GetInputMode () == InputFromMap)
+        fprintf (logFile, "  We will map each input file once, with %s access, into a shared memory cache.\n", InputAccessName (GetInputAccess ()));
+    InitializeSoak (&SampleAttributes, logFile);
+    InitializeSampler (&SampleAttributes, logFile);
+    InitializeTrace (&SampleAttributes, logFile);
+    InitializePerfCounters (&SampleAttributes, logFile);
+    TraceThreadName ("pump");
+
     if (SampleAttributes.IsKeyPresent ("MemoryManager"))
         fprintf (logFile, "  We will use the Memory Manager %s.\n\n", SampleAttributes.GetKeyValue("MemoryManager")->value(0));
     else
@@ -363,12 +954,17 @@ int main(int argc, char** argv)
 
     /* Before the first library is started, we must initialize any mameory managers we may wish to use
     */
-    InitializeAllMemoryManagers ();
+    InitializeAllMemoryManagers (&SampleAttributes, logFile);
 
     /* If we are using a base thread library, start it now */
     APDFLib *baseInstance = NULL;
     if (SampleAttributes.GetKeyValueBool ("BaseInit"))
+    {
+        ScopedPhase phase (PhaseStart);
+        Probe1 (lib__init__start, 0);
         baseInstance = new APDFLib (kPDFLInitPreferLocalFonts, &SampleAttributes);
+        Probe1 (lib__init__done, 0);
+    }
 
     /* Construct the array of worker types 
     ** Set establish the options for each type*/
@@ -444,6 +1040,9 @@ int main(int argc, char** argv)
         }
     }
 
+    /* Load the memory managers named by the workers to be run, before any thread is started */
+    InitializeWorkerMemoryManagers (&SampleAttributes, workerTypeList, processes, logFile);
+
     /* Now, "threads" contains a threadinfo structure for each thread we want to run, 
     ** and "workerList" contains a list of the workers we want to run, in the order we 
     ** want to run them. Populate these into the "threads" list, so each thread will know what 
@@ -465,6 +1064,70 @@ int main(int argc, char** argv)
         type++;
     }
 
+    /* If we are using a thread pool, start the pool threads now. 
+    ** A pool thread must load plugins if any process in the list needs them, and
+    ** need only skip the library if no process uses it.
+    */
+    PoolThread *pools = NULL;
+    if (useThreadPool)
+    {
+        InitCS (jobQueue.lock);
+        jobQueue.jobs = (ThreadInfo **)malloc (sizeof (ThreadInfo *) * totalThreads);
+        jobQueue.size = totalThreads;
+        jobQueue.queued = jobQueue.taken = 0;
+        jobQueue.closed = false;
+
+        bool poolNoAPDFL = true;
+        bool poolLoadPlugins = false;
+        for (int index = 0; index < processes; index++)
+        {
+            if (!workerList[index].NonAPDFL->noAPDFL)
+                poolNoAPDFL = false;
+            if (workers[workerTypeList[index]].LoadPlugins)
+                poolLoadPlugins = true;
+        }
+
+        /* A pool thread's library runs every type of job, so it can use a worker's memory manager
+        ** only when every process names the same one. Otherwise, it uses the run's.
+        */
+        char *poolManagerName = workerList[0].NonAPDFL->memoryManagerName;
+        MemoryManagers poolManager = workerList[0].NonAPDFL->memoryManager;
+        for (int index = 1; index < processes; index++)
+            if (!workerList[index].NonAPDFL->memoryManagerName || workerList[index].NonAPDFL->memoryManager != poolManager)
+                poolManagerName = NULL;
+        if (!poolManagerName)
+        {
+            const char *runManagerName = SampleAttributes.IsKeyPresent ("MemoryManager") ? SampleAttributes.GetKeyValue ("MemoryManager")->value (0) : "None";
+            for (int index = 0; index < processes; index++)
+            {
+                /* A worker type may appear in the process list more than once */
+                bool logged = false;
+                for (int earlier = 0; earlier < index; earlier++)
+                    if (workerTypeList[earlier] == workerTypeList[index])
+                        logged = true;
+                if (!logged && workerList[index].NonAPDFL->memoryManagerName)
+                    fprintf (logFile, "  Pool threads run every type of job, so the %s workers will use the run's Memory Manager (%s), not %s.\n",
+                        workers[workerTypeList[index]].name, runManagerName, workerList[index].NonAPDFL->memoryManagerName);
+            }
+        }
+        if (!poolManagerName)
+            poolManager = SelectedMemoryManager ();
+
+        pools = (PoolThread *)malloc (sizeof (PoolThread) * activeThreads);
+        for (int index = 0; index < activeThreads; index++)
+        {
+            memset ((char *)&pools[index], 0, sizeof (PoolThread));
+            pools[index].poolNumber = index;
+            pools[index].frameAttributes = &SampleAttributes;
+            pools[index].noAPDFL = poolNoAPDFL;
+            pools[index].LoadPlugins = poolLoadPlugins;
+            pools[index].UseTempMemFileSys = UseTempMemFileSys;
+            pools[index].memoryManagerName = poolManagerName;
+            pools[index].memoryManager = poolManager;
+            createThread (poolWorker, pools[index]);
+        }
+    }
+
     /* The "threads" table is now populated with the type or worker to run. We just need to 
     ** start "actualCount" threads, and each time a thread ends, start a new thread
     */
@@ -483,6 +1146,24 @@ int main(int argc, char** argv)
     /* Accumulate percentage used */
     double percentageUsed = 0;
 
+    /* Accumulate memory used, when it is counted */
+    MemoryCounters memoryUsed;
+    memset ((char *)&memoryUsed, 0, sizeof (MemoryCounters));
+
+    /* Accumulate the page faults taken by jobs (Linux only) */
+    ASUns64 jobMinorFaults = 0, jobMajorFaults = 0;
+
+    /* Accumulate the use of plugin sessions, and the times of each type of job
+    ** (As jobs complete, since a soak run reuses the entries in "threads")
+    */
+    int sessionsStarted = 0, sessionsReused = 0;
+    double sessionTime = 0;
+    int typeJobs[NumberOfWorkers];
+    double typeWall[NumberOfWorkers], typeCPU[NumberOfWorkers];
+    memset (typeJobs, 0, sizeof (typeJobs));
+    memset (typeWall, 0, sizeof (typeWall));
+    memset (typeCPU, 0, sizeof (typeCPU));
+
     /* This mechanism will allow the queue of active threads to fall to zero
     ** from time to time. If there is a single "pauseEvery" value, it will pause
     ** every N threads. If the pause entry is a list of values, it will pause after the 
@@ -497,19 +1178,17 @@ int main(int argc, char** argv)
     */
     bool pausing = false;
 
-	/* Overall tiem for unix platforms */
-#ifndef WIN_PLATFORM
-	struct timeval  startTime, endTime;                 /* Used in Unix only, wall time started/stopped */
-	clock_t         startCPU, endCPU;                   /* Used in Unix only to track CPU time used. */
+    /* The resources used by the run, and by the pump, from here (See process_metrics.h) */
+    ResourceUse runStart, pumpStart;
+    ProcessResourceUse (&runStart);
+    ThreadResourceUse (&pumpStart);
 
-	struct timezone zone;
-	memset((char *)&zone, 0, sizeof(struct timezone));
-	gettimeofday(startTime, &zone);
-	startCPU = clock();
-#endif
+    /* Sample the growth of the process through a soak run */
+    StartSoakMonitor ();
+    StartSampler ();
 
-    /* This loop is the thread pump */
-    while (completedThreads < totalThreads)
+    /* This loop is the thread pump (A soak run goes on starting jobs until it's time has passed) */
+    while ((completedThreads < startedThreads) || (startedThreads < totalThreads) || SoakContinues ())
     {
 
         /* If we are paused, and there are no longer any running threads
@@ -524,14 +1203,30 @@ int main(int argc, char** argv)
 
         /* If we have less threads running than we want active, and we have not 
         ** already started all threads, start a thread!
+        ** A soak run starts the list again, reusing each entry once it's last job is complete.
         */
-        if ((startedThreads < totalThreads) && (runningThreads < activeThreads) && (!pausing))
+        ThreadInfo *nextThread = &threads[startedThreads % totalThreads];
+        bool entryFree = true;
+        for (int x = 0; x < runningThreads; x++)
+            if (activeThreadInfo[x] == nextThread)
+                entryFree = false;
+        if (((startedThreads < totalThreads) || (SoakContinues () && entryFree)) && (runningThreads < activeThreads) && (!pausing))
         {
-            createThread (outerWorker, threads[startedThreads]);
-            activeThreadArray[runningThreads] = threads[startedThreads].threadID;
-            activeThreadInfo[runningThreads] = &threads[startedThreads];
+            if (startedThreads >= totalThreads)
+                RearmThreadInfo (nextThread, startedThreads, processes);
+            nextThread->queuedAt = LatencyClock ();
+            if (useThreadPool)
+                QueueJob (nextThread);
+            else
+            {
+                createThread (outerWorker, (*nextThread));
+                activeThreadArray[runningThreads] = nextThread->threadID;
+            }
+            activeThreadInfo[runningThreads] = nextThread;
             startedThreads++;
             runningThreads++;
+            SamplerProgress (completedThreads, runningThreads);
+            TraceCounter ("running", runningThreads);
 
             /* If pause every is zero, we will not pause.
             ** It will default to zero, or may be set there in an entry
@@ -553,12 +1248,15 @@ int main(int argc, char** argv)
         if (runningThreads)
         {
             /* Wait for the first in the list of threads to complete
+            ** (Jobs run in a thread pool are always found by polling, 
+            **  as they do not end their thread)
             */
-#ifdef WIN_PLATFORM
-            ASInt32 index = WaitForAnyThreadComplete (activeThreadArray, runningThreads);
-#else
             ASInt32 index = -1;
-            while (1)
+#ifdef WIN_PLATFORM
+            if (!useThreadPool)
+                index = WaitForAnyThreadComplete (activeThreadArray, runningThreads);
+#endif
+            while (index == -1)
             {
                 for (int x = 0; x < runningThreads; x++)
                 {
@@ -570,9 +1268,8 @@ int main(int argc, char** argv)
                 }
                 if (index != -1)
                     break;
-                usleep (1000);
+                ThreadSleep (1);
             }
-#endif
 
             /* A thread completed! */
             completedThreads++;
@@ -586,33 +1283,65 @@ int main(int argc, char** argv)
                 errCode = doneThread->result;
 
 #ifdef WIN_PLATFORM
-            /* For windows, it is easier to collect thread info after the thread completes 
+            /* For windows, it is easier to collect the CPU time after the thread completes 
             ** The values are in FILETIME, which is nano seconds since 1/1/1601 (For some ofd reason), 
             ** They arested in two adjacent 32 bit integers, sequence such tht they can be considered a 
-            ** single 64 bit integer 
+            ** single 64 bit integer. The wall time was taken by the thread itself, from the monotonic clock.
+            ** (Jobs run in a pool thread collected thier own times, in workerclass::endPooledJob)
             */
-            FILETIME start, end, kernel, cpuTime;
-            ASUns64 *start64 = (ASUns64*)&start, *end64 = (ASUns64 *)&end, *kernel64 = (ASUns64 *)&kernel, *cpu64 = (ASUns64 *)&cpuTime;
-            GetThreadTimes (doneThread->threadID, &start, &end, &kernel, &cpuTime);
-            end64[0] -= start64[0];
-            cpu64[0] += kernel64[0];
-            doneThread->wallTimeUsed = ((end64[0] * 1.0) / 10000000);
-            doneThread->cpuTimeUsed = ((cpu64[0] * 1.0) / 10000000);
-            doneThread->percentUtilized = (doneThread->cpuTimeUsed / doneThread->wallTimeUsed) * 100;
+            if (!doneThread->pool)
+            {
+                FILETIME start, end, kernel, cpuTime;
+                ASUns64 *kernel64 = (ASUns64 *)&kernel, *cpu64 = (ASUns64 *)&cpuTime;
+                GetThreadTimes (doneThread->threadID, &start, &end, &kernel, &cpuTime);
+                cpu64[0] += kernel64[0];
+                doneThread->cpuTimeUsed = ((cpu64[0] * 1.0) / 10000000);
+                if (doneThread->wallTimeUsed > 0)
+                    doneThread->percentUtilized = (doneThread->cpuTimeUsed / doneThread->wallTimeUsed) * 100;
+            }
 #endif
 
             percentageUsed += doneThread->percentUtilized;
+            AddMemoryCounters (&memoryUsed, &doneThread->memory);
+            jobMinorFaults += doneThread->minorFaults;
+            jobMajorFaults += doneThread->majorFaults;
+            if (doneThread->sessionStarted)
+                sessionsStarted++;
+            if (doneThread->sessionReused)
+                sessionsReused++;
+            sessionTime += doneThread->sessionTime;
+            workerclass *doneWorker = (workerclass *)doneThread->object;
+            EnumOfWorkers doneType = doneWorker->workerType;
+            if (InstrumentingMemory ())
+            {
+                /* The memory needed by each type of job, and each input document */
+                char *document = doneWorker->InFileCount ? doneWorker->GetInFileName (doneThread->sequence) : NULL;
+                AddDocumentMemory (workers[doneType].name, document, &doneThread->memory);
+                if (document)
+                    free (document);
+            }
+            typeJobs[doneType]++;
+            typeWall[doneType] += doneThread->wallTimeUsed;
+            typeCPU[doneType] += doneThread->cpuTimeUsed;
+            RecordJobTimes (doneType, doneThread);
+            SoakJobCompleted ();
 
             /* If we are not silent, then display a status for the thread completing */
             if (!doneThread->silent)
             {
                 fprintf (doneThread->logFile, "Thread %01d completed in %0.6g seconds wall, %0.10g seconds CPU, with code %01d. -- %0.03g%% Utilized.\n",
                     doneThread->threadNumber + 1, doneThread->wallTimeUsed, doneThread->cpuTimeUsed, doneThread->result, doneThread->percentUtilized);
+                if (doneThread->minorFaults || doneThread->majorFaults)
+                    fprintf (doneThread->logFile, "Thread %01d took %01llu page faults, %01llu of them major.\n", doneThread->threadNumber + 1,
+                        (unsigned long long)(doneThread->minorFaults + doneThread->majorFaults), (unsigned long long)doneThread->majorFaults);
+                if (InstrumentingMemory ())
+                    ReportJobMemory (doneThread->logFile, doneThread->threadNumber + 1, &doneThread->memory);
                 fflush (doneThread->logFile);
             }
 
-            /* end the thread */
-            destroyThread (doneThread);
+            /* end the thread (Pool threads are ended when the pump completes) */
+            if (!doneThread->pool)
+                destroyThread (doneThread);
 
             /* If the thread to finish was NOT the last thread, then shift all of the arrays
             ** up to remove this thread from the array 
@@ -628,6 +1357,8 @@ int main(int argc, char** argv)
 
             /* One less running thread */
             runningThreads--;
+            SamplerProgress (completedThreads, runningThreads);
+            TraceCounter ("running", runningThreads);
 
             continue;
         }
@@ -637,36 +1368,134 @@ int main(int argc, char** argv)
                 " completed %&01d, but have no threads active?\n", startedThreads, totalThreads, completedThreads);
         exit (-2);
     }
+    StopSoakMonitor ();
+    StopSampler ();
+
+    /* If we are using a thread pool, close the queue, and wait for the pool 
+    ** threads to end thier plugin sessions and close the library.
+    */
+    if (useThreadPool)
+    {
+        EnterCS (jobQueue.lock);
+        jobQueue.closed = true;
+        LeaveCS (jobQueue.lock);
+
+        for (int index = 0; index < activeThreads; index++)
+        {
+            while (!pools[index].threadCompleted)
+                ThreadSleep (1);
+            destroyThread ((&pools[index]));
+        }
+    }
+
+    /* Wait for output documents still being written behind. The jobs which saved them have
+    ** completed, so a document which could not be written fails the run, as it's job would have.
+    */
+    if (DrainOutputFileSys () && errCode < 2)
+        errCode = 2;
+
+    /* Report the time spent starting and ending plugin sessions, and the time 
+    ** saved by jobs that reused a session started by an earlier job.
+    */
+    if (useThreadPool)
+        for (int index = 0; index < activeThreads; index++)
+            sessionTime += pools[index].sessionTime;
+
+    if (sessionsStarted)
+    {
+        double sessionCost = sessionTime / sessionsStarted;
+        fprintf (logFile, "\n%01d plugin sessions started, %01d jobs reused an open session. Each session took %0.5g seconds to start and end.\n",
+            sessionsStarted, sessionsReused, sessionCost);
+        fprintf (logFile, "Reusing sessions saved %0.5g seconds in all, %0.5g seconds per job.\n",
+            sessionCost * sessionsReused, (sessionCost * sessionsReused) / completedThreads);
+    }
+
+    /* Report the use of the input cache */
+    ReportInputFileSys (logFile);
+    ReportOutputFileSys (logFile);
+    ReportAllMemoryManagers (&SampleAttributes, logFile);
+    ReportMemoryBudget (logFile);
+    ReportAllocationTrace (logFile);
+    ReportAllocationProfile (logFile);
+    ReportLargeBuffers (logFile);
+    if (InstrumentingMemory ())
+    {
+        ReportMemoryCounters (logFile, &memoryUsed, completedThreads);
+        ReportDocumentMemory (logFile);
+    }
+
+    /* A soak run fails if the process grew too fast */
+    int soakResult = ReportSoak (logFile);
+    if (soakResult > errCode)
+        errCode = soakResult;
+
+    /* The run's CPU time counts every thread, including those which have ended. It's run delay
+    ** is that of each job, and of the pump, as a thread's is lost when it ends.
+    */
+    ResourceUse runEnd, runUsed, pumpEnd, pumpUsed;
+    ProcessResourceUse (&runEnd);
+    ThreadResourceUse (&pumpEnd);
+    ResourceUsed (&runUsed, &runStart, &runEnd);
+    ResourceUsed (&pumpUsed, &pumpStart, &pumpEnd);
+    runUsed.runDelay = jobResources[NumberOfWorkers].runDelay + pumpUsed.runDelay;
 
 	double WallTimeUsed, CPUTimeUsed, Concurrency;
-#ifdef WIN_PLATFORM
-	FILETIME start, end, kernel, cpuTime;
-	ASUns64 *start64 = (ASUns64*)&start, *end64 = (ASUns64 *)&end, *kernel64 = (ASUns64 *)&kernel, *cpu64 = (ASUns64 *)&cpuTime;
-
-	HANDLE processHandle = GetCurrentProcess ();
-	GetProcessTimes(processHandle, &start, &end, &kernel, &cpuTime);
-	GetSystemTimeAsFileTime(&end);
-	
-	end64[0] -= start64[0];
-	cpu64[0] += kernel64[0];
-	WallTimeUsed = ((end64[0] * 1.0) / 10000000);
-	CPUTimeUsed = ((cpu64[0] * 1.0) / 10000000);
-#else
-	gettimeofday (&endTime, &zone);
-	endCPU = clock();
-	wallTimeUsed = ((endTime.tv_sec - startTime.tv_sec) * 1.0) +
-		((endTime.tv_usec - startTime.tv_usec) / 1000000);
-	CPUTimeUsed = ((endCPU -startCPU) * 1.0) / CLOCKS_PER_SEC;
-#endif
+	WallTimeUsed = runUsed.wall;
+	CPUTimeUsed = runUsed.user + runUsed.system;
 
 	Concurrency = (CPUTimeUsed / WallTimeUsed);
-	fprintf(logFile, "\n\nTotal Wall time:%0.5g seconds.\nTotal CPU Time used %0.5g seconds.\nConcurrency %0.5g.\n ",
+	fprintf(logFile, "\n\nTotal Wall time:%0.5g seconds.\nTotal CPU Time used %0.5g seconds.\nConcurrency %0.5g.\n",
 		WallTimeUsed, CPUTimeUsed, Concurrency);
+    fprintf (logFile, "CPU time %0.5g seconds user, %0.5g seconds system. %01llu voluntary, and %01llu involuntary, context switches.\n",
+        runUsed.user, runUsed.system, (unsigned long long)runUsed.voluntarySwitches, (unsigned long long)runUsed.involuntarySwitches);
+    fprintf (logFile, "%0.5g seconds waiting for a processor, %0.5g of them by jobs, %0.5g by the pump.\n",
+        runUsed.runDelay, jobResources[NumberOfWorkers].runDelay, pumpUsed.runDelay);
 
 	fprintf(logFile, "%01d Threads, %01d at a time. Each thread took %0.5g seconds CPU, and %0.5g seconds wall.\n",
 		completedThreads, activeThreads, CPUTimeUsed / completedThreads, (double)(WallTimeUsed / (completedThreads * 1.0) * activeThreads));
 
-    percentageUsed /= totalThreads;
+    /* When more than one type of job is run, report the throughput of each, with the memory manager it used */
+    if (processes > 1)
+    {
+        const char *runManagerName = SampleAttributes.IsKeyPresent ("MemoryManager") ? SampleAttributes.GetKeyValue ("MemoryManager")->value (0) : "None";
+        for (int type = 0; type < NumberOfWorkers; type++)
+        {
+            int jobs = typeJobs[type];
+            if (!jobs)
+                continue;
+
+            workerclass *worker = (workerclass *)workerClasses[type].NonAPDFL;
+            const char *managerName = worker->memoryManagerName ? worker->memoryManagerName : runManagerName;
+            if (useThreadPool)
+                managerName = pools[0].memoryManagerName ? pools[0].memoryManagerName : runManagerName;
+            fprintf (logFile, "%s: %01d jobs, %0.5g jobs per second. Each job took %0.5g seconds wall, and %0.5g seconds CPU (Memory Manager %s).\n",
+                workers[type].name, jobs, jobs / WallTimeUsed, typeWall[type] / jobs, typeCPU[type] / jobs, managerName);
+        }
+    }
+
+    /* The tail of the job times, which the averages above hide, and where the time of each type of job went */
+    ReportJobTimes (logFile);
+
+    ASUns64 minorFaults = 0, majorFaults = 0;
+#ifndef WIN_PLATFORM
+    /* The peak resident set size, to compare the memory managers (Reported in bytes on macOS, and kilobytes elsewhere) */
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    fprintf (logFile, "Peak resident memory %0.5g MB.\n", usage.ru_maxrss / (1024.0 * 1024.0));
+#else
+    fprintf (logFile, "Peak resident memory %0.5g MB.\n", usage.ru_maxrss / 1024.0);
+#endif
+
+    /* Page faults, to measure the effect of mapping large buffers (See large_memory.h) */
+    minorFaults = usage.ru_minflt;
+    majorFaults = usage.ru_majflt;
+    fprintf (logFile, "Page faults %01llu minor, %01llu major, %01llu of them (%01llu major) taken by jobs.\n",
+        (unsigned long long)minorFaults, (unsigned long long)majorFaults,
+        (unsigned long long)(jobMinorFaults + jobMajorFaults), (unsigned long long)jobMajorFaults);
+#endif
+
+    percentageUsed /= completedThreads;
     fprintf (logFile, "\n\n%0.5g%% of time used.\n", percentageUsed);
 
     if (SampleAttributes.IsKeyPresent ("StatisticsFile"))
@@ -686,10 +1515,25 @@ int main(int argc, char** argv)
 
         ASUns32 pdflVersion = PDFLGetVersion ();
 
-        fprintf (statFile, "%s|%s|%01d.%01d.%01d|%01d|%01d|%0.5g|%0.5g|%0.5g|%0.5g|%0.5g\n",
+        fprintf (statFile, "%s|%s|%01d.%01d.%01d|%01d|%01d|%0.5g|%0.5g|%0.5g|%0.5g|%0.5g",
                             argv[1], processName, pdflVersion >> 16, (pdflVersion << 16) >> 16, (pdflVersion << 24) >> 24,
                             completedThreads, activeThreads, WallTimeUsed, CPUTimeUsed, Concurrency,
                             (double)(WallTimeUsed / (completedThreads * 1.0) * activeThreads), CPUTimeUsed / completedThreads);
+        for (int latency = 0; latency < NumberOfLatencies; latency++)
+            WriteLatencyStatistics (statFile, &jobLatency[NumberOfWorkers][latency]);
+        if (InstrumentingMemory ())
+        {
+            fprintf (statFile, "|%01llu|%01llu|%01llu|%0.5g|%0.5g",
+                            (unsigned long long)memoryUsed.allocations, (unsigned long long)memoryUsed.frees, (unsigned long long)memoryUsed.reallocations,
+                            memoryUsed.bytesAllocated / (1024.0 * 1024.0), memoryUsed.highWater / (1024.0 * 1024.0));
+            WriteDocumentMemoryStatistics (statFile);
+        }
+        else
+            fprintf (statFile, "|||||||||");
+        WritePerfStatistics (statFile, &jobCounters[NumberOfWorkers]);
+        WriteResourceStatistics (statFile, &runUsed);
+        fprintf (statFile, "|%01llu|%01llu", (unsigned long long)minorFaults, (unsigned long long)majorFaults);
+        fprintf (statFile, "\n");
         fclose (statFile);
     }
 
@@ -699,13 +1543,33 @@ int main(int argc, char** argv)
 
     /* If we are using a base thread library, stop it now */
     if (SampleAttributes.GetKeyValueBool ("BaseInit"))
+    {
+        ScopedPhase phase (PhaseEnd);
+        Probe1 (lib__term__start, 0);
         delete baseInstance;
+        Probe1 (lib__term__done, 0);
+    }
+
+    /* Every thread has ended, so the timeline is complete */
+    FinishTrace ();
 
     /* After all APDFL Libraries are closed, 
     ** Finalize all memory managers
     */
     FinalizeAllMemoryManagers ();
 
+    /* Release the input cache */
+    FinalizeInputFileSys ();
+    FinalizeOutputFileSys ();
+
+
+    /* Release the thread pool */
+    if (useThreadPool)
+    {
+        DestroyCS (jobQueue.lock);
+        free (jobQueue.jobs);
+        free (pools);
+    }
 
     /* If we built a pause Every List, free it */
     if (pauseEveryList)
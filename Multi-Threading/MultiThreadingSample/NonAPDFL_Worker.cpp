@@ -148,7 +148,6 @@ void NonAPDFLWorker::WorkerThread (ThreadInfo *info)
         {
             /* If we could not read the entire file, mark as failed for reason 2*/
             info->result = 2;
-            free (buffer);
         }
         else
         {
@@ -179,6 +178,7 @@ void NonAPDFLWorker::WorkerThread (ThreadInfo *info)
                 /* Burn some CPU as well */
                 ASUns32 *primes = (ASUns32 *)malloc (sizeof (ASUns32) * Primes[sequence % PrimesCount]);
                 ASUns32 primesFound = FindPrimes (primes, Primes[sequence % PrimesCount]);
+                free (primes);
             }
         }
         free (buffer);
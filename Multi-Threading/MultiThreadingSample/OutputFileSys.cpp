@@ -0,0 +1,496 @@
+/* This is an APDFL file system, used to save output documents to memory, or nowhere at all.
+**
+** A path name in this file system is simply a copy of the C string file name.
+** An open file is a position, an end of file, and (for the memory sink) the buffer
+** of the thread that opened it.
+**
+** Each thread's buffer is created on the first save in that thread, and kept on a
+** list, so that it can be released when the run is complete. When a thread ends, it's
+** buffer is put on a free list, to be picked up by the next thread to save. Only the
+** lists, and the usage counts, are protected by a mutex. Writes go to the thread's own buffer.
+*/
+
+#include <stdlib.h>
+#include "OutputFileSys.h"
+#include "option_names.h"
+#include "WriteBehind.h"
+#include "Utilities.h"
+#include "ASCalls.h"
+
+/* Errors returned by the file system procedures */
+#define OutputFileError(code) ErrBuildCode (ErrAlways, ErrSysASFile, code)
+
+/* The memory buffer for one thread */
+typedef struct outputBuffer
+{
+    char                   *data;           /* Bytes written */
+    ASUns64                 capacity;       /* Bytes allocated */
+    bool                    inUse;          /* True while a file is open on it */
+    struct outputBuffer    *next;           /* Next on the list of all buffers */
+    struct outputBuffer    *nextFree;       /* Next on the list of free buffers */
+} OutputBuffer;
+
+/* One open file */
+typedef struct outputFile
+{
+    OutputBuffer   *buffer;                 /* Where the bytes are kept, NULL to discard them */
+    char           *name;                   /* The path to write to, for write behind */
+    ASUns64         position;               /* Position of the next read or write */
+    ASUns64         eof;                    /* Length of the file */
+} OutputFile;
+
+/* A document closed by the job running in a thread, held until the job ends (Write behind only) */
+typedef struct heldOutput
+{
+    char                   *name;           /* The path to write to */
+    char                   *data;           /* Bytes of the document */
+    ASUns64                 size;           /* Number of bytes */
+    struct heldOutput      *next;
+} HeldOutput;
+
+static const char *outputSinkNames[NumberOfOutputSinks] =
+{ "DISK", "NULL", "MEMORY", "WRITEBEHIND" };
+
+static OutputSinks      outputSink = OutputToDisk;
+static ASFileSysRec     outputFileSysRec;
+static CSMutex          outputLock;
+static OutputBuffer    *outputBuffers = NULL;
+static OutputBuffer    *freeOutputBuffers = NULL;
+static ThreadLocal OutputBuffer *threadOutputBuffer = NULL;
+static ThreadLocal HeldOutput *threadHeldOutput = NULL;
+
+/* Usage counts, for the report at the end of the run */
+static ASInt32          outputFilesSaved = 0;
+static ASUns64          outputBytesSaved = 0;
+static ASUns64          outputLargestFile = 0;
+static ASInt32          outputBuffersCreated = 0;
+static ASInt32          outputFilesDiscarded = 0;
+
+
+/* Take a buffer from the free list, or create a new one, and add it to the list of all buffers */
+static OutputBuffer *NewOutputBuffer ()
+{
+    EnterCS (outputLock);
+    OutputBuffer *buffer = freeOutputBuffers;
+    if (buffer)
+        freeOutputBuffers = buffer->nextFree;
+    LeaveCS (outputLock);
+    if (buffer)
+        return (buffer);
+
+    buffer = (OutputBuffer *)malloc (sizeof (OutputBuffer));
+    buffer->capacity = 1024 * 1024;
+    buffer->data = (char *)malloc ((size_t)buffer->capacity);
+    buffer->inUse = false;
+    buffer->nextFree = NULL;
+
+    EnterCS (outputLock);
+    buffer->next = outputBuffers;
+    outputBuffers = buffer;
+    outputBuffersCreated++;
+    LeaveCS (outputLock);
+
+    return (buffer);
+}
+
+/* Make sure a buffer can hold at least size bytes.
+** Returns false, leaving the buffer as it was, if the memory cannot be had.
+*/
+static bool GrowOutputBuffer (OutputBuffer *buffer, ASUns64 size)
+{
+    if (size <= buffer->capacity)
+        return (true);
+
+    ASUns64 capacity = buffer->capacity;
+    while (capacity < size)
+        capacity *= 2;
+    char *data = (char *)realloc (buffer->data, (size_t)capacity);
+    if (!data)
+        return (false);
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return (true);
+}
+
+/* Set the end of file, zero filling any gap in the memory buffer.
+** Returns zero, or an error if the buffer cannot be grown.
+*/
+static ASInt32 SetOutputEof (OutputFile *file, ASUns64 eof)
+{
+    if (file->buffer && eof > file->eof)
+    {
+        if (!GrowOutputBuffer (file->buffer, eof))
+            return (OutputFileError (fileErrWrite));
+        memset (file->buffer->data + file->eof, 0, (size_t)(eof - file->eof));
+    }
+    file->eof = eof;
+    return (0);
+}
+
+
+/* The file system procedures */
+static ACCB1 ASErrorCode ACCB2 outputOpen (ASPathName pathName, ASFileMode mode, ASMDFile *fP)
+{
+    *fP = NULL;
+
+    /* Files are not kept after they are closed, so there is nothing to open for reading */
+    if (!(mode & (ASFILE_WRITE | ASFILE_CREATE)))
+        return (OutputFileError (fileErrFNF));
+
+    OutputFile *file = (OutputFile *)malloc (sizeof (OutputFile));
+    file->buffer = NULL;
+    file->position = 0;
+    file->eof = 0;
+    file->name = NULL;
+
+    /* For write behind, each file has a buffer of it's own, which is handed on when it is closed */
+    if (outputSink == OutputToWriteBehind)
+    {
+        file->name = (char *)malloc (strlen ((char *)pathName) + 1);
+        strcpy (file->name, (char *)pathName);
+        file->buffer = (OutputBuffer *)malloc (sizeof (OutputBuffer));
+        file->buffer->capacity = 1024 * 1024;
+        file->buffer->data = (char *)malloc ((size_t)file->buffer->capacity);
+        file->buffer->inUse = true;
+    }
+
+    if (outputSink == OutputToMemory)
+    {
+        if (!threadOutputBuffer)
+            threadOutputBuffer = NewOutputBuffer ();
+
+        /* A second file open at once in the same thread gets a buffer of it's own */
+        file->buffer = threadOutputBuffer->inUse ? NewOutputBuffer () : threadOutputBuffer;
+        file->buffer->inUse = true;
+        if (file->buffer != threadOutputBuffer)
+            file->buffer->nextFree = NULL;
+    }
+
+    *fP = (ASMDFile)file;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputClose (ASMDFile f)
+{
+    OutputFile *file = (OutputFile *)f;
+
+    /* A document written behind is held until the job ends (See EndJobOutput) */
+    if (file->name)
+    {
+        HeldOutput *held = (HeldOutput *)malloc (sizeof (HeldOutput));
+        held->name = file->name;
+        held->data = file->buffer->data;
+        held->size = file->eof;
+        held->next = threadHeldOutput;
+        threadHeldOutput = held;
+        file->name = NULL;
+        free (file->buffer);
+        file->buffer = NULL;
+    }
+
+    if (file->buffer)
+        file->buffer->inUse = false;
+
+    EnterCS (outputLock);
+
+    /* A buffer that is not the thread's own goes straight back on the free list */
+    if (file->buffer && file->buffer != threadOutputBuffer)
+    {
+        file->buffer->nextFree = freeOutputBuffers;
+        freeOutputBuffers = file->buffer;
+    }
+
+    outputFilesSaved++;
+    outputBytesSaved += file->eof;
+    if (file->eof > outputLargestFile)
+        outputLargestFile = file->eof;
+    LeaveCS (outputLock);
+
+    free (file);
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputFlush (ASMDFile f)
+{
+    return (0);
+}
+
+static ACCB1 ASSize_t ACCB2 outputRead (void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+    OutputFile *file = (OutputFile *)f;
+    *pError = 0;
+    if (!file->buffer)
+        return (0);
+
+    ASUns64 wanted = (ASUns64)size * count;
+    ASUns64 available = (file->position < file->eof) ? file->eof - file->position : 0;
+    if (wanted > available)
+        wanted = available;
+
+    memcpy (ptr, file->buffer->data + file->position, (size_t)wanted);
+    file->position += wanted;
+    return ((ASSize_t)wanted);
+}
+
+static ACCB1 ASSize_t ACCB2 outputWrite (void *ptr, ASSize_t size, ASSize_t count, ASMDFile f, ASInt32 *pError)
+{
+    OutputFile *file = (OutputFile *)f;
+    ASUns64 length = (ASUns64)size * count;
+    ASUns64 end = file->position + length;
+
+    if (file->buffer)
+    {
+        if ((file->position > file->eof && SetOutputEof (file, file->position)) || !GrowOutputBuffer (file->buffer, end))
+        {
+            *pError = OutputFileError (fileErrWrite);
+            return (0);
+        }
+        memcpy (file->buffer->data + file->position, ptr, (size_t)length);
+    }
+
+    file->position = end;
+    if (end > file->eof)
+        file->eof = end;
+    *pError = 0;
+    return ((ASSize_t)length);
+}
+
+static ACCB1 ASInt32 ACCB2 outputSetPos (ASMDFile f, ASFilePos pos)
+{
+    ((OutputFile *)f)->position = (ASUns64)pos;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputGetPos (ASMDFile f, ASFilePos *pos)
+{
+    *pos = (ASFilePos)((OutputFile *)f)->position;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputSetEof (ASMDFile f, ASFilePos pos)
+{
+    return (SetOutputEof ((OutputFile *)f, (ASUns64)pos));
+}
+
+static ACCB1 ASInt32 ACCB2 outputGetEof (ASMDFile f, ASFilePos *pos)
+{
+    *pos = (ASFilePos)((OutputFile *)f)->eof;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputSetPos64 (ASMDFile f, ASFilePos64 pos)
+{
+    ((OutputFile *)f)->position = (ASUns64)pos;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputGetPos64 (ASMDFile f, ASFilePos64 *pos)
+{
+    *pos = (ASFilePos64)((OutputFile *)f)->position;
+    return (0);
+}
+
+static ACCB1 ASInt32 ACCB2 outputSetEof64 (ASMDFile f, ASFilePos64 pos)
+{
+    return (SetOutputEof ((OutputFile *)f, (ASUns64)pos));
+}
+
+static ACCB1 ASInt32 ACCB2 outputGetEof64 (ASMDFile f, ASFilePos64 *pos)
+{
+    *pos = (ASFilePos64)((OutputFile *)f)->eof;
+    return (0);
+}
+
+static ACCB1 ASPathName ACCB2 outputCopyPathName (ASPathName pathName)
+{
+    char *copy = (char *)malloc (strlen ((char *)pathName) + 1);
+    strcpy (copy, (char *)pathName);
+    return ((ASPathName)copy);
+}
+
+static ACCB1 void ACCB2 outputDisposePathName (ASPathName pathName)
+{
+    free (pathName);
+}
+
+static ACCB1 ASInt32 ACCB2 outputGetName (ASPathName pathName, char *name, ASInt32 maxLength)
+{
+    char *fullName = (char *)pathName;
+    char *fileName = strrchr (fullName, PathSep);
+    fileName = fileName ? fileName + 1 : fullName;
+    if (name && maxLength > 0)
+    {
+        strncpy (name, fileName, maxLength - 1);
+        name[maxLength - 1] = 0;
+    }
+    return ((ASInt32)strlen (fileName));
+}
+
+static ACCB1 char * ACCB2 outputDisplayStringFromPath (ASPathName pathName)
+{
+    char *display = (char *)ASmalloc (strlen ((char *)pathName) + 1);
+    strcpy (display, (char *)pathName);
+    return (display);
+}
+
+static ACCB1 ASBool ACCB2 outputIsSameFile (ASMDFile f, ASPathName pathName, ASPathName newPathName)
+{
+    return (!strcmp ((char *)pathName, (char *)newPathName));
+}
+
+static ACCB1 ASAtom ACCB2 outputGetFileSysName (void)
+{
+    return (ASAtomFromString ("MTOutputFileSys"));
+}
+
+
+/* Select the output sink, and fill in the file system record */
+bool InitializeOutputFileSys (attributes *FrameAttributes)
+{
+    outputSink = OutputToDisk;
+    if (FrameAttributes->IsKeyPresent ("OutputSink"))
+    {
+        outputSink = (OutputSinks)OptionIndex (FrameAttributes->GetKeyValue ("OutputSink")->value (0), outputSinkNames, NumberOfOutputSinks);
+        if (outputSink == NumberOfOutputSinks)
+        {
+            outputSink = OutputToDisk;
+            return (false);
+        }
+    }
+
+    if (outputSink == OutputToDisk)
+        return (true);
+
+    InitCS (outputLock);
+
+    memset (&outputFileSysRec, 0, sizeof (ASFileSysRec));
+    outputFileSysRec.size = sizeof (ASFileSysRec);
+    outputFileSysRec.open = outputOpen;
+    outputFileSysRec.open64 = outputOpen;
+    outputFileSysRec.close = outputClose;
+    outputFileSysRec.flush = outputFlush;
+    outputFileSysRec.read = outputRead;
+    outputFileSysRec.write = outputWrite;
+    outputFileSysRec.setpos = outputSetPos;
+    outputFileSysRec.getpos = outputGetPos;
+    outputFileSysRec.seteof = outputSetEof;
+    outputFileSysRec.geteof = outputGetEof;
+    outputFileSysRec.setpos64 = outputSetPos64;
+    outputFileSysRec.getpos64 = outputGetPos64;
+    outputFileSysRec.seteof64 = outputSetEof64;
+    outputFileSysRec.geteof64 = outputGetEof64;
+    outputFileSysRec.copyPathName = outputCopyPathName;
+    outputFileSysRec.disposePathName = outputDisposePathName;
+    outputFileSysRec.getName = outputGetName;
+    outputFileSysRec.displayStringFromPath = outputDisplayStringFromPath;
+    outputFileSysRec.isSameFile = outputIsSameFile;
+    outputFileSysRec.getFileSysName = outputGetFileSysName;
+
+    if (outputSink == OutputToWriteBehind)
+        StartWriteBehind (FrameAttributes);
+
+    return (true);
+}
+
+int DrainOutputFileSys ()
+{
+    if (outputSink == OutputToWriteBehind)
+        return (DrainWriteBehind ());
+    return (0);
+}
+
+void FinalizeOutputFileSys ()
+{
+    if (outputSink == OutputToDisk)
+        return;
+
+    freeOutputBuffers = NULL;
+    while (outputBuffers)
+    {
+        OutputBuffer *buffer = outputBuffers;
+        outputBuffers = buffer->next;
+        free (buffer->data);
+        free (buffer);
+    }
+
+    DestroyCS (outputLock);
+}
+
+void ReleaseThreadOutputBuffer ()
+{
+    if (!threadOutputBuffer)
+        return;
+
+    EnterCS (outputLock);
+    threadOutputBuffer->nextFree = freeOutputBuffers;
+    freeOutputBuffers = threadOutputBuffer;
+    LeaveCS (outputLock);
+    threadOutputBuffer = NULL;
+}
+
+void EndJobOutput (bool succeeded)
+{
+    while (threadHeldOutput)
+    {
+        HeldOutput *held = threadHeldOutput;
+        threadHeldOutput = held->next;
+        if (succeeded)
+            QueueWriteBehind (held->name, held->data, held->size);
+        else
+        {
+            free (held->data);
+            EnterCS (outputLock);
+            outputFilesDiscarded++;
+            LeaveCS (outputLock);
+        }
+        free (held->name);
+        free (held);
+    }
+}
+
+OutputSinks GetOutputSink ()
+{
+    return (outputSink);
+}
+
+const char *OutputSinkName (OutputSinks sink)
+{
+    return (outputSinkNames[sink]);
+}
+
+ASFileSys GetOutputFileSys ()
+{
+    if (outputSink == OutputToDisk)
+        return (ASGetDefaultFileSys ());
+    return (&outputFileSysRec);
+}
+
+ASPathName OutputFileSysPathName (char *name)
+{
+    if (outputSink != OutputToDisk)
+        return (outputCopyPathName ((ASPathName)name));
+
+#if MAC_ENV
+    return (GetMacPath (name));
+#else
+    return (ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), name, 0));
+#endif
+}
+
+void ReportOutputFileSys (FILE *logFile)
+{
+    if (outputSink == OutputToDisk)
+        return;
+
+    fprintf (logFile, "Output sink (%s): %01d documents (%0.5g MB, largest %0.5g MB) were saved, and %s.",
+        outputSinkNames[outputSink], outputFilesSaved, outputBytesSaved / (1024.0 * 1024.0),
+        outputLargestFile / (1024.0 * 1024.0), (outputSink == OutputToNull) ? "discarded" :
+        (outputSink == OutputToMemory) ? "kept in memory" : "written behind");
+    if (outputSink == OutputToMemory)
+        fprintf (logFile, " %01d thread buffers were used.", outputBuffersCreated);
+    if (outputFilesDiscarded)
+        fprintf (logFile, " %01d documents of failed jobs were not written.", outputFilesDiscarded);
+    fprintf (logFile, "\n");
+    if (outputSink == OutputToWriteBehind)
+        ReportWriteBehind (logFile);
+}
@@ -0,0 +1,78 @@
+/* This is an APDFL file system, used to save output documents somewhere other than disc.
+**
+** When "OutputSink=null" is given, documents are saved through a file system which
+** discards every byte written, but counts them. When "OutputSink=memory" is given,
+** documents are saved into a buffer owned by the saving thread. The buffer is reused
+** (and grown, as needed) by each save in that thread, so that after the first few
+** saves, no memory is allocated for output.
+**
+** When "OutputSink=writebehind" is given, each document is saved into a buffer of it's
+** own. When the job which saved it ends, the buffer is handed to a small pool of I/O
+** threads, which write it to it's final path (See WriteBehind.h), so the worker never
+** waits on storage, unless the budget for bytes waiting to be written is used up.
+** The documents of a job which failed (Perhaps part way through a save) are discarded,
+** so they never replace an earlier output.
+**
+** Comparing a run with "OutputSink=null" or "OutputSink=memory" to one with
+** "OutputSink=disk" (the default) separates the cost of the conversion from the
+** cost of writing to storage, and shows whether storage is the bottleneck.
+**
+** The output file system also supports reading back what has been written,
+** since some save options read the output before they complete.
+*/
+#ifndef OUTPUTFILESYS_H
+#define OUTPUTFILESYS_H
+
+#include "MTHeader.h"
+#include "ASExpT.h"
+
+/* The places output documents may be saved */
+typedef enum outputSinks
+{
+    OutputToDisk,                   /* The default file system (OutputSink=disk) */
+    OutputToNull,                   /* Count and discard (OutputSink=null) */
+    OutputToMemory,                 /* A buffer for each thread (OutputSink=memory) */
+    OutputToWriteBehind,            /* Written to disc by I/O threads (OutputSink=writebehind) */
+    NumberOfOutputSinks
+} OutputSinks;
+
+/* Select the output sink from the framework attributes ("OutputSink=").
+** Call this once, from the main line, before any worker threads are started.
+** Returns false if the value given is not a known sink.
+*/
+bool InitializeOutputFileSys (attributes *FrameAttributes);
+
+/* Wait for any output still being written behind, after all worker threads are complete.
+** Returns the number of documents which could not be written.
+*/
+int DrainOutputFileSys ();
+
+/* Release every thread's output buffer, after all worker threads are complete */
+void FinalizeOutputFileSys ();
+
+/* Called by a thread as it ends, to give it's output buffer to the next thread to save */
+void ReleaseThreadOutputBuffer ();
+
+/* Called as each job ends. With write behind, the documents the job saved are handed to the
+** I/O threads if it succeeded, and discarded if it did not.
+*/
+void EndJobOutput (bool succeeded);
+
+/* Return the output sink in use, and it's name */
+OutputSinks GetOutputSink ();
+const char *OutputSinkName (OutputSinks sink);
+
+/* Return the file system to save output documents to.
+** This is the default file system when the sink is disk.
+*/
+ASFileSys GetOutputFileSys ();
+
+/* Create a path name in the output file system, for a C string file name.
+** Release it with ASFileSysReleasePath (GetOutputFileSys (), path).
+*/
+ASPathName OutputFileSysPathName (char *name);
+
+/* Write a line describing the use of the output sink to the log */
+void ReportOutputFileSys (FILE *logFile);
+
+#endif
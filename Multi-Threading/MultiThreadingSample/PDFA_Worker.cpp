@@ -16,6 +16,8 @@
 
 */
 #include "PDFA_Worker.h"
+#include "OutputFileSys.h"
+#include "trace_events.h"
 #include "PDFProcessorCalls.h"
 
 ASBool PDFProcessorProgressMonitorCBPDFa (ASInt32 pageNum, ASInt32 totalPages, float current, void *clientData);
@@ -110,6 +112,27 @@ void PDFaWorker::ParseOptions (attributes *FrameAttributes, WorkerType *worker)
 
 };
 
+/* Start a PDFProcessor plugin session.
+** There are no settings kept for the session, the conversion parameters
+** vary from job to job.
+*/
+bool PDFaWorker::StartSession (void **sessionData)
+{
+    /* Initialize the HFT for the plugin */
+    gPDFProcessorHFT = InitPDFProcessorHFT;
+
+    //initialize PDFProcessor plugin
+    *sessionData = NULL;
+    return (PDFProcessorInitialize () != 0);
+}
+
+/* End a PDFProcessor plugin session */
+void PDFaWorker::EndSession (void *sessionData)
+{
+    /* terminate the plugin */
+    PDFProcessorTerminate ();
+}
+
     /* One thread worker procedure */
 void PDFaWorker::WorkerThread (ThreadInfo *info)
 {
@@ -129,11 +152,8 @@ void PDFaWorker::WorkerThread (ThreadInfo *info)
         /* Free the input file names */
         free (fullFileName);
 
-        /* Initialize the HFT for the plugin */
-        gPDFProcessorHFT = InitPDFProcessorHFT;
-
-        //initialize PDFProcessor plugin
-        if (!PDFProcessorInitialize ())
+        /* Start (or reuse) the PDFProcessor plugin session */
+        if (!OpenSession (info))
             /* If the plugin cannot be initilized! */
             info->result = 1;
         else
@@ -154,29 +174,29 @@ void PDFaWorker::WorkerThread (ThreadInfo *info)
 
 
             /* Create the ouput file ASPath name */
-#if !MAC_ENV	
-            ASPathName destFilePath = ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), fullOutputFileName, NULL);
-#else
-         ASPathName destFilePath =GetMacPath (fullOutputFileName);
-#endif
+            ASFileSys destFileSys = GetOutputFileSys ();
+            ASPathName destFilePath = OutputFileSysPathName (fullOutputFileName);
 
             /* Release the output file name */
             free (fullOutputFileName);
 
             /* Perform the conversions */
-            PDFProcessorConvertAndSaveToPDFA (inDoc, destFilePath, ASGetDefaultFileSys (),
+            SetWorkerPhase (PhaseConvert);
+            PDFProcessorConvertAndSaveToPDFA (inDoc, destFilePath, destFileSys,
                 ConvertOptions[convertorOptions[sequence % convertorOptionsCount] + 1], &userParams);
+            SetWorkerPhase (PhaseOther);
 
             /* Release the output path name */
-            ASFileSysReleasePath (NULL, destFilePath);
+            ASFileSysReleasePath (destFileSys, destFilePath);
 
-            PDDocClose (inDoc);
+            CloseSampleFile (inDoc);
 
-            /* terminate the plugin */
-            PDFProcessorTerminate ();
+            /* End the plugin session (A pool thread will keep it for the next job) */
+            CloseSession (info);
         }
     HANDLER
         info->result = 2;
+        CloseSession (info);
     END_HANDLER
 
         if (!silent)
@@ -192,6 +212,7 @@ ASBool PDFProcessorProgressMonitorCBPDFa (ASInt32 pageNum, ASInt32 totalPages, f
         pageNum + 1, /* Adding 1, since Page numbers are 0-indexed*/
         totalPages,
         current /* Current Overall Progress */);
+    TraceProgress ("PDF/a page", pageNum, totalPages, current);
 
     //Return 1 to Cancel conversion
     return 0;
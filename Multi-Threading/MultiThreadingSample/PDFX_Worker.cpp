@@ -13,6 +13,8 @@
 **                   RemoveAllAnnotations=[false]                        SettingforPDF/a conversion option "removeAllAnnotations" (100 values max!)
 */
 #include "PDFX_Worker.h"
+#include "OutputFileSys.h"
+#include "trace_events.h"
 #include "PDFProcessorCalls.h"
 
 ASBool PDFProcessorProgressMonitorCBPDFx (ASInt32 pageNum, ASInt32 totalPages, float current, void *clientData);
@@ -83,6 +85,27 @@ void PDFxWorker::ParseOptions (attributes *FrameAttributes, WorkerType *worker)
 };
 
 
+/* Start a PDFProcessor plugin session.
+** There are no settings kept for the session, the conversion parameters
+** vary from job to job.
+*/
+bool PDFxWorker::StartSession (void **sessionData)
+{
+    /* Initialize the HFT for the plugin */
+    gPDFProcessorHFT = InitPDFProcessorHFT;
+
+    //initialize PDFProcessor plugin
+    *sessionData = NULL;
+    return (PDFProcessorInitialize () != 0);
+}
+
+/* End a PDFProcessor plugin session */
+void PDFxWorker::EndSession (void *sessionData)
+{
+    /* terminate the plugin */
+    PDFProcessorTerminate ();
+}
+
 /* One thread worker procedure */
 void PDFxWorker::WorkerThread (ThreadInfo *info)
 {
@@ -102,11 +125,8 @@ void PDFxWorker::WorkerThread (ThreadInfo *info)
         /* Free the input file names */
         free (fullFileName);
 
-        /* Initialize the HFT for the plugin */
-        gPDFProcessorHFT = InitPDFProcessorHFT;
-
-        //initialize PDFProcessor plugin
-        if (!PDFProcessorInitialize ())
+        /* Start (or reuse) the PDFProcessor plugin session */
+        if (!OpenSession (info))
             /* If the plugin cannot be initilized! */
             info->result = 1;
         else
@@ -128,30 +148,30 @@ void PDFxWorker::WorkerThread (ThreadInfo *info)
             }
 
             /* Create the ouput file ASPath name */
-#if !MAC_ENV	
-            ASPathName destFilePath = ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), fullOutputFileName, NULL);
-#else
-            ASPathName destFilePath = GetMacPath (fullOutputFileName);
-#endif
+            ASFileSys destFileSys = GetOutputFileSys ();
+            ASPathName destFilePath = OutputFileSysPathName (fullOutputFileName);
 
             /* Release the output file name */
             free (fullOutputFileName);
 
             /* Perform the conversions */
-            PDFProcessorConvertAndSaveToPDFX (inDoc, destFilePath, ASGetDefaultFileSys (),
+            SetWorkerPhase (PhaseConvert);
+            PDFProcessorConvertAndSaveToPDFX (inDoc, destFilePath, destFileSys,
                 ConvertOptions[convertorOptions[sequence % convertorOptionsCount]], &userParams);
+            SetWorkerPhase (PhaseOther);
 
             /* Release the output path name */
-            ASFileSysReleasePath (NULL, destFilePath);
+            ASFileSysReleasePath (destFileSys, destFilePath);
 
             /* Close the input file */
-            PDDocClose (inDoc);
+            CloseSampleFile (inDoc);
 
-            /* terminate the plugin */
-            PDFProcessorTerminate ();
+            /* End the plugin session (A pool thread will keep it for the next job) */
+            CloseSession (info);
         }
     HANDLER
         info->result = 2;
+        CloseSession (info);
     END_HANDLER
 
 
@@ -168,6 +188,7 @@ ASBool PDFProcessorProgressMonitorCBPDFx (ASInt32 pageNum, ASInt32 totalPages, f
         pageNum + 1, /* Adding 1, since Page numbers are 0-indexed*/
         totalPages,
         current /* Current Overall Progress */);
+    TraceProgress ("PDF/x page", pageNum, totalPages, current);
 
     //Return 1 to Cancel conversion
     return 0;
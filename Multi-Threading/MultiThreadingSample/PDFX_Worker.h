@@ -40,6 +40,10 @@ public:
 
     void WorkerThread (ThreadInfo *info);
 
+    /* Start and end the plugin session (See workerclass::OpenSession) */
+    bool StartSession (void **sessionData);
+    void EndSession (void *sessionData);
+
 private:
 
     bool removeAllAnnotations[100];
@@ -0,0 +1,10 @@
+/* Static probes (USDT).
+**
+** The job running in each thread is kept here, and not in the worker framework, so that the
+** allocators (Which are linked into the allocator benchmark without the framework) may give
+** it to their probes. WorkerPhase sets it as each job starts and ends.
+*/
+
+#include "Probes.h"
+
+ThreadLocal int probeJob = 0;
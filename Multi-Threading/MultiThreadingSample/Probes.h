@@ -0,0 +1,68 @@
+/* Static probes (USDT), so a run may be traced by perf, bpftrace or SystemTap, without a
+** special build, and without the sample writing anything.
+**
+** Where <sys/sdt.h> is installed (The systemtap-sdt-dev or systemtap-sdt-devel package, on Linux),
+** each probe is a single nop instruction, with a note in the executable saying where it is, and
+** where it's arguments are. Until a tracer attaches to it, that nop is all it costs, so the
+** arguments given are only values already at hand. Elsewhere (Or when built with NO_PROBES
+** defined), the probes are empty.
+**
+** The probes are in the provider "mtsample". List them with
+**     perf list sdt_mtsample:* (After perf buildid-cache --add MultiThreadingSample)
+**     bpftrace -l 'usdt:./MultiThreadingSample:*'
+**
+** Strings are passed as pointers; read them with str () in bpftrace. The job is the serial
+** number of the job (From one), or zero where the thread is not running one. The worker is the
+** name of the worker type (e.g. "PDFA"), and the input the name of it's input file (Without path
+** or suffix), or "" where it has none.
+**
+**   job__start (job, type, worker, input)          A job starts, before the library, if it
+**   job__end (job, type, worker, input, result)    starts one, and after it is ended.
+**   lib__init__start (job), lib__init__done (job)  The library is started, and ended, by a job,
+**   lib__term__start (job), lib__term__done (job)  or (Job zero) by a pool thread or the main line.
+**   phase__change (job, worker, input, from, to)   The thread changes phase (See WorkerPhase.h).
+**   queue__push (job, queued)                      The pump queues a job for a pool thread, and a
+**   queue__pop (job, queued)                       pool thread takes it. Queued is the length after.
+**   arena__chunk (job, bytes)                      Allocator slow paths: the arena takes a chunk,
+**   arena__large (job, bytes)                      or a large block, from the system.
+**   slab__refill (job, sizeClass, blockSize)       A slab magazine is refilled from the depot,
+**   slab__new (job, sizeClass, bytes)              which makes a new slab.
+**   large__map (job, bytes, mapped)                A large buffer is mapped, or huge pages were
+**   large__fallback (job, bytes)                   asked for, and not given.
+**
+** For example, the time each job waits in the queue, by worker type:
+**     bpftrace -e 'usdt:./MultiThreadingSample:queue__push { @q[arg0] = nsecs; }
+**                  usdt:./MultiThreadingSample:job__start /@q[arg0]/ { @wait[str(arg2)] = hist(nsecs - @q[arg0]); delete(@q[arg0]); }'
+*/
+#ifndef PROBES_H
+#define PROBES_H
+
+#include "MTHeader.h"
+
+/* The job running in the calling thread (From one), zero if none. Set by SetWorkerJob (See WorkerPhase.h),
+** and read by the probes of modules, such as the allocators, which do not know the job they work for.
+*/
+extern ThreadLocal int probeJob;
+
+#if !defined (NO_PROBES) && defined (__linux__) && defined (__has_include)
+#if __has_include (<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SAMPLE_PROBES
+#endif
+#endif
+
+#ifdef SAMPLE_PROBES
+#define Probe1( name, a ) DTRACE_PROBE1( mtsample, name, a )
+#define Probe2( name, a, b ) DTRACE_PROBE2( mtsample, name, a, b )
+#define Probe3( name, a, b, c ) DTRACE_PROBE3( mtsample, name, a, b, c )
+#define Probe4( name, a, b, c, d ) DTRACE_PROBE4( mtsample, name, a, b, c, d )
+#define Probe5( name, a, b, c, d, e ) DTRACE_PROBE5( mtsample, name, a, b, c, d, e )
+#else
+#define Probe1( name, a ) do { } while (0)
+#define Probe2( name, a, b ) do { } while (0)
+#define Probe3( name, a, b, c ) do { } while (0)
+#define Probe4( name, a, b, c, d ) do { } while (0)
+#define Probe5( name, a, b, c, d, e ) do { } while (0)
+#endif
+
+#endif
@@ -16,6 +16,7 @@
 **                   ColorModel={RGB,CMYK,GRAY,DeviceN]                 Which color model to use. RGB is the default.
 */
 #include "RasterizeDoc_Worker.h"
+#include "OutputFileSys.h"
 #include "PDPageDrawM.h"
 #include "DLExtrasCalls.h"
 #include "PEWCalls.h"
@@ -117,6 +118,7 @@ void RasterizeDocWorker::ParseOptions (attributes *FrameAttributes, WorkerType *
 
 char *RasterizeDocWorker::RenderPageToBitmap (PDPage page, ASSize_t *mapSize, ASSize_t *width, ASSize_t *depth)
 {
+    ScopedPhase phase (PhaseDraw);
 
     /* Get the matrix that transforms user space coordinates to rotated and cropped upright image coordinates.
     **  The origin of this space is the top-left of the rotated, cropped page. Y is decreasing
@@ -182,8 +184,8 @@ char *RasterizeDocWorker::RenderPageToBitmap (PDPage page, ASSize_t *mapSize, AS
     if (bufferSize == 0)
         return (NULL);
 
-    /* Allocate a buffer to hold the bitmap */
-    char *buffer = (char *)malloc (bufferSize);
+    /* Allocate a buffer to hold the bitmap (Mapped for itself, when large buffers are used) */
+    char *buffer = (char *)AllocateLargeBuffer (bufferSize);
 
     /* Point to it int he draw params.*/
     drawParams.buffer = buffer;
@@ -307,29 +309,28 @@ void RasterizeDocWorker::WorkerThread (ThreadInfo *info)
             AddImageToDoc (outDoc, mapsize, mapBuffer, width, depth, info);
 
             /* Free the bitmap */
-            free (mapBuffer);
+            ReleaseLargeBuffer (mapBuffer);
 
             /* Release the current page */
             PDPageRelease (page);
         }
 
         /* Close the input document */
-        PDDocClose (inDoc);
+        CloseSampleFile (inDoc);
 
         if (saveOutput)
         {
             /* Get an ASPathName from the path */
-#if !MAC_ENV	
-            ASPathName destFilePath = ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), fullOutputFileName, NULL);
-#else
-            ASPathName destFilePath = GetMacPath (fullOutputFileName);
-#endif
+            ASFileSys destFileSys = GetOutputFileSys ();
+            ASPathName destFilePath = OutputFileSysPathName (fullOutputFileName);
 
             /* Save document */
-            PDDocSave (outDoc, PDSaveFull | PDSaveCollectGarbage, destFilePath, NULL, NULL, NULL);
+            SetWorkerPhase (PhaseSave);
+            PDDocSave (outDoc, PDSaveFull | PDSaveCollectGarbage, destFilePath, destFileSys, NULL, NULL);
+            SetWorkerPhase (PhaseOther);
 
             /* Release the ASPathName*/
-            ASFileSysReleasePath (NULL, destFilePath);
+            ASFileSysReleasePath (destFileSys, destFilePath);
         }
 
         /* Free the file path */
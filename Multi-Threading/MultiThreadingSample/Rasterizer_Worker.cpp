@@ -16,6 +16,7 @@
 **                   ColorModel={RGB,CMYK,GRAY,DeviceN]                 Which color model to use. RGB is the default.
 */
 #include "Rasterizer_Worker.h"
+#include "OutputFileSys.h"
 #include "PDPageDrawM.h"
 #include "DLExtrasCalls.h"
 #include "PEWCalls.h"
@@ -146,6 +147,7 @@ void RasterizerWorker::ParseOptions (attributes *FrameAttributes, WorkerType *wo
 
 char *RasterizerWorker::RenderPageToBitmap (PDPage page, ASSize_t *mapSize, ASSize_t *width, ASSize_t *depth)
 {
+    ScopedPhase phase (PhaseDraw);
 
     /* Get the matrix that transforms user space coordinates to rotated and cropped upright image coordinates.
     **  The origin of this space is the top-left of the rotated, cropped page. Y is decreasing
@@ -211,8 +213,8 @@ char *RasterizerWorker::RenderPageToBitmap (PDPage page, ASSize_t *mapSize, ASSi
     if (bufferSize == 0)
         return (NULL);
 
-    /* Allocate a buffer to hold the bitmap */
-    char *buffer = (char *)malloc (bufferSize);
+    /* Allocate a buffer to hold the bitmap (Mapped for itself, when large buffers are used) */
+    char *buffer = (char *)AllocateLargeBuffer (bufferSize);
 
     /* Point to it int he draw params.*/
     drawParams.buffer = buffer;
@@ -306,14 +308,17 @@ void RasterizerWorker::WorkerThread (ThreadInfo *info)
     if (!silent)
         fprintf (info->logFile, "Rasterizer Worker Thread Started! (Sequence: %01d, Thread: %01d\n", sequence + 1, info->threadNumber + 1);
 
-    /* Generate input name */
-    char *fullFileName = GetInFileName (sequence);
+    /* Generate input name (Volatile, so the handler sees whether it has been freed) */
+    char * volatile fullFileName = GetInFileName (sequence);
 
 
     DURING
         /* Open the input document */
         PDDoc inDoc = OpenSampleFile (fullFileName);
 
+        /* Free the input file name */
+        free (fullFileName);
+        fullFileName = NULL;
 
         /* Get the number of pages */
         size_t pagesInDocument = PDDocGetNumPages (inDoc);
@@ -360,7 +365,7 @@ void RasterizerWorker::WorkerThread (ThreadInfo *info)
                 }
 
                 /* Free the bitmap */
-                free (mapBuffer);
+                ReleaseLargeBuffer (mapBuffer);
 
             }
         }
@@ -369,19 +374,23 @@ void RasterizerWorker::WorkerThread (ThreadInfo *info)
         {
             /* The automatic logic will use he same suffix for the output as the input, so change the suffix here */
             char *fullOutputFileName = GetOutFileName (sequence, -1);
-#if !MAC_ENV	
-            ASPathName destFilePath = ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), fullOutputFileName, NULL);
-#else
-            ASPathName destFilePath =GetMacPath (fullOutputFileName);
-#endif
-
-            PDDocSave (outDoc, PDSaveFull | PDSaveCollectGarbage, destFilePath, NULL, NULL, NULL);
-            ASFileSysReleasePath (NULL, destFilePath);
+            ASFileSys destFileSys = GetOutputFileSys ();
+            ASPathName destFilePath = OutputFileSysPathName (fullOutputFileName);
+
+            SetWorkerPhase (PhaseSave);
+            PDDocSave (outDoc, PDSaveFull | PDSaveCollectGarbage, destFilePath, destFileSys, NULL, NULL);
+            SetWorkerPhase (PhaseOther);
+            ASFileSysReleasePath (destFileSys, destFilePath);
             free (fullOutputFileName);
             PDDocClose (outDoc);
         }
 
+        /* Close the input document */
+        CloseSampleFile (inDoc);
+
     HANDLER
+        /* Free the name, if the open raised before it was freed */
+        free (fullFileName);
         info->result = 1;
     END_HANDLER
 
@@ -74,6 +74,7 @@ void TextextWorker::WorkerThread (ThreadInfo *info)
         wfConfig.recSize = sizeof (PDWordFinderConfigRec);
 
         /* Create a word finder */
+        SetWorkerPhase (PhaseExtract);
         PDWordFinder wordFinder = PDDocCreateWordFinderEx (inDoc, WF_LATEST_VERSION, false, &wfConfig);
 
         /* How many pages have we already done*/
@@ -136,9 +137,10 @@ void TextextWorker::WorkerThread (ThreadInfo *info)
 
         /* Release the word finder itself*/
         PDWordFinderDestroy (wordFinder);
+        SetWorkerPhase (PhaseOther);
 
         /* Close the input document */
-        PDDocClose (inDoc);
+        CloseSampleFile (inDoc);
 
         /* free input file name  */
         free (fullFileName);
@@ -13,6 +13,10 @@
 #include <stdio.h>
 #include "Utilities.h"
 #include "PDCalls.h"
+#include "InputFileSys.h"
+#include "OutputFileSys.h"
+#include "perf_counters.h"
+#include "option_names.h"
 
 #ifdef MAC_PLATFORM
 #include <limits.h> /* PATH_MAX */
@@ -29,14 +33,15 @@
 //   ColorsPath                     Where to find color profiles, defaults to ..\\..\\Resources\\Color\\Profiles
 //...UnicodePath                    Where to find the Unicode Directory, defaults to ../../Resources/Unicode
 //   CMapsPath                      Where to find the CMaps Directory, defaults to ../../Resources/CMaps
-//   MemoryManger                   Which memory manager should APDFL Use?
+//   MemoryManger                   Which memory manager should APDFL Use? (Unless MemoryManagerName is given)
 //========================================================================================================
-APDFLib::APDFLib(ASUns32 Flags, attributes *FrameAttributes)
+APDFLib::APDFLib(ASUns32 Flags, attributes *FrameAttributes, char *MemoryManagerName)
 #if AIX_GCC_COMPAT
     :gccHelp()
 #endif
 {
     initValid = false;                            //Whether the initialization succeeded.
+    memoryAllocator = NULL;
     stringPool = NULL;
     stringPoolSize = 0;
 
@@ -44,7 +49,6 @@ APDFLib::APDFLib(ASUns32 Flags, attributes *FrameAttributes)
     {
         char *binaries = FrameAttributes->GetKeyValue ("APDFLPath")->value(0);
         strcpy (BinariesPath, binaries);
-        free (binaries);
     }
     else
 #ifdef WIN_PLATFORM
@@ -70,12 +74,33 @@ APDFLib::APDFLib(ASUns32 Flags, attributes *FrameAttributes)
 
     pdflData.flags = Flags;                      // Pass on initialization flags. Generally zero.
 
-    if ((FrameAttributes != NULL) && (FrameAttributes->IsKeyPresent ("MemoryManager")))
+    managerID = no_memoryManager;
+    if (MemoryManagerName != NULL)
+        pdflData.allocator = StringToMemManager (MemoryManagerName, &managerID);
+    else if ((FrameAttributes != NULL) && (FrameAttributes->IsKeyPresent ("MemoryManager")))
         pdflData.allocator = StringToMemManager (FrameAttributes->GetKeyValue ("MemoryManager")->value (0), &managerID);
     else
         pdflData.allocator = NULL;
 
-    InitializeMemoryManager ();
+    /* An arena is created for each library instance, and released with it */
+    if (managerID == arena_memory_manager)
+        pdflData.allocator = memoryAllocator = arena_create ();
+
+    /* A numa arena is mapped on the node of the processor this thread is pinned to */
+    if (managerID == numa_memory_manager)
+        pdflData.allocator = memoryAllocator = arena_create_on_node (numa_current_node ());
+
+    /* Large buffers are taken from the system directly, rather than from the allocator chosen */
+    pdflData.allocator = LargeBufferAllocator (pdflData.allocator, &largeAllocator);
+
+    /* When a budget is given, the allocator is wrapped to track the bytes in use against it */
+    pdflData.allocator = BudgetedAllocator (pdflData.allocator, &memoryBudget);
+
+    /* When memory use is counted, the allocator chosen is wrapped by the counting allocator */
+    pdflData.allocator = InstrumentedAllocator (pdflData.allocator, &instrumentedAllocator);
+
+    /* When a trace is recorded, the recorder sees each call exactly as APDFL makes it */
+    pdflData.allocator = RecordingAllocator (pdflData.allocator, &recordingAllocator);
 
 #ifdef WIN_PLATFORM
     pdflData.inst = dllInst;
@@ -568,17 +593,39 @@ APDFLib::~APDFLib()
 {
     if (initValid)
         PDFLTermHFT();
+    ReleaseMemoryBudget (&memoryBudget);
+
+    /* Release all of the instance's memory at once */
+    if (memoryAllocator != NULL)
+        arena_release (memoryAllocator);
     if (stringPool != NULL)
         free (stringPool);
     free (fontDirList);
     free (colorProfDirList);
     free (pluginDirList);
-    FinalizeMemoryManager ();
 }
 
 
 PDDoc OpenSampleFile (char *name)
 {
+    ScopedPhase phase (PhaseOpen);
+
+    /* When an input cache is in use, open the document from the shared copy in memory */
+    ASFileSys fileSys = GetInputFileSys ();
+    if (fileSys)
+    {
+        ASPathName cachedPath = InputFileSysPathName (name);
+        PDDoc cachedDoc = NULL;
+        DURING
+            cachedDoc = PDDocOpen (cachedPath, fileSys, NULL, true);
+        HANDLER
+            ASFileSysReleasePath (fileSys, cachedPath);
+            RERAISE ();
+        END_HANDLER
+        ASFileSysReleasePath (fileSys, cachedPath);
+        return (cachedDoc);
+    }
+
         ASPathName pathName;
 #if MAC_PLATFORM
         pathName = GetMacPath (name);
@@ -593,20 +640,30 @@ PDDoc OpenSampleFile (char *name)
     return (doc);
 }
 
+/* Close a document opened by OpenSampleFile, noting the memory the job still has in use
+** (See instrumented_memory.h)
+*/
+void CloseSampleFile (PDDoc doc)
+{
+    ScopedPhase phase (PhaseClose);
+    if (CountingPerf ())
+        NoteJobPages (PDDocGetNumPages (doc));
+    PDDocClose (doc);
+    NoteDocumentClosed ();
+}
+
 
 void SaveDocument (PDDoc doc,char *pathName, PDSaveFlags saveFlags)
 {
+    ScopedPhase phase (PhaseSave);
 
-    ASPathName path;
-#if MAC_PLATFORM
-    path = GetMacPath (pathName);
-#else
-    path = ASFileSysCreatePathName (NULL, ASAtomFromString ("Cstring"), pathName, 0);
-#endif
+    /* Save to the output sink selected (The default file system, unless OutputSink is given) */
+    ASFileSys fileSys = GetOutputFileSys ();
+    ASPathName path = OutputFileSysPathName (pathName);
 
-    PDDocSave (doc, saveFlags, path, NULL, NULL, NULL);
+    PDDocSave (doc, saveFlags, path, fileSys, NULL, NULL);
 
-    ASFileSysReleasePath (NULL, path);    //Release ASPathName object and set to NULL.
+    ASFileSysReleasePath (fileSys, path);    //Release ASPathName object and set to NULL.
 }
 
 #ifdef MAC_PLATFORM
@@ -687,28 +744,18 @@ ASPathName GetMacPath (char * filename)
 ** Add a new pair of files. The .h file needs to define it's access routine only. 
 ** the .cpp file sould include defintions for allocation, reallocation, deallocation,
 ** an remaining size.
+**
+** An allocator in a shared library (tcmalloc, jemalloc, mimalloc) needs only a descriptor,
+** naming the library and it's entry points, which is passed to the loader in loadable_memory.cpp.
 */
 
 char *memManagerNames[NumberOfMemManager] =
-{ "NONE", "MALLOC", "TCMALLOC", "RPMALLOC" };
+{ "NONE", "MALLOC", "TCMALLOC", "RPMALLOC", "JEMALLOC", "MIMALLOC", "ARENA", "SLAB", "NUMA" };
 
 
 TKAllocatorProcs *StringToMemManager (char *name, MemoryManagers *saveId)
 {
-    char localName[20];
-    strcpy (localName, name);
-    for (int index = 0; localName[index] != 0; index++)
-        localName[index] = toupper (localName[index]);
-
-    MemoryManagers id = NumberOfMemManager;
-    for (int index = 0; index < NumberOfMemManager; index++)
-    {
-        if (!strcmp (localName, memManagerNames[index]))
-        {
-            id = (MemoryManagers)index;
-            break;
-        }
-    }
+    MemoryManagers id = (MemoryManagers)OptionIndex (name, memManagerNames, NumberOfMemManager);
 
     *saveId = id;
 
@@ -725,11 +772,29 @@ TKAllocatorProcs *StringToMemManager (char *name, MemoryManagers *saveId)
     case tcmalloc_memory_Manager:
         return (tcmalloc_access ());
         break;
-#ifdef WIN_PLATFORM
+
+    case jemalloc_memory_manager:
+        return (jemalloc_access ());
+        break;
+
+    case mimalloc_memory_manager:
+        return (mimalloc_access ());
+        break;
+#ifndef MAC_ENV
     case rpmalloc_memory_manager:
         return (rpmalloc_access ());
         break;
 #endif
+    /* The arena is created by each library instance (See APDFLib::APDFLib) */
+    case arena_memory_manager:
+    case numa_memory_manager:
+        return (NULL);
+        break;
+
+    case slab_memory_manager:
+        return (slab_access ());
+        break;
+
     case NumberOfMemManager:
     default:
         return (NULL);
@@ -740,13 +805,45 @@ TKAllocatorProcs *StringToMemManager (char *name, MemoryManagers *saveId)
     return (NULL);
 }
 
-void APDFLib::InitializeMemoryManager ()
+/* The memory manager selected for the run, and the one each thread's library uses
+** (Which differ when a worker type names a memory manager of it's own)
+*/
+static MemoryManagers selectedManager = no_memoryManager;
+static ThreadLocal int threadManager = no_memoryManager;
+
+void SelectMemoryManager (MemoryManagers id)
+{
+    selectedManager = id;
+}
+
+MemoryManagers SelectedMemoryManager ()
 {
-    switch (managerID)
+    return (selectedManager);
+}
+
+const char *DescribeMemoryManager (MemoryManagers id)
+{
+    switch (id)
     {
-#ifdef WIN_PLATFORM
+    case tcmalloc_memory_Manager:
+        return (tcmalloc_describe ());
+    case jemalloc_memory_manager:
+        return (jemalloc_describe ());
+    case mimalloc_memory_manager:
+        return (mimalloc_describe ());
+    default:
+        return (NULL);
+    }
+}
+
+void InitializeThreadMemoryManager (MemoryManagers id)
+{
+    threadManager = id;
+    switch (id)
+    {
+#ifndef MAC_ENV
         case rpmalloc_memory_manager:
-            rpmalloc_thread_initialize ();
+            rpmalloc_init ();
             break;
 #endif
         default:
@@ -754,16 +851,22 @@ void APDFLib::InitializeMemoryManager ()
     }
 }
 
-void APDFLib::FinalizeMemoryManager ()
+void FinalizeThreadMemoryManager ()
 {
-    switch (managerID)
+    switch (threadManager)
     {
-#ifdef WIN_PLATFORM
+#ifndef MAC_ENV
     case rpmalloc_memory_manager:
-        rpmalloc_thread_finalize ();
+        rpmalloc_term ();
         break;
 #endif
+    case slab_memory_manager:
+        slab_thread_finalize ();
+        break;
     default:
         break;
     }
+
+    /* Write any allocations this thread recorded */
+    FlushAllocationTrace ();
 }
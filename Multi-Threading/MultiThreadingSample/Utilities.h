@@ -28,6 +28,7 @@
 #include "ASCalls.h"
 #include "ASExtraCalls.h"
 #include "MTHeader.h"
+#include "WorkerPhase.h"
 
 
 #ifdef AIX_GCC_COMPAT
@@ -87,6 +88,11 @@ typedef enum memoryMangers
     malloc_memoryManager,
     tcmalloc_memory_Manager,
     rpmalloc_memory_manager,
+    jemalloc_memory_manager,
+    mimalloc_memory_manager,
+    arena_memory_manager,
+    slab_memory_manager,
+    numa_memory_manager,
     NumberOfMemManager
 } MemoryManagers;
 
@@ -94,31 +100,57 @@ typedef enum memoryMangers
 #include "malloc_memory.h"
 #include "tcmalloc_memory.h"
 #include "rpmalloc_memory.h"
+#include "jemalloc_memory.h"
+#include "mimalloc_memory.h"
+#include "arena_memory.h"
+#include "slab_memory.h"
+#include "numa_memory.h"
+#include "large_memory.h"
+#include "memory_budget.h"
+#include "allocation_trace.h"
+#include "allocation_profile.h"
+#include "instrumented_memory.h"
 
 
 TKAllocatorProcs *StringToMemManager (char *name, MemoryManagers *id);
 
+/* Record the memory manager selected for the run. Call this from the main line, before any thread is started. */
+void SelectMemoryManager (MemoryManagers id);
+MemoryManagers SelectedMemoryManager ();
+
+/* Return a line describing a memory manager loaded from a shared library, or NULL for any other */
+const char *DescribeMemoryManager (MemoryManagers id);
+
+/* Some memory managers keep state for each thread. Each worker thread calls these,
+** before it starts a library, and after it's library is terminated. The manager
+** given is the one the thread's library is started with.
+*/
+void InitializeThreadMemoryManager (MemoryManagers id);
+void FinalizeThreadMemoryManager ();
+
 
 
 class APDFLib
 {
 public:
     //Constructor initializes APDFL Using choices encoded in the attributes.
-    APDFLib (ASUns32 flags, attributes *FrameAttributes);
+    //When a memory manager is named, it is used in place of the one in the attributes.
+    APDFLib (ASUns32 flags, attributes *FrameAttributes, char *MemoryManagerName = NULL);
     ~APDFLib();                                       //Destructor terminates APDFL.
 
     ASInt32 getInitError();                           //Reports whether an error happened during initialization and returns that error.
     ASBool isValid() { return initValid; };           //Returns true if the library initialized successfully.
     static void displayError(ASErrorCode);            //Utility method, may be used to print APDFL errors to the terminal.
 
-void InitializeMemoryManager ();
-void FinalizeMemoryManager ();
-
 private:
     PDFLDataRec pdflData;                             //A struct containing information that APDFL initializes with.
     ASInt32 initError;                                //Used to record initialization errors.
     ASBool initValid;                                 //Set to true if the library initializes successfully.
-    TKAllocatorProcsP memoryAllocator;                //Set to te memory allocator to use
+    TKAllocatorProcsP memoryAllocator;                //Set to te memory allocator to use, when it belongs to this instance (arena)
+    TKAllocatorProcs largeAllocator;                  //Maps large buffers for themselves, when "LargeBuffers=" is given
+    TKAllocatorProcs instrumentedAllocator;           //Counts the use of the allocator, when "InstrumentMemory=true"
+    MemoryBudget memoryBudget;                        //Holds the allocator to a budget, when "MemoryBudget=" is given
+    TKAllocatorProcs recordingAllocator;              //Records each call to the allocator, when "AllocationTrace=" is given
     MemoryManagers managerID;
 
     void fillDirectories(attributes *frameAttributes);                           //Sets directory information for our PDFLDataRec.
@@ -147,6 +179,7 @@ private:
 };
 
 PDDoc OpenSampleFile (char *);
+void  CloseSampleFile (PDDoc doc);
 void  SaveDocument (PDDoc doc, char *name, PDSaveFlags saveFlags = (PDSaveFull | PDSaveCollectGarbage));
 ASPathName GetMacPath (char * filename);
 
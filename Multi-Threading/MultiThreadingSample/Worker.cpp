@@ -4,6 +4,10 @@
 */
 
 #include "Worker.h"
+#include "OutputFileSys.h"
+#include "latency_histogram.h"
+#include "trace_events.h"
+#include "Probes.h"
 
 /* Initialiaze the object with static values.*/
 workerclass::workerclass ()
@@ -14,6 +18,8 @@ workerclass::workerclass ()
     OutPathCount = 0;
     silent = true;
     noAPDFL = false;
+    memoryManagerName = NULL;
+    memoryManager = no_memoryManager;
     InFilePath = InFileName = InFileSuffix = OutFilePath = NULL;
 }
 
@@ -129,6 +135,37 @@ char * workerclass::GetOutFileName (int threadSequence, int inner)
 }
 
 
+#ifndef WIN_PLATFORM
+/* CPU time (user and kernel) used so far by the calling thread, in seconds */
+static double threadCPUSeconds ()
+{
+    struct timespec cpuTime;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+    return (cpuTime.tv_sec + ((cpuTime.tv_nsec * 1.0) / 1000000000.0));
+}
+#endif
+
+/* Page faults taken so far by the calling thread. Only Linux counts these for each thread. */
+static void threadPageFaults (ASUns64 *minor, ASUns64 *major)
+{
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    getrusage (RUSAGE_THREAD, &usage);
+    *minor = usage.ru_minflt;
+    *major = usage.ru_majflt;
+#else
+    *minor = *major = 0;
+#endif
+}
+
+/* The name of a job's input file, without path or suffix, for the probes */
+static const char *probeInput (workerclass *worker, ThreadInfo *info)
+{
+    if (!worker->InFileCount)
+        return ("");
+    return (worker->InFileName[info->sequence % worker->InFileCount]);
+}
+
 /* For non indows platforms, save start time. 
 ** For all platforms, initialize the APDFL library
 ** (if desired), and pass the worker type value for silent 
@@ -137,12 +174,25 @@ char * workerclass::GetOutFileName (int threadSequence, int inner)
 */
 void workerclass::startThreadWorker (ThreadInfo *info)
 {
+    SetWorkerJob (info->threadNumber + 1, WorkerIDEntry->name, probeInput (this, info));
+    Probe4 (job__start, info->threadNumber + 1, (int)workerType, WorkerIDEntry->name, probeInput (this, info));
+    StartJobPhaseTimes ();
+    ThreadResourceUse (&info->startResources);
 #ifndef WIN_PLATFORM
-    struct timezone zone;
-    memset ((char *)&zone, 0, sizeof (struct timezone));
-    gettimeofday (&info->startTime, &zone);
-    info->startCPU = clock ();
+    info->startThreadCPU = threadCPUSeconds ();
 #endif
+    info->queueTime = LatencyClock () - info->queuedAt;
+
+    /* Count memory used by the job, including starting and ending the library */
+    StartJobMemoryCounters ();
+    threadPageFaults (&info->startMinorFaults, &info->startMajorFaults);
+
+    /* Pin the thread (when asked) before any of it's memory is touched */
+    numa_pin_thread (info->threadNumber);
+
+    /* Per thread memory manager state must exist before the library is started */
+    InitializeThreadMemoryManager (memoryManager);
+
     if (noAPDFL)
     {
         info->instance = NULL;
@@ -150,10 +200,13 @@ void workerclass::startThreadWorker (ThreadInfo *info)
     }
     else
     {
+        ScopedPhase phase (PhaseStart);
         ASUns32 flags = 0;
         if (!info->LoadPlugins)
             flags |= kDontLoadPlugIns;
-        info->instance = new APDFLib (flags, frameAttributes);
+        Probe1 (lib__init__start, info->threadNumber + 1);
+        info->instance = new APDFLib (flags, frameAttributes, memoryManagerName);
+        Probe1 (lib__init__done, info->threadNumber + 1);
         if (info->UseTempMemFileSys)
             ASSetTempFileSys (ASGetRamFileSys ());
     }
@@ -168,25 +221,178 @@ void workerclass::startThreadWorker (ThreadInfo *info)
 void workerclass::endThreadWorker (ThreadInfo *info)
 {
     if (info->instance)
+    {
+        ScopedPhase phase (PhaseEnd);
+        Probe1 (lib__term__start, info->threadNumber + 1);
         delete info->instance;
+        Probe1 (lib__term__done, info->threadNumber + 1);
+    }
 
+    /* Write behind the documents the job saved, unless it failed, and pass this thread's
+    ** output buffer (If any) on to later threads
+    */
+    EndJobOutput (info->result == 0);
+    ReleaseThreadOutputBuffer ();
+
+    /* Release per thread memory manager state, now the library is terminated */
+    FinalizeThreadMemoryManager ();
+    TakeJobMemoryCounters (&info->memory);
+    TakeJobPhaseTimes (&info->phases);
+    threadPageFaults (&info->minorFaults, &info->majorFaults);
+    info->minorFaults -= info->startMinorFaults;
+    info->majorFaults -= info->startMajorFaults;
+
+    /* The wall time is by the monotonic clock (See process_metrics.h) */
+    ResourceUse endResources;
+    ThreadResourceUse (&endResources);
+    ResourceUsed (&info->resources, &info->startResources, &endResources);
+    info->wallTimeUsed = info->resources.wall;
 #ifndef WIN_PLATFORM
-    struct timezone zone;
-    memset ((char *)&zone, 0, sizeof (struct timezone));
-    gettimeofday (&info->endTime, &zone);
-    info->wallTimeUsed = ((info->endTime.tv_sec - info->startTime.tv_sec) * 1.0) +
-                         (((info->endTime.tv_usec - info->startTime.tv_usec) * 1.0) / 1000000);
-    clockid_t clockId;
-    pthread_getcpuclockid (info->threadID, &clockId);
-    struct timespec cpuTime;
-    clock_gettime (clockId, &cpuTime);
-    info->cpuTimeUsed = cpuTime.tv_sec + ((cpuTime.tv_nsec * 1.0) / 1000000000.0);
-    info->percentUtilized = (info->cpuTimeUsed / info->wallTimeUsed) * 100;
+    info->cpuTimeUsed = threadCPUSeconds () - info->startThreadCPU;
+    info->percentUtilized = info->wallTimeUsed > 0 ? (info->cpuTimeUsed / info->wallTimeUsed) * 100 : 0;
 #endif
+    TraceJob (WorkerIDEntry->name, info->threadNumber, info->queuedAt + info->queueTime, LatencyClock ());
+    Probe5 (job__end, info->threadNumber + 1, (int)workerType, WorkerIDEntry->name, probeInput (this, info), info->result);
+    SetWorkerJob (0, NULL, NULL);
+
     /* This is used by non windows thread pump to detect that a thread is complete */
     info->threadCompleted = true;
 }
 
+/* Start of a job run in a pool thread.
+**
+** The library is already open in the pool thread, so just use it's instance.
+** As the thread runs many jobs, start times are taken for all platforms here, 
+** (The windows thread pump cannot use the threads times, as it does for a 
+** thread per job).
+*/
+void workerclass::startPooledJob (ThreadInfo *info, PoolThread *pool)
+{
+    info->queueTime = LatencyClock () - info->queuedAt;
+    SetWorkerJob (info->threadNumber + 1, WorkerIDEntry->name, probeInput (this, info));
+    Probe4 (job__start, info->threadNumber + 1, (int)workerType, WorkerIDEntry->name, probeInput (this, info));
+    StartJobPhaseTimes ();
+    ThreadResourceUse (&info->startResources);
+    info->pool = pool;
+    info->threadID = pool->threadID;
+#ifndef WIN_PLATFORM
+    info->startThreadCPU = threadCPUSeconds ();
+#else
+    FILETIME created, exited, kernel, user;
+    GetThreadTimes (GetCurrentThread (), &created, &exited, &kernel, &user);
+    info->startCPU64 = *((ASUns64 *)&kernel) + *((ASUns64 *)&user);
+#endif
+    StartJobMemoryCounters ();
+    threadPageFaults (&info->startMinorFaults, &info->startMajorFaults);
+    if (noAPDFL)
+    {
+        info->instance = NULL;
+        info->noAPDFL = true;
+    }
+    else
+        info->instance = pool->instance;
+    info->silent = silent;
+}
+
+/* End of a job run in a pool thread.
+**
+** Capture end time, and times used (For all platforms). The library
+** instance, and any plugin session, are left open for the next job.
+*/
+void workerclass::endPooledJob (ThreadInfo *info)
+{
+    /* The wall time is by the monotonic clock (See process_metrics.h) */
+    ResourceUse endResources;
+    ThreadResourceUse (&endResources);
+    ResourceUsed (&info->resources, &info->startResources, &endResources);
+    info->wallTimeUsed = info->resources.wall;
+#ifndef WIN_PLATFORM
+    info->cpuTimeUsed = threadCPUSeconds () - info->startThreadCPU;
+#else
+    FILETIME created, exited, kernel, user;
+    GetThreadTimes (GetCurrentThread (), &created, &exited, &kernel, &user);
+    info->cpuTimeUsed = ((*((ASUns64 *)&kernel) + *((ASUns64 *)&user) - info->startCPU64) * 1.0) / 10000000;
+#endif
+    info->percentUtilized = info->wallTimeUsed > 0 ? (info->cpuTimeUsed / info->wallTimeUsed) * 100 : 0;
+    EndJobOutput (info->result == 0);
+    TakeJobMemoryCounters (&info->memory);
+    TakeJobPhaseTimes (&info->phases);
+    threadPageFaults (&info->minorFaults, &info->majorFaults);
+    info->minorFaults -= info->startMinorFaults;
+    info->majorFaults -= info->startMajorFaults;
+    TraceJob (WorkerIDEntry->name, info->threadNumber, info->queuedAt + info->queueTime, LatencyClock ());
+    Probe5 (job__end, info->threadNumber + 1, (int)workerType, WorkerIDEntry->name, probeInput (this, info), info->result);
+    SetWorkerJob (0, NULL, NULL);
+
+    /* This is used by the thread pump to detect that a job is complete */
+    info->threadCompleted = true;
+}
+
+/* Open a plugin session for this job.
+**
+** If the job is run by a pool thread, and that thread already has a session open 
+** for the plugin this worker uses, reuse it. Otherwise, start a new session, and time it.
+** A pool thread keeps the new session for the jobs that follow. 
+*/
+bool workerclass::OpenSession (ThreadInfo *info)
+{
+    PoolThread *pool = info->pool;
+    EnumOfPlugins plugin = callSessionPlugin (this);
+    if (pool && pool->sessionOwner[plugin])
+    {
+        info->sessionReused = true;
+        info->sessionOpen = true;
+        return (true);
+    }
+
+    void *data = NULL;
+    ScopedPhase phase (PhaseSession);
+    double start = LatencyClock ();
+    bool started = callStartSession (this, &data);
+    info->sessionTime += LatencyClock () - start;
+    if (!started)
+        return (false);
+
+    if (pool)
+    {
+        pool->sessionOwner[plugin] = this;
+        pool->sessionData[plugin] = data;
+    }
+    else
+        info->sessionData = data;
+    info->sessionStarted = true;
+    info->sessionOpen = true;
+    return (true);
+}
+
+/* Return the data built when the current session was started */
+void *workerclass::SessionData (ThreadInfo *info)
+{
+    if (info->pool)
+        return (info->pool->sessionData[callSessionPlugin (this)]);
+    return (info->sessionData);
+}
+
+/* Close the plugin session for this job.
+**
+** A session kept by a pool thread is left open, to be ended when the pool thread finishes.
+** It is safe to call this when no session is open (from an exception handler, for instance).
+*/
+void workerclass::CloseSession (ThreadInfo *info)
+{
+    if (!info->sessionOpen)
+        return;
+    info->sessionOpen = false;
+    if (info->pool)
+        return;
+
+    ScopedPhase phase (PhaseSession);
+    double start = LatencyClock ();
+    callEndSession (this, info->sessionData);
+    info->sessionTime += LatencyClock () - start;
+    info->sessionData = NULL;
+}
+
 /* Utiltity routine to divide a file name into path, name, and suffix */
 void workerclass::splitpath (char *path, char **toPath, char **filename, char **suffix)
 {
@@ -315,6 +521,7 @@ void    workerclass::ParseOptions (attributes *FrameAttributes, char *defaultInF
         for (int count = 0; count < values->size (); count++)
             valueArray[count + 1] = values->value (count);
         threadAttributes = new attributes (listSize + 1, valueArray);
+        free (valueArray);
     }
     else
     {
@@ -419,6 +626,22 @@ void    workerclass::ParseOptions (attributes *FrameAttributes, char *defaultInF
     if (threadAttributes->IsKeyPresent ("LoadPlugins"))
         WorkerIDEntry->LoadPlugins = threadAttributes->GetKeyValueBool ("LoadPlugins");
 
+    /* All threads accept MemoryManager as an option.
+    ** It replaces the run's memory manager for the libraries of this type of worker,
+    ** so that each type may use the allocator best suited to it.
+    */
+    memoryManager = SelectedMemoryManager ();
+    if (threadAttributes->IsKeyPresent ("MemoryManager"))
+    {
+        memoryManagerName = threadAttributes->GetKeyValue ("MemoryManager")->value (0);
+        StringToMemManager (memoryManagerName, &memoryManager);
+        if (memoryManager == NumberOfMemManager)
+        {
+            printf ("The memory manager \"%s\" does not exist? \n", memoryManagerName);
+            exit (-1);
+        }
+    }
+
     /* Validate that every intput file name exists, and is readable
     ** Fail if thie is not true!
     */
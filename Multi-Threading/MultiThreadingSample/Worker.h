@@ -7,11 +7,14 @@
 
 #include "MTHeader.h"
 #include "Utilities.h"
+#include "perf_counters.h"
+#include "process_metrics.h"
 #include "ASExpT.h"
 #include <time.h>
 
 #ifndef WIN_PLATFORM
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <pthread.h>
 #endif
 
@@ -34,10 +37,48 @@ typedef enum
     NumberOfWorkers
 } EnumOfWorkers;
 
+/* The plugins workers open sessions on (See workerclass::OpenSession). Several worker types
+** may start the same plugin (PDFA and PDFX both start PDFProcessor), and a plugin may be
+** initialized only once in a thread, so a pool thread keeps one session for each plugin, not
+** for each worker type. Workers sharing a plugin must build the same session data (Or none).
+** The last member of the enumeration must always be "NumberOfPlugins"
+*/
+typedef enum
+{
+    PDFProcessorPlugin,
+    FlattenerPlugin,
+    XPS2PDFPlugin,
+    NumberOfPlugins
+} EnumOfPlugins;
+
 
 
 class workerclass;
 
+/* Pool thread communication.
+** When "ThreadPool=true", jobs are not given a thread of their own. Instead, "ActiveThreads" pool 
+** threads are started once, and each runs job after job from the pump's queue. The library instance
+** belongs to the pool thread, as does any plugin session a worker opens (See workerclass::OpenSession).
+** A plugin session opened by the first job to use a plugin is reused by every later job using that plugin
+** in the same pool thread (Whatever it's type), and is ended only when the pool thread finishes.
+*/
+typedef struct poolthread
+{
+    ASInt32         poolNumber;                         /* Serial number of this thread in the pool */
+    SDKThreadID     threadID;                           /* Platform dependent thread "handle" */
+    APDFLib        *instance;                           /* APDFL Library instance, shared by all jobs run in this thread */
+    attributes     *frameAttributes;                    /* Framework attributes, used to initialize the library */
+    bool            noAPDFL;                            /* When true, no job in this pool needs the library */
+    bool            LoadPlugins;                        /* If true, some job in this pool needs plugins */
+    bool            UseTempMemFileSys;                  /* If true, use the Ram File Sys for temp files. */
+    char           *memoryManagerName;                  /* Memory manager the library is started with, NULL for the run's */
+    MemoryManagers  memoryManager;                      /* It's ID (The run's, when the name is NULL) */
+    workerclass    *sessionOwner[NumberOfPlugins];      /* Worker which started each plugin's session in this thread, NULL if none */
+    void           *sessionData[NumberOfPlugins];       /* Data built when that session was started */
+    double          sessionTime;                        /* Seconds spent ending the open sessions, as the thread finished */
+    bool            threadCompleted;                    /* Mark the pool thread complete, after all sessions and the library are closed */
+} PoolThread;
+
 /* Thread Communication */
 typedef struct
 {
@@ -47,11 +88,7 @@ typedef struct
     void           *object;                             /* Worker Thread Object */
     APDFLib        *instance;                           /* APDFL Library instance */
     ASInt32         result;                             /* Numeric result, unique to worker type. But "zero" is always "No Problem" */
-#ifndef WIN_PLATFORM
-    struct timeval  startTime, endTime;                 /* Used in Unix only, wall time started/stopped */
-    clock_t         startCPU, endCPU;                   /* Used in Unix only to track CPU time used. */
-#endif
-    double          wallTimeUsed, cpuTimeUsed;          /* Walltime start to finish, and CPU time (user and kernal) consumed */
+    double          wallTimeUsed, cpuTimeUsed;          /* Walltime start to finish (Monotonic), and CPU time (user and kernal) consumed */
     double          percentUtilized;                    /* Percentage of CPU time in wall time */
     bool            silent;                             /* When true, write nothing to stdout! */
     bool            noAPDFL;                            /* When true, do not init/term the library in this thread! */
@@ -60,6 +97,26 @@ typedef struct
     bool            logFileSet;                         /* If log file is set, then default "silent" to "false". */
     bool            LoadPlugins;                        /* If true, we must load plugins for this type of worker. */
     bool            UseTempMemFileSys;                  /* If true, use the Ram File Sys for temp files. */
+    PoolThread     *pool;                               /* The pool thread running this job, or NULL if the job has it's own thread */
+    void           *sessionData;                        /* Plugin session data, when the session is not kept by a pool thread */
+    bool            sessionOpen;                        /* True while this job has a plugin session open */
+    bool            sessionStarted;                     /* True if this job started a plugin session */
+    bool            sessionReused;                      /* True if this job used a session started by an earlier job */
+    double          sessionTime;                        /* Seconds this job spent starting (and ending) it's plugin session */
+#ifndef WIN_PLATFORM
+    double          startThreadCPU;                     /* Thread CPU time when the job started (Pool threads run many jobs) */
+#else
+    ASUns64         startCPU64;                         /* FILETIME CPU time when a pooled job started */
+#endif
+    double          queuedAt;                           /* LatencyClock when the pump released the job */
+    double          queueTime;                          /* Seconds from the pump releasing the job until it started */
+    MemoryCounters  memory;                             /* Memory used by this job, when "InstrumentMemory=true" */
+    PhaseTimes      phases;                             /* Time this job spent in each phase (See WorkerPhase.h) */
+    PerfCounts      counters;                           /* Performance counters of the job's work, when "PerfCounters=true" */
+    ResourceUse     startResources;                     /* Resources used by the thread when the job started */
+    ResourceUse     resources;                          /* Resources used by this job (CPU, context switches, run delay) */
+    ASUns64         startMinorFaults, startMajorFaults; /* Page faults taken by the thread when the job started */
+    ASUns64         minorFaults, majorFaults;           /* Page faults taken by this job (Counted on Linux only) */
 } ThreadInfo;
 
 /* Worker Type Communication */
@@ -125,6 +182,14 @@ public:
     */
     bool        noAPDFL;
 
+    /* The memory manager the libraries of this type of worker are started with.
+    ** This will be set in the standard options logic (workerclass::ParserOptions()) from the command
+    ** line keyword "MemoryManager". When it is not given, memoryManagerName is NULL, and
+    ** memoryManager is the one selected for the run.
+    */
+    char           *memoryManagerName;
+    MemoryManagers  memoryManager;
+
     /* Dictionary of options for this object */
     attributes *threadAttributes;
 
@@ -157,6 +222,28 @@ public:
     /* Processing done at the end of every worker thread! */
     void endThreadWorker (ThreadInfo *info);
 
+    /* Processing done at the start and end of each job run by a pool thread.
+    ** These do what startThreadWorker/endThreadWorker do, but use the library 
+    ** instance belonging to the pool thread, rather than creating one.
+    */
+    void startPooledJob (ThreadInfo *info, PoolThread *pool);
+    void endPooledJob (ThreadInfo *info);
+
+    /* Plugin sessions.
+    ** Workers which use a plugin call OpenSession before their work, and CloseSession after.
+    ** OpenSession calls the workers StartSession (through callStartSession()), which will initialize 
+    ** the plugin, and may build conversion settings that do not change from job to job (SessionData).
+    ** CloseSession calls the workers EndSession in the same way.
+    **
+    ** When the job is run by a pool thread, the session is kept open when the job completes, and later 
+    ** jobs in that thread using the same plugin reuse it, rather than starting their own. 
+    **
+    ** OpenSession returns false if the session could not be started.
+    */
+    bool  OpenSession (ThreadInfo *info);
+    void *SessionData (ThreadInfo *info);
+    void  CloseSession (ThreadInfo *info);
+
     /* Utiltity to split a file name into path, name, suffix */
     void splitpath (char *path, char **toPath, char **filename, char **suffix);
 
@@ -180,4 +267,15 @@ public:
     void    ParseOptions (attributes *FrameAttributes, char *defaultInFileName, char *defaultOutFilePath);
 };
 
+/* These call the StartSession/EndSession of a worker, based on it's GetWorkerClass method,
+** and give the plugin it starts.
+** They are defined with callWorker() (MultiThreadingSample.cpp), and must be updated for
+** every worker type that uses a plugin session.
+*/
+bool callStartSession (workerclass *worker, void **sessionData);
+void callEndSession (workerclass *worker, void *sessionData);
+
+/* The plugin whose session a worker starts */
+EnumOfPlugins callSessionPlugin (workerclass *worker);
+
 #endif
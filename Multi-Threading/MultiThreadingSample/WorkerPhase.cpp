@@ -0,0 +1,147 @@
+/* The phase of it's work each thread is in.
+**
+** The phase is a single value in thread local storage, so it is set and read without a lock.
+** The phase times are kept in thread local storage too. Reading the clocks costs a little,
+** so they are read only while a job is being timed, and phases change only a few times a job.
+** When a trace is being written, each phase left (But "other") is written to it as a span.
+** Each change of phase also fires the phase__change probe (See Probes.h).
+*/
+
+#include <string.h>
+#include "WorkerPhase.h"
+#include "trace_events.h"
+#include "latency_histogram.h"
+#include "Probes.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const char *phaseNames[NumberOfPhases] = { "other", "start", "open", "convert", "draw", "extract", "save", "end", "session", "close" };
+
+static ThreadLocal int threadPhase = PhaseOther;
+
+/* The phase times of the job running in this thread, and the clocks when the phase last changed */
+static ThreadLocal bool         threadTiming = false;
+static ThreadLocal PhaseTimes   threadTimes;
+static ThreadLocal double       phaseWallStart, phaseCPUStart;
+
+/* When the phase last changed, by LatencyClock, for the trace */
+static ThreadLocal double       phaseTraceStart = 0;
+
+/* The job running in this thread, for the probes */
+static ThreadLocal int          threadJob = 0;
+static ThreadLocal const char  *threadWorker = "";
+static ThreadLocal const char  *threadInput = "";
+
+
+/* Read the monotonic clock, and the CPU time (user and kernel) of the calling thread, in seconds */
+static void PhaseClocks (double *wall, double *cpu)
+{
+    *wall = LatencyClock ();
+#ifndef WIN_PLATFORM
+    struct timespec now;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+    *cpu = now.tv_sec + ((now.tv_nsec * 1.0) / 1000000000.0);
+#else
+    FILETIME created, exited, kernel, user;
+    GetThreadTimes (GetCurrentThread (), &created, &exited, &kernel, &user);
+    *cpu = ((*((ASUns64 *)&kernel) + *((ASUns64 *)&user)) * 1.0) / 10000000;
+#endif
+}
+
+/* Charge the time since the last change to the current phase */
+static void ChargePhase ()
+{
+    double wall, cpu;
+    PhaseClocks (&wall, &cpu);
+    threadTimes.wall[threadPhase] += wall - phaseWallStart;
+    threadTimes.cpu[threadPhase] += cpu - phaseCPUStart;
+    phaseWallStart = wall;
+    phaseCPUStart = cpu;
+}
+
+
+WorkerPhases SetWorkerPhase (WorkerPhases phase)
+{
+    WorkerPhases previous = (WorkerPhases)threadPhase;
+    if (threadTiming && phase != previous)
+    {
+        ChargePhase ();
+        threadTimes.entered[phase]++;
+    }
+    if (Tracing () && phase != previous)
+    {
+        double now = LatencyClock ();
+        if (previous != PhaseOther)
+            TraceSpan ("phase", phaseNames[previous], phaseTraceStart, now);
+        phaseTraceStart = now;
+    }
+    if (phase != previous)
+        Probe5 (phase__change, threadJob, threadWorker, threadInput, phaseNames[previous], phaseNames[phase]);
+    threadPhase = phase;
+    return (previous);
+}
+
+WorkerPhases GetWorkerPhase ()
+{
+    return ((WorkerPhases)threadPhase);
+}
+
+const char *WorkerPhaseName (WorkerPhases phase)
+{
+    if (phase < 0 || phase >= NumberOfPhases)
+        return ("unknown");
+    return (phaseNames[phase]);
+}
+
+void SetWorkerJob (int job, const char *worker, const char *input)
+{
+    threadJob = job;
+    probeJob = job;
+    threadWorker = worker ? worker : "";
+    threadInput = input ? input : "";
+}
+
+void StartJobPhaseTimes ()
+{
+    memset (&threadTimes, 0, sizeof (PhaseTimes));
+    PhaseClocks (&phaseWallStart, &phaseCPUStart);
+    threadTimes.entered[threadPhase]++;
+    threadTiming = true;
+}
+
+void TakeJobPhaseTimes (PhaseTimes *times)
+{
+    if (threadTiming)
+        ChargePhase ();
+    threadTiming = false;
+    memcpy (times, &threadTimes, sizeof (PhaseTimes));
+}
+
+void AddPhaseTimes (PhaseTimes *total, PhaseTimes *job)
+{
+    for (int phase = 0; phase < NumberOfPhases; phase++)
+    {
+        total->wall[phase] += job->wall[phase];
+        total->cpu[phase] += job->cpu[phase];
+        total->entered[phase] += job->entered[phase];
+    }
+}
+
+void ReportPhaseTimes (FILE *logFile, const char *name, PhaseTimes *total, int jobs)
+{
+    double wall = 0;
+    for (int phase = 0; phase < NumberOfPhases; phase++)
+        wall += total->wall[phase];
+    if (!jobs || wall <= 0)
+        return;
+
+    fprintf (logFile, "  %s, seconds per job (wall, CPU, and share of the wall time):\n", name);
+    for (int phase = 0; phase < NumberOfPhases; phase++)
+        if (total->entered[phase])
+            fprintf (logFile, "    %-8s %10.5g  %10.5g  %5.1f%%\n", phaseNames[phase],
+                total->wall[phase] / jobs, total->cpu[phase] / jobs, (total->wall[phase] * 100.0) / wall);
+}
@@ -0,0 +1,88 @@
+/* The phase of it's work each thread is in.
+**
+** Each thread keeps a note of what it is doing: starting or ending the library, opening
+** a document, converting, drawing or extracting from it, or saving it. The note is kept
+** in thread local storage, so it costs nothing to set, and may be read from anywhere the
+** thread goes, including inside the memory managers, while APDFL is calling them.
+**
+** The framework sets the phase around the library start and end, OpenSampleFile and
+** SaveDocument. Each worker sets it around the APDFL calls which do it's real work.
+** Use ScopedPhase to set a phase for a block of code, and put back the phase before it.
+**
+** Where APDFL raises an error through a block, the phase may be left set. runWorker sets
+** the phase back to PhaseOther as each job ends, so it does not carry on into the next job.
+**
+** The phases are timed, too. While a job is running, each change of phase charges the wall
+** time (monotonic clock) and thread CPU time since the last change to the phase being left.
+** A job's times are started with StartJobPhaseTimes and collected with TakeJobPhaseTimes, as
+** the memory counts are, and the pump totals them for each type of job. So the log shows
+** whether, say, a PDF/A job's time goes to parsing, conversion or the final save.
+*/
+#ifndef WORKERPHASE_H
+#define WORKERPHASE_H
+
+#include <stdio.h>
+#include "MTHeader.h"
+
+/* The phases. Add new ones before NumberOfPhases, and give them a name in WorkerPhase.cpp */
+typedef enum workerPhases
+{
+    PhaseOther,                     /* Anything not in one of the phases below */
+    PhaseStart,                     /* Starting the library */
+    PhaseOpen,                      /* Opening the input document */
+    PhaseConvert,                   /* Converting the document (PDF/A, PDF/X, XPS, flattening) */
+    PhaseDraw,                      /* Drawing pages */
+    PhaseExtract,                   /* Extracting text or content */
+    PhaseSave,                      /* Saving the output document */
+    PhaseEnd,                       /* Ending the library */
+    PhaseSession,                   /* Starting or ending a plugin session */
+    PhaseClose,                     /* Closing the input document */
+    NumberOfPhases
+} WorkerPhases;
+
+/* Set the phase of the calling thread. Returns the phase it was in. */
+WorkerPhases SetWorkerPhase (WorkerPhases phase);
+
+/* Return the phase of the calling thread */
+WorkerPhases GetWorkerPhase ();
+
+/* Return the name of a phase (e.g. "open") */
+const char *WorkerPhaseName (WorkerPhases phase);
+
+/* Note the job the calling thread is running, so the probes fired in it (See Probes.h) may
+** name it. Job zero, and NULL names, when it is running none.
+*/
+void SetWorkerJob (int job, const char *worker, const char *input);
+
+/* The time spent in each phase, by a job or a total of jobs */
+typedef struct phaseTimes
+{
+    double          wall[NumberOfPhases];               /* Seconds, by the monotonic clock */
+    double          cpu[NumberOfPhases];                /* Seconds of the thread's CPU time */
+    ASUns32         entered[NumberOfPhases];            /* Times the phase was entered */
+} PhaseTimes;
+
+/* Start timing the phases of a new job in the calling thread */
+void StartJobPhaseTimes ();
+
+/* Copy the phase times of the job ending in the calling thread, and stop timing */
+void TakeJobPhaseTimes (PhaseTimes *times);
+
+/* Add the phase times of one job into a total */
+void AddPhaseTimes (PhaseTimes *total, PhaseTimes *job);
+
+/* Write lines giving the time each phase took, on average, in a number of jobs, to the log */
+void ReportPhaseTimes (FILE *logFile, const char *name, PhaseTimes *total, int jobs);
+
+/* Sets a phase for as long as it is in scope */
+class ScopedPhase
+{
+public:
+    ScopedPhase (WorkerPhases phase) { previous = SetWorkerPhase (phase); }
+    ~ScopedPhase () { SetWorkerPhase (previous); }
+
+private:
+    WorkerPhases previous;
+};
+
+#endif
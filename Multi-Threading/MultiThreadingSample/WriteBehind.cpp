@@ -0,0 +1,320 @@
+/* The write behind stage: a queue of saved documents, and the I/O threads which write them.
+**
+** The queue is a simple linked list, protected by a mutex. I/O threads take up to a
+** batch of documents at a time, and poll (as the pool threads do) when the queue
+** is empty. Each document is written to "<name>.partial", the whole batch is made
+** durable, each file is renamed to it's final name, and then the directories the
+** batch was written to are made durable, so that the renames are too.
+**
+** The latency of each document, from being queued to being durable under it's final
+** name, is measured, as is the time spent in fsync, and the time workers spent
+** waiting on the budget.
+*/
+
+#include <stdlib.h>
+#include <set>
+#include "WriteBehind.h"
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* One document waiting to be written */
+typedef struct flushJob
+{
+    char               *name;               /* Final path of the document */
+    char               *data;               /* Bytes of the document */
+    ASUns64             size;               /* Number of bytes */
+    double              queued;             /* Time it was queued */
+    FILE               *file;               /* Temporary file, while it is written */
+    bool                failed;             /* True if it could not be written */
+    struct flushJob    *next;               /* Next in the queue */
+} FlushJob;
+
+/* One I/O thread */
+typedef struct writeBehindThread
+{
+    SDKThreadID         threadID;
+    int                 threadNumber;
+    bool                threadCompleted;
+} WriteBehindThread;
+
+static struct writeBehindStage
+{
+    CSMutex             lock;
+    FlushJob           *first, *last;       /* The queue */
+    bool                closed;             /* No more documents will be queued */
+    ASUns64             budget;             /* Most bytes allowed to wait */
+    ASUns64             pending;            /* Bytes queued, and not yet written */
+    int                 batchSize;
+    int                 threadCount;
+    WriteBehindThread  *threads;
+
+    /* Usage counts, for the report at the end of the run */
+    int                 filesWritten, filesFailed, batches, waits;
+    ASUns64             bytesWritten, highWater;
+    double              latencyTotal, latencyMax, syncTime, waitTime;
+} writeBehind;
+
+
+/* Return the name of the temporary file for a document (The caller frees it) */
+static char *PartialName (char *name)
+{
+    char *partial = (char *)malloc (strlen (name) + 10);
+    strcpy (partial, name);
+    strcat (partial, ".partial");
+    return (partial);
+}
+
+/* Make a file durable. Returns false if it could not be. */
+static bool SyncFile (FILE *file)
+{
+#ifdef WIN_PLATFORM
+    return (_commit (_fileno (file)) == 0);
+#else
+    return (fsync (fileno (file)) == 0);
+#endif
+}
+
+/* Make the directory entries (and so the renames) in a directory durable.
+** Windows commits the rename itself, with MOVEFILE_WRITE_THROUGH.
+*/
+static void SyncDirectory (const std::string &directory)
+{
+#ifndef WIN_PLATFORM
+    int handle = open (directory.c_str (), O_RDONLY);
+    if (handle >= 0)
+    {
+        fsync (handle);
+        close (handle);
+    }
+#endif
+}
+
+/* Move the temporary file into place, replacing any earlier output */
+static bool RenameFile (char *from, char *to)
+{
+#ifdef WIN_PLATFORM
+    return (MoveFileExA (from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0);
+#else
+    return (rename (from, to) == 0);
+#endif
+}
+
+/* Write one batch of documents */
+static void WriteBatch (FlushJob *batch)
+{
+    /* Write each document to it's temporary file */
+    for (FlushJob *job = batch; job; job = job->next)
+    {
+        char *partial = PartialName (job->name);
+        job->file = fopen (partial, "wb");
+        job->failed = (job->file == NULL);
+        if (job->file && job->size)
+            job->failed = (fwrite (job->data, 1, (size_t)job->size, job->file) != job->size);
+        if (job->file && fflush (job->file) != 0)
+            job->failed = true;
+        free (partial);
+    }
+
+    /* Make the whole batch durable. A document is written only if it's data reached the disk,
+    ** and it's file closed cleanly (Which is where a full disk, or a network file system, may
+    ** first say so).
+    */
+    double syncStart = LatencyClock ();
+    for (FlushJob *job = batch; job; job = job->next)
+        if (job->file)
+        {
+            if (!job->failed && !SyncFile (job->file))
+                job->failed = true;
+            if (fclose (job->file) != 0)
+                job->failed = true;
+            job->file = NULL;
+        }
+
+    /* Rename each into place (Leaving any earlier output where a document failed), then make the directories durable */
+    std::set<std::string> directories;
+    for (FlushJob *job = batch; job; job = job->next)
+    {
+        char *partial = PartialName (job->name);
+        if (!job->failed)
+            job->failed = !RenameFile (partial, job->name);
+        if (job->failed)
+            remove (partial);
+        free (partial);
+
+        char *separator = strrchr (job->name, PathSep);
+        directories.insert (separator ? std::string (job->name, separator - job->name) : std::string ("."));
+    }
+    for (std::set<std::string>::iterator directory = directories.begin (); directory != directories.end (); directory++)
+        SyncDirectory (*directory);
+    double syncEnd = LatencyClock ();
+
+    /* Account for the batch, and release the budget it held */
+    EnterCS (writeBehind.lock);
+    writeBehind.batches++;
+    writeBehind.syncTime += syncEnd - syncStart;
+    while (batch)
+    {
+        FlushJob *job = batch;
+        batch = job->next;
+
+        double latency = syncEnd - job->queued;
+        writeBehind.latencyTotal += latency;
+        if (latency > writeBehind.latencyMax)
+            writeBehind.latencyMax = latency;
+        if (job->failed)
+        {
+            writeBehind.filesFailed++;
+            fprintf (stderr, "Write behind: %s could not be written.\n", job->name);
+        }
+        else
+        {
+            writeBehind.filesWritten++;
+            writeBehind.bytesWritten += job->size;
+        }
+        writeBehind.pending -= job->size;
+
+        free (job->data);
+        free (job->name);
+        free (job);
+    }
+    LeaveCS (writeBehind.lock);
+}
+
+/* The I/O thread. Take a batch from the queue and write it, until the queue is closed and empty */
+ThreadFuncReturnType writeBehindWorker (WriteBehindThread *thread)
+{
+    while (true)
+    {
+        EnterCS (writeBehind.lock);
+        FlushJob *batch = writeBehind.first, *last = NULL;
+        int count = 0;
+        for (FlushJob *job = batch; job && count < writeBehind.batchSize; job = job->next)
+        {
+            last = job;
+            count++;
+        }
+        if (last)
+        {
+            writeBehind.first = last->next;
+            if (!writeBehind.first)
+                writeBehind.last = NULL;
+            last->next = NULL;
+        }
+        bool closed = writeBehind.closed;
+        LeaveCS (writeBehind.lock);
+
+        if (count)
+            WriteBatch (batch);
+        else if (closed)
+            break;
+        else
+            ThreadSleep (1);
+    }
+
+    thread->threadCompleted = true;
+    return (0);
+}
+
+
+void StartWriteBehind (attributes *FrameAttributes)
+{
+    memset (&writeBehind, 0, sizeof (writeBehind));
+    InitCS (writeBehind.lock);
+
+    writeBehind.threadCount = FrameAttributes->GetKeyValueInt ("WriteBehindThreads");
+    if (writeBehind.threadCount < 1)
+        writeBehind.threadCount = 2;
+    int budget = FrameAttributes->GetKeyValueInt ("WriteBehindBudget");
+    writeBehind.budget = (ASUns64)(budget < 1 ? 256 : budget) * 1024 * 1024;
+    writeBehind.batchSize = FrameAttributes->GetKeyValueInt ("WriteBehindBatch");
+    if (writeBehind.batchSize < 1)
+        writeBehind.batchSize = 8;
+
+    writeBehind.threads = (WriteBehindThread *)calloc (writeBehind.threadCount, sizeof (WriteBehindThread));
+    for (int index = 0; index < writeBehind.threadCount; index++)
+    {
+        writeBehind.threads[index].threadNumber = index;
+        createThread (writeBehindWorker, writeBehind.threads[index]);
+    }
+}
+
+void QueueWriteBehind (char *name, char *data, ASUns64 size)
+{
+    FlushJob *job = (FlushJob *)malloc (sizeof (FlushJob));
+    job->name = (char *)malloc (strlen (name) + 1);
+    strcpy (job->name, name);
+    job->data = data;
+    job->size = size;
+    job->file = NULL;
+    job->failed = false;
+    job->next = NULL;
+
+    /* Wait while the budget is used up. A document larger than the whole
+    ** budget is allowed through once nothing else is waiting.
+    */
+    double start = LatencyClock ();
+    bool waited = false;
+    EnterCS (writeBehind.lock);
+    while (writeBehind.pending > 0 && (writeBehind.pending + size) > writeBehind.budget)
+    {
+        LeaveCS (writeBehind.lock);
+        ThreadSleep (1);
+        waited = true;
+        EnterCS (writeBehind.lock);
+    }
+
+    job->queued = LatencyClock ();
+    if (waited)
+    {
+        writeBehind.waits++;
+        writeBehind.waitTime += job->queued - start;
+    }
+    writeBehind.pending += size;
+    if (writeBehind.pending > writeBehind.highWater)
+        writeBehind.highWater = writeBehind.pending;
+    if (writeBehind.last)
+        writeBehind.last->next = job;
+    else
+        writeBehind.first = job;
+    writeBehind.last = job;
+    LeaveCS (writeBehind.lock);
+}
+
+int DrainWriteBehind ()
+{
+    EnterCS (writeBehind.lock);
+    writeBehind.closed = true;
+    LeaveCS (writeBehind.lock);
+
+    for (int index = 0; index < writeBehind.threadCount; index++)
+    {
+        while (!writeBehind.threads[index].threadCompleted)
+            ThreadSleep (1);
+        destroyThread ((&writeBehind.threads[index]));
+    }
+
+    free (writeBehind.threads);
+    writeBehind.threads = NULL;
+    writeBehind.threadCount = 0;
+    DestroyCS (writeBehind.lock);
+    return (writeBehind.filesFailed);
+}
+
+void ReportWriteBehind (FILE *logFile)
+{
+    int files = writeBehind.filesWritten + writeBehind.filesFailed;
+    fprintf (logFile, "Write behind: %01d documents (%0.5g MB) written in %01d batches, %01d failed. At most %0.5g MB waited to be written.\n",
+        writeBehind.filesWritten, writeBehind.bytesWritten / (1024.0 * 1024.0), writeBehind.batches, writeBehind.filesFailed,
+        writeBehind.highWater / (1024.0 * 1024.0));
+    if (files)
+        fprintf (logFile, "Write behind: flush latency %0.5g seconds average, %0.5g seconds maximum. %0.5g seconds were spent making batches durable.\n",
+            writeBehind.latencyTotal / files, writeBehind.latencyMax, writeBehind.syncTime);
+    fprintf (logFile, "Write behind: workers waited on the budget %01d times, for %0.5g seconds in all.\n",
+        writeBehind.waits, writeBehind.waitTime);
+}
@@ -0,0 +1,42 @@
+/* The write behind stage, used by the output file system when "OutputSink=writebehind" is given.
+**
+** Worker threads save documents into memory (See OutputFileSys.h). When the job which
+** saved a document ends successfully, it's bytes are handed to this stage, and the worker
+** goes on with it's next job. A small pool of I/O threads writes each document to a temporary file
+** beside it's final path, makes a batch of such files durable with fsync, and then
+** renames each into place, so that a reader never sees a partial output.
+**
+** The bytes waiting to be written are limited by a budget. A worker which would
+** exceed the budget waits for the I/O threads to catch up (backpressure), so that
+** memory use stays bounded when storage is slower than conversion.
+**
+** The attributes which control the stage are:
+**   "WriteBehindThreads="   The number of I/O threads. Default is 2.
+**   "WriteBehindBudget="    The most megabytes waiting to be written. Default is 256.
+**   "WriteBehindBatch="     The most documents made durable by one batch. Default is 8.
+*/
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include "MTHeader.h"
+#include "ASExpT.h"
+
+/* Start the I/O threads. Call this once, from the main line, before any worker threads are started. */
+void StartWriteBehind (attributes *FrameAttributes);
+
+/* Hand a saved document to the I/O threads. The name is copied, and the data
+** (which must have been allocated with malloc) now belongs to the write behind stage.
+** This waits while the budget is used up.
+*/
+void QueueWriteBehind (char *name, char *data, ASUns64 size);
+
+/* Wait until every document queued has been written, then stop the I/O threads.
+** Call this from the main line, after all worker threads are complete.
+** Returns the number of documents which could not be written.
+*/
+int DrainWriteBehind ();
+
+/* Write lines describing the work of the write behind stage to the log */
+void ReportWriteBehind (FILE *logFile);
+
+#endif
@@ -36,6 +36,55 @@ void XPS2PDFWorker::ParseOptions (attributes *FrameAttributes, WorkerType *worke
 };
 
 
+/* Start an XPS2PDF plugin session, and build the conversion settings 
+** (job options) used by every job in the session.
+*/
+bool XPS2PDFWorker::StartSession (void **sessionData)
+{
+    *sessionData = NULL;
+#ifdef MAC_ENV
+    return (false);
+#else
+    /* Set up the HFT for XPS2PDF */
+    gXPS2PDFHFT = InitXPS2PDFHFT;
+
+    /* Load and initialize the XPS2PDF plugin */
+    if (!XPS2PDFInitialize ())
+    {
+        XPS2PDFTerminate ();
+        return (false);
+    }
+
+    /* Set up the job options. */
+    ASCab settings = ASCabNew ();
+
+    //The .joboptions file specifies a great number of settings which determine exactly how the PDF document
+    //is created by the converter.
+    ASText jobNameText = ASTextFromUnicode ((ASUTF16Val*)"../../Resources/joboptions/Standard.joboptions", kUTF8);
+    ASCabPutText (settings, "PDFSettings", jobNameText);
+
+    //Specify which description in the .joboptions file we will use.
+    //There are many others, for different langauges. See the file.
+    ASText language = ASTextFromUnicode ((ASUTF16Val*)"ENU", kUTF8);
+    ASCabPutText (settings, "PDFSettingsLang", language);
+
+    *sessionData = settings;
+    return (true);
+#endif
+}
+
+/* End an XPS2PDF plugin session, releasing the job options */
+void XPS2PDFWorker::EndSession (void *sessionData)
+{
+#ifndef MAC_ENV
+    if (sessionData)
+        ASCabDestroy ((ASCab)sessionData);
+
+    /* Terminate the plugin */
+    XPS2PDFTerminate ();
+#endif
+}
+
 void XPS2PDFWorker::WorkerThread (ThreadInfo *info)
 {
 #ifdef MAC_ENV
@@ -49,26 +98,13 @@ void XPS2PDFWorker::WorkerThread (ThreadInfo *info)
 
     DURING
 
-        /* Set up the HFT for XPS2PDF */
-        gXPS2PDFHFT = InitXPS2PDFHFT;
-
-        /* Load and initialize the XPS2PDF plugin */
-        if (!XPS2PDFInitialize ())
+        /* Start (or reuse) the XPS2PDF plugin session */
+        if (!OpenSession (info))
             info->result = 1;
         else
         {
-            /* Set up the job options. */
-            ASCab settings = ASCabNew ();
-
-            //The .joboptions file specifies a great number of settings which determine exactly how the PDF document
-            //is created by the converter.
-            ASText jobNameText = ASTextFromUnicode ((ASUTF16Val*)"../../Resources/joboptions/Standard.joboptions", kUTF8);
-            ASCabPutText (settings, "PDFSettings", jobNameText);
-
-            //Specify which description in the .joboptions file we will use.
-            //There are many others, for different langauges. See the file.
-            ASText language = ASTextFromUnicode ((ASUTF16Val*)"ENU", kUTF8);
-            ASCabPutText (settings, "PDFSettingsLang", language);
+            /* The job options were built with the session */
+            ASCab settings = (ASCab)SessionData (info);
 
             /* Generate input and output file names */
             char *fullFileName = GetInFileName (sequence);
@@ -87,7 +123,9 @@ void XPS2PDFWorker::WorkerThread (ThreadInfo *info)
 
             /* Convert the document */
             PDDoc outputDoc = NULL;
+            SetWorkerPhase (PhaseConvert);
             int ret_val = XPS2PDFConvert (settings, 0, asInPathName, NULL, &outputDoc, NULL);
+            SetWorkerPhase (PhaseOther);
 
             //If we succeeded, XPS2PDFConvert returns 1.
             if (ret_val != 1)
@@ -98,23 +136,22 @@ void XPS2PDFWorker::WorkerThread (ThreadInfo *info)
                 SaveDocument (outputDoc, fullOutputFileName);
             }
 
-            /* Close the output document */
-            PDDocClose (outputDoc);
+            /* Close the output document (The only document of the job, so the memory it leaves live is noted) */
+            CloseSampleFile (outputDoc);
 
             /* release the output file name */
             free (fullOutputFileName);
 
             /* Release other resources created */
-            ASCabDestroy (settings);
             ASFileSysReleasePath (NULL, asInPathName);
 
+            /* End the plugin session (A pool thread will keep it for the next job) */
+            CloseSession (info);
         }
 
-        /* Terminate the plugin */
-        XPS2PDFTerminate ();
-
     HANDLER
         info->result = 3;
+        CloseSession (info);
     END_HANDLER
 #endif
 
@@ -28,4 +28,8 @@ public:
 
     void WorkerThread (ThreadInfo *info);
 
+    /* Start and end the plugin session (See workerclass::OpenSession) */
+    bool StartSession (void **sessionData);
+    void EndSession (void *sessionData);
+
 };
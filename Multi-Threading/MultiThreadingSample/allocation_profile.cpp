@@ -0,0 +1,296 @@
+/* A sampling profiler of the places APDFL allocates memory from.
+**
+** Each thread counts down to it's next sample, so allocations which are not sampled cost
+** one decrement. A sample captures the return addresses on the stack, and adds it's weight
+** to a table keyed by the phase and the addresses, under a mutex. The table is built with
+** the C++ library's allocator, never with the one being profiled.
+**
+** Addresses are only turned into names when the stacks are written, once for each
+** distinct address.
+**
+** The frames at the top of each stack are the profiler's own, and those of the memory
+** managers wrapping the one APDFL was started with (The recording and budget wrappers, as
+** well as the counting one). How many there are depends on the wrappers installed, and on
+** what the compiler inlined, so they are found at run time: every frame up to the first
+** outside the module holding the profiler is dropped, which leaves the stack from the
+** library's call into the allocator. Where the library is linked into the same module as
+** the sample, no such frame is found, and a fixed count of frames is dropped instead.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include "allocation_profile.h"
+#include "WorkerPhase.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#endif
+
+/* The most frames, inside the profiler and the memory manager wrappers, dropped from a stack */
+#define ProfileWrapperFrames    16
+
+/* The frames dropped when the library is in the same module as the profiler (CaptureFrames,
+** TakeSample, SampleAllocation, and instrumented_allocate or instrumented_reallocate, in an
+** unoptimized build with no other wrapper installed)
+*/
+#define ProfileSkipFrames       4
+
+/* A distinct stack, in a distinct phase */
+typedef struct profileKey
+{
+    int                 phase;
+    int                 depth;
+    void               *frames[AllocationProfileFrames];
+
+    bool operator< (const struct profileKey &other) const
+    {
+        if (phase != other.phase)
+            return (phase < other.phase);
+        if (depth != other.depth)
+            return (depth < other.depth);
+        return (memcmp (frames, other.frames, depth * sizeof (void *)) < 0);
+    }
+} ProfileKey;
+
+/* The weight of the samples taken at one stack */
+typedef struct profileWeight
+{
+    ASUns64             samples;
+    ASUns64             bytes;
+} ProfileWeight;
+
+typedef std::map<ProfileKey, ProfileWeight> ProfileTable;
+
+static int                  sampleInterval = 0;         /* Zero when not sampling */
+static std::string          profilePrefix;
+static FILE                *bytesFile = NULL;
+static FILE                *countFile = NULL;
+static CSMutex              profileLock;
+static ProfileTable        *profileTable = NULL;
+static void                *profileModule = NULL;       /* The module holding the profiler */
+static ASUns64              profileSamples = 0;
+static ASUns64              profileTruncated = 0;       /* Samples with more frames than were kept */
+
+/* Allocations this thread will make before it's next sample */
+static ThreadLocal int      threadCountdown = 0;
+
+
+/* Capture the calling thread's return addresses. Returns the number captured. */
+static int CaptureFrames (void **frames, int most)
+{
+#ifdef WIN_PLATFORM
+    return ((int)CaptureStackBackTrace (0, most, frames, NULL));
+#else
+    return (backtrace (frames, most));
+#endif
+}
+
+/* Return the module holding the code at an address, NULL if it cannot be found */
+static void *FrameModule (void *address)
+{
+#ifdef WIN_PLATFORM
+    HMODULE module = NULL;
+    GetModuleHandleExA (GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        (LPCSTR)address, &module);
+    return ((void *)module);
+#else
+    Dl_info info;
+    memset (&info, 0, sizeof (info));
+    if (!dladdr (address, &info))
+        return (NULL);
+    return (info.dli_fbase);
+#endif
+}
+
+/* Return a name for the code at an address. Names may not hold ';', which separates frames. */
+static std::string FrameName (void *address)
+{
+    char buffer[1024];
+    std::string name;
+
+#ifdef WIN_PLATFORM
+    HMODULE module = NULL;
+    if (GetModuleHandleExA (GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            (LPCSTR)address, &module) && GetModuleFileNameA (module, buffer, sizeof (buffer)))
+    {
+        char *base = strrchr (buffer, '\\');
+        name = base ? base + 1 : buffer;
+        sprintf (buffer, "+0x%llx", (unsigned long long)((char *)address - (char *)module));
+        name += buffer;
+    }
+#else
+    Dl_info info;
+    memset (&info, 0, sizeof (info));
+    if (dladdr (address, &info) && info.dli_sname)
+    {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle (info.dli_sname, NULL, NULL, &status);
+        name = (demangled && status == 0) ? demangled : info.dli_sname;
+        free (demangled);
+    }
+    else if (info.dli_fname)
+    {
+        const char *base = strrchr (info.dli_fname, '/');
+        name = base ? base + 1 : info.dli_fname;
+        sprintf (buffer, "+0x%llx", (unsigned long long)((char *)address - (char *)info.dli_fbase));
+        name += buffer;
+    }
+#endif
+
+    if (name.empty ())
+    {
+        sprintf (buffer, "0x%llx", (unsigned long long)address);
+        name = buffer;
+    }
+    for (size_t index = 0; index < name.size (); index++)
+        if (name[index] == ';')
+            name[index] = ':';
+    return (name);
+}
+
+/* Take one sample, of an allocation of size bytes */
+static void TakeSample (size_t size)
+{
+    void *frames[AllocationProfileFrames + ProfileWrapperFrames];
+    int captured = CaptureFrames (frames, AllocationProfileFrames + ProfileWrapperFrames);
+
+    /* Drop the frames of the profiler and the wrappers, up to the library's call */
+    int skip = 0;
+    while ((skip < captured) && (skip < ProfileWrapperFrames) && (FrameModule (frames[skip]) == profileModule))
+        skip++;
+    if ((skip == captured) || (skip == ProfileWrapperFrames))
+        skip = captured > ProfileSkipFrames ? ProfileSkipFrames : captured;
+
+    ProfileKey key;
+    memset (&key, 0, sizeof (key));
+    key.phase = GetWorkerPhase ();
+    key.depth = captured - skip;
+    if (key.depth > AllocationProfileFrames)
+        key.depth = AllocationProfileFrames;
+    memcpy (key.frames, &frames[skip], key.depth * sizeof (void *));
+
+    EnterCS (profileLock);
+    ProfileWeight &weight = (*profileTable)[key];
+    weight.samples += sampleInterval;
+    weight.bytes += (ASUns64)size * sampleInterval;
+    profileSamples++;
+    if ((captured == AllocationProfileFrames + ProfileWrapperFrames) || (captured - skip > AllocationProfileFrames))
+        profileTruncated++;
+    LeaveCS (profileLock);
+}
+
+
+bool InitializeAllocationProfile (attributes *FrameAttributes)
+{
+    sampleInterval = FrameAttributes->GetKeyValueInt ("AllocationSampling");
+    if (sampleInterval < 1)
+    {
+        sampleInterval = 0;
+        return (true);
+    }
+
+    profilePrefix = FrameAttributes->IsKeyPresent ("AllocationProfile") ?
+        FrameAttributes->GetKeyValue ("AllocationProfile")->value (0) : "AllocationProfile";
+    bytesFile = fopen ((profilePrefix + ".bytes.folded").c_str (), "w");
+    countFile = fopen ((profilePrefix + ".count.folded").c_str (), "w");
+    if (!bytesFile || !countFile)
+    {
+        sampleInterval = 0;
+        return (false);
+    }
+
+    InitCS (profileLock);
+    profileTable = new ProfileTable;
+    profileModule = FrameModule ((void *)&TakeSample);
+
+    /* The first backtrace may load the unwinder, so take it here, rather than in a worker */
+    void *frames[AllocationProfileFrames];
+    CaptureFrames (frames, AllocationProfileFrames);
+    return (true);
+}
+
+const char *AllocationProfilePrefix ()
+{
+    return (profilePrefix.c_str ());
+}
+
+bool ProfilingAllocations ()
+{
+    return (sampleInterval != 0);
+}
+
+void SampleAllocation (size_t size)
+{
+    if (!sampleInterval)
+        return;
+
+    /* A new thread starts at a random point, so threads do not all sample the same calls */
+    if (threadCountdown <= 0)
+        threadCountdown = (rand () % sampleInterval) + 1;
+    if (--threadCountdown == 0)
+    {
+        threadCountdown = sampleInterval;
+        TakeSample (size);
+    }
+}
+
+void ReportAllocationProfile (FILE *logFile)
+{
+    if (!sampleInterval)
+        return;
+
+    ASUns64 phaseSamples[NumberOfPhases], phaseBytes[NumberOfPhases];
+    memset (phaseSamples, 0, sizeof (phaseSamples));
+    memset (phaseBytes, 0, sizeof (phaseBytes));
+
+    std::map<void *, std::string> names;
+    for (ProfileTable::iterator entry = profileTable->begin (); entry != profileTable->end (); entry++)
+    {
+        const ProfileKey &key = entry->first;
+
+        /* Folded stacks are written outermost frame first */
+        std::string stack = WorkerPhaseName ((WorkerPhases)key.phase);
+        for (int index = key.depth - 1; index >= 0; index--)
+        {
+            std::map<void *, std::string>::iterator name = names.find (key.frames[index]);
+            if (name == names.end ())
+                name = names.insert (std::make_pair (key.frames[index], FrameName (key.frames[index]))).first;
+            stack += ";";
+            stack += name->second;
+        }
+        fprintf (bytesFile, "%s %llu\n", stack.c_str (), (unsigned long long)entry->second.bytes);
+        fprintf (countFile, "%s %llu\n", stack.c_str (), (unsigned long long)entry->second.samples);
+
+        phaseSamples[key.phase] += entry->second.samples;
+        phaseBytes[key.phase] += entry->second.bytes;
+    }
+    fclose (bytesFile);
+    fclose (countFile);
+    bytesFile = countFile = NULL;
+
+    fprintf (logFile, "Allocation profile: %01llu samples (1 in %01d allocations), at %01d distinct stacks, written to %s.bytes.folded and %s.count.folded.\n",
+        (unsigned long long)profileSamples, sampleInterval, (int)profileTable->size (), profilePrefix.c_str (), profilePrefix.c_str ());
+    if (profileTruncated)
+        fprintf (logFile, "Allocation profile: %01llu samples were deeper than %01d frames, and lost their outermost frames.\n",
+            (unsigned long long)profileTruncated, AllocationProfileFrames);
+    for (int phase = 0; phase < NumberOfPhases; phase++)
+        if (phaseSamples[phase])
+            fprintf (logFile, "Allocation profile: %-8s about %01llu allocations, %0.5g MB.\n", WorkerPhaseName ((WorkerPhases)phase),
+                (unsigned long long)phaseSamples[phase], phaseBytes[phase] / (1024.0 * 1024.0));
+}
+
+void FinalizeAllocationProfile ()
+{
+    if (!profileTable)
+        return;
+    delete profileTable;
+    profileTable = NULL;
+    DestroyCS (profileLock);
+    sampleInterval = 0;
+}
@@ -0,0 +1,55 @@
+/* A sampling profiler of the places APDFL allocates memory from.
+**
+** When "AllocationSampling=" gives a number N, one in every N allocations (and reallocations)
+** made by APDFL captures a backtrace of the calling thread. Each sample is attributed to the
+** phase the thread is in (open, convert, draw, extract, save and so on, see WorkerPhase.h),
+** and is weighted by N, and by N times the bytes asked for, so the totals estimate all of the
+** allocations made, not just those sampled.
+**
+** Sampling is done by the counting memory manager (See instrumented_memory.h), which is
+** installed whenever sampling is on, whether or not "InstrumentMemory=true" is given.
+**
+** At the end of the run, the samples are written as folded stacks, one line for each distinct
+** phase and stack, with the phase as the outermost frame:
+**     <Prefix>.bytes.folded       weighted by bytes allocated
+**     <Prefix>.count.folded       weighted by the number of allocations
+** where the prefix is given by "AllocationProfile=" (Default is "AllocationProfile"). These may
+** be drawn as flame graphs (e.g. with flamegraph.pl), or simply sorted.
+**
+** On Unix, frames are named from the dynamic symbol tables, so the sample itself should be
+** linked with -rdynamic. Frames which cannot be named are given as module+offset.
+*/
+#ifndef ALLOCATION_PROFILE_h
+#define ALLOCATION_PROFILE_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+#define AllocationProfileFrames     32          /* Most frames kept for a sample */
+
+/* Read "AllocationSampling=" and "AllocationProfile=", and create the output files.
+** Call this once, from the main line, before any library is started.
+** Returns false if the files cannot be created.
+*/
+bool InitializeAllocationProfile (attributes *FrameAttributes);
+
+/* The prefix of the output files, as given by "AllocationProfile=", or the default */
+const char *AllocationProfilePrefix ();
+
+/* True if allocations are being sampled */
+bool ProfilingAllocations ();
+
+/* Count an allocation of size bytes, and take a sample if it is this thread's turn.
+** Called by the counting memory manager.
+*/
+void SampleAllocation (size_t size);
+
+/* Write the folded stacks, and lines describing the samples taken to the log.
+** Call this after all threads are complete.
+*/
+void ReportAllocationProfile (FILE *logFile);
+
+/* Release the samples, after the report */
+void FinalizeAllocationProfile ();
+
+#endif
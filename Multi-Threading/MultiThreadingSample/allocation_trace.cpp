@@ -0,0 +1,181 @@
+/* This is an APDFL memory manager which records every call made to any other memory manager.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. Here, each method adds a record
+** to the calling thread's buffer, and calls the wrapped allocator (or malloc, when
+** APDFL was to use it's own). The client data is the wrapped allocator.
+**
+** Each block is preceded by a 16 byte header, holding it's serial number.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "allocation_trace.h"
+#include "wrapped_allocator.h"
+#include "latency_histogram.h"
+
+#define TraceHeaderSize     16
+#define TraceBufferRecords  4096
+
+/* The records made by one thread, not yet written */
+typedef struct traceBuffer
+{
+    ASUns32             thread;
+    int                 count;
+    AllocationRecord    records[TraceBufferRecords];
+} TraceBuffer;
+
+static FILE                *traceFile = NULL;
+static CSMutex              traceLock;
+static volatile ASInt64     traceBlocks = 0;            /* Last block serial number given */
+static volatile ASInt64     traceThreads = 0;           /* Last thread serial number given */
+static ASUns64              traceRecords = 0;           /* Records written */
+static double               traceStart = 0;
+
+static ThreadLocal TraceBuffer *threadTrace = NULL;
+
+
+/* Write a thread's buffered records */
+static void WriteTraceBuffer (TraceBuffer *buffer)
+{
+    if (!buffer->count)
+        return;
+    EnterCS (traceLock);
+    fwrite (buffer->records, sizeof (AllocationRecord), buffer->count, traceFile);
+    traceRecords += buffer->count;
+    LeaveCS (traceLock);
+    buffer->count = 0;
+}
+
+/* Add a record to this thread's buffer */
+static void TraceRecord (TraceOperations operation, size_t size, ASUns64 block)
+{
+    if (!threadTrace)
+    {
+        threadTrace = (TraceBuffer *)malloc (sizeof (TraceBuffer));
+        threadTrace->thread = (ASUns32)AtomicAdd64 (&traceThreads, 1);
+        threadTrace->count = 0;
+    }
+    if (threadTrace->count == TraceBufferRecords)
+        WriteTraceBuffer (threadTrace);
+
+    AllocationRecord *record = &threadTrace->records[threadTrace->count++];
+    record->operation = (ASUns8)operation;
+    memset (record->reserved, 0, sizeof (record->reserved));
+    record->thread = threadTrace->thread;
+    record->size = (ASUns64)size;
+    record->block = block;
+    record->time = (ASUns64)((LatencyClock () - traceStart) * 1000000000.0);
+}
+
+void *trace_allocate (void *clientData, size_t size)
+{
+    char *header = (char *)WrappedAllocate ((TKAllocatorProcs *)clientData, size + TraceHeaderSize);
+    if (!header)
+        return (NULL);
+    ASUns64 block = (ASUns64)AtomicAdd64 (&traceBlocks, 1);
+    *((ASUns64 *)header) = block;
+    TraceRecord (TraceAllocate, size, block);
+    return (header + TraceHeaderSize);
+}
+
+void *trace_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (trace_allocate (clientData, size));
+
+    char *header = ((char *)pointer) - TraceHeaderSize;
+    ASUns64 block = *((ASUns64 *)header);
+    header = (char *)WrappedReallocate ((TKAllocatorProcs *)clientData, header, size + TraceHeaderSize);
+    if (!header)
+        return (NULL);
+    TraceRecord (TraceReallocate, size, block);
+    return (header + TraceHeaderSize);
+}
+
+void trace_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    char *header = ((char *)ptr) - TraceHeaderSize;
+    TraceRecord (TraceFree, 0, *((ASUns64 *)header));
+    WrappedFree ((TKAllocatorProcs *)clientData, header);
+    return;
+}
+
+size_t trace_remaining (void *clientData)
+{
+    TKAllocatorProcs *wrapped = (TKAllocatorProcs *)clientData;
+    if (wrapped && wrapped->memAvailProc)
+        return (wrapped->memAvailProc (wrapped->clientData));
+    return (1024 * 1024 * 1024 * 1);
+}
+
+
+bool InitializeAllocationTrace (attributes *FrameAttributes)
+{
+    if (!FrameAttributes->IsKeyPresent ("AllocationTrace"))
+        return (true);
+
+    traceFile = fopen (FrameAttributes->GetKeyValue ("AllocationTrace")->value (0), "wb");
+    if (!traceFile)
+        return (false);
+
+    AllocationTraceHeader header;
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, AllocationTraceMagic, 4);
+    header.version = AllocationTraceVersion;
+    header.recordSize = sizeof (AllocationRecord);
+    fwrite (&header, sizeof (header), 1, traceFile);
+
+    InitCS (traceLock);
+    traceStart = LatencyClock ();
+    return (true);
+}
+
+bool RecordingAllocations ()
+{
+    return (traceFile != NULL);
+}
+
+TKAllocatorProcs *RecordingAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper)
+{
+    if (!traceFile)
+        return (allocator);
+
+    wrapper->allocProc = trace_allocate;
+    wrapper->reallocProc = trace_reallocate;
+    wrapper->freeProc = trace_free;
+    wrapper->memAvailProc = trace_remaining;
+    wrapper->clientData = allocator;
+    return (wrapper);
+}
+
+void FlushAllocationTrace ()
+{
+    if (!threadTrace)
+        return;
+    WriteTraceBuffer (threadTrace);
+    free (threadTrace);
+    threadTrace = NULL;
+}
+
+void FinalizeAllocationTrace ()
+{
+    if (!traceFile)
+        return;
+    FlushAllocationTrace ();
+    fclose (traceFile);
+    traceFile = NULL;
+    DestroyCS (traceLock);
+}
+
+void ReportAllocationTrace (FILE *logFile)
+{
+    if (!traceFile)
+        return;
+    fprintf (logFile, "Allocation trace: %01llu calls to the allocator were recorded, from %01lld threads, for %01lld blocks.\n",
+        (unsigned long long)traceRecords, (long long)traceThreads, (long long)traceBlocks);
+}
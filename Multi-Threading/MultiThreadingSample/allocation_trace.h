@@ -0,0 +1,74 @@
+/* This is an APDFL memory manager which records every call made to any other memory manager.
+**
+** When "AllocationTrace=" gives a file name, the allocator APDFL is started with is wrapped
+** by this one. Each allocation, reallocation and free is written to the file, as a fixed
+** size binary record, giving the operation, the thread, the size, an identifier for the block
+** and the time. Blocks are identified by a serial number, kept in a small header before each
+** block, so the trace does not depend on the addresses given by the allocator.
+**
+** Records are kept in a buffer for each thread, and written to the file when the buffer is
+** full, and as the thread ends, so recording needs a lock only to write a full buffer.
+**
+** AllocatorBench replays a trace ("Replay="), against any of the memory managers, without
+** APDFL. Each thread in the trace is replayed by a thread of it's own.
+*/
+#ifndef ALLOCATION_TRACE_h
+#define ALLOCATION_TRACE_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+#define AllocationTraceMagic    "MTAT"
+#define AllocationTraceVersion  2
+
+/* The operations recorded */
+typedef enum traceOperations
+{
+    TraceAllocate,
+    TraceReallocate,
+    TraceFree
+} TraceOperations;
+
+/* The start of a trace file */
+typedef struct allocationTraceHeader
+{
+    char                magic[4];                       /* AllocationTraceMagic */
+    ASUns32             version;                        /* AllocationTraceVersion */
+    ASUns32             recordSize;                     /* sizeof (AllocationRecord) */
+    ASUns32             reserved;
+} AllocationTraceHeader;
+
+/* One call to the allocator */
+typedef struct allocationRecord
+{
+    ASUns8              operation;                      /* A TraceOperations value */
+    ASUns8              reserved[3];
+    ASUns32             thread;                         /* Serial number of the thread, from 1 */
+    ASUns64             size;                           /* Bytes asked for (zero for a free) */
+    ASUns64             block;                          /* Serial number of the block, from 1 */
+    ASUns64             time;                           /* Nanoseconds since recording started */
+} AllocationRecord;
+
+/* Open the trace file, if "AllocationTrace=" is given. Call this once, from the main line,
+** before any library is started. Returns false if the file cannot be created.
+*/
+bool InitializeAllocationTrace (attributes *FrameAttributes);
+
+/* True if allocations are being recorded */
+bool RecordingAllocations ();
+
+/* Return the allocator a library should be started with: the recording wrapper, built in the
+** block given (which must last as long as the library), when recording, otherwise the allocator given.
+*/
+TKAllocatorProcs *RecordingAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper);
+
+/* Write the records buffered by this thread. Call this as each thread ends. */
+void FlushAllocationTrace ();
+
+/* Write the main line's records, and close the trace, after all libraries are terminated */
+void FinalizeAllocationTrace ();
+
+/* Write a line describing the trace to the log */
+void ReportAllocationTrace (FILE *logFile);
+
+#endif
@@ -0,0 +1,322 @@
+/* This is an APDFL memory manager which gives each library instance an arena of it's own.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. Here, the client data is the arena,
+** and the TKAllocatorProcs block is the first member of the arena.
+**
+** Each block is preceded by a 16 byte header, holding the size the block was rounded to,
+** and the arena it came from. Sizes up to 1K are rounded to 16 bytes, and sizes up to
+** 256K to a power of two. Each rounded size has a free list. Larger blocks are allocated
+** with malloc, and kept on a list of their own, so they may be released with the arena.
+** An arena created on a NUMA node maps it's chunks and large blocks on that node instead.
+**
+** I can update the arena without a mutex, because it is used only by the thread that created it!
+** Only the totals reported at the end of the run need a mutex.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena_memory.h"
+#include "numa_memory.h"
+#include "MTHeader.h"
+#include "Probes.h"
+
+#define ArenaChunkSize      (1024 * 1024)       /* Bytes in each chunk */
+#define ArenaHeaderSize     16                  /* Bytes before each block */
+#define ArenaLargestSmall   (256 * 1024)        /* Largest block carved from a chunk */
+#define ArenaSmallClasses   64                  /* 16 byte classes, up to 1K */
+#define ArenaClasses        (ArenaSmallClasses + 8)   /* With power of two classes, 2K to 256K */
+
+/* The header before each block */
+typedef struct arenaHeader
+{
+    size_t              size;                   /* Size the block was rounded to */
+    struct memoryArena *arena;                  /* Arena it was allocated from */
+} ArenaHeader;
+
+/* Large blocks have links before their header */
+typedef struct arenaLarge
+{
+    struct arenaLarge  *previous, *next;
+    ArenaHeader         header;
+} ArenaLarge;
+
+/* Each chunk starts with a link to the chunk before */
+typedef struct arenaChunk
+{
+    struct arenaChunk  *next;
+    size_t              size;
+} ArenaChunk;
+
+typedef struct memoryArena
+{
+    TKAllocatorProcs    procs;                  /* Must be first. The interface given to APDFL */
+    void               *owner;                  /* Identifies the thread that created the arena */
+    int                 node;                   /* NUMA node the arena's memory is mapped on, or -1 to use malloc */
+    ArenaChunk         *chunks;                 /* Chunks allocated, most recent first */
+    char               *next, *end;             /* Space left in the most recent chunk */
+    void               *freeLists[ArenaClasses];
+    ArenaLarge         *large;                  /* Large blocks, in use */
+
+    ASUns64             allocations, frees, recycled;
+    ASUns64             chunkCount, largeCount;
+    ASUns64             reserved, highReserved; /* Bytes held in chunks and large blocks */
+} MemoryArena;
+
+/* The address of this differs in each thread, so identifies the thread */
+static ThreadLocal int arenaThreadMarker;
+
+/* Totals over every arena released */
+static CSMutex              arena_stats_lock;
+static int                  arenasReleased = 0;
+static ASUns64              arenaAllocations = 0, arenaRecycled = 0, arenaBulkFreed = 0, arenaChunks = 0, arenaLarge = 0;
+static ASUns64              arenaHighReserved = 0;
+
+
+/* Return the size class for a small size, and round the size to it */
+static int ArenaClass (size_t *size)
+{
+    if (*size <= 1024)
+    {
+        size_t rounded = (*size + 15) & ~((size_t)15);
+        if (rounded == 0)
+            rounded = 16;
+        *size = rounded;
+        return ((int)(rounded / 16) - 1);
+    }
+
+    int sizeClass = ArenaSmallClasses;
+    size_t rounded = 2048;
+    while (rounded < *size)
+    {
+        rounded <<= 1;
+        sizeClass++;
+    }
+    *size = rounded;
+    return (sizeClass);
+}
+
+static void ArenaReserved (MemoryArena *arena, ASInt64 bytes)
+{
+    arena->reserved += bytes;
+    if (arena->reserved > arena->highReserved)
+        arena->highReserved = arena->reserved;
+}
+
+/* Take memory for a chunk or a large block from the system, and give it back */
+static void *ArenaSystemAllocate (MemoryArena *arena, size_t size)
+{
+    if (arena->node >= 0)
+        return (numa_node_allocate (size, arena->node));
+    return (malloc (size));
+}
+
+static void ArenaSystemFree (MemoryArena *arena, void *pointer, size_t size)
+{
+    if (arena->node >= 0)
+        numa_node_free (pointer, size);
+    else
+        free (pointer);
+}
+
+/* Take space for a small block from the current chunk, adding a chunk if needed */
+static char *ArenaBump (MemoryArena *arena, size_t bytes)
+{
+    if ((size_t)(arena->end - arena->next) < bytes)
+    {
+        Probe2 (arena__chunk, probeJob, (size_t)ArenaChunkSize);
+        ArenaChunk *chunk = (ArenaChunk *)ArenaSystemAllocate (arena, ArenaChunkSize);
+        if (!chunk)
+            return (NULL);
+        chunk->next = arena->chunks;
+        chunk->size = ArenaChunkSize;
+        arena->chunks = chunk;
+        arena->chunkCount++;
+        ArenaReserved (arena, ArenaChunkSize);
+        arena->next = ((char *)chunk) + sizeof (ArenaChunk);
+        arena->end = ((char *)chunk) + ArenaChunkSize;
+    }
+
+    char *space = arena->next;
+    arena->next += bytes;
+    return (space);
+}
+
+
+void *arena_allocate (void *clientData, size_t size)
+{
+    MemoryArena *arena = (MemoryArena *)clientData;
+    arena->allocations++;
+
+    if (size > ArenaLargestSmall)
+    {
+        Probe2 (arena__large, probeJob, size);
+        ArenaLarge *large = (ArenaLarge *)ArenaSystemAllocate (arena, sizeof (ArenaLarge) + size);
+        if (!large)
+            return (NULL);
+        large->header.size = size;
+        large->header.arena = arena;
+        large->previous = NULL;
+        large->next = arena->large;
+        if (arena->large)
+            arena->large->previous = large;
+        arena->large = large;
+        arena->largeCount++;
+        ArenaReserved (arena, size);
+        return (((char *)large) + sizeof (ArenaLarge));
+    }
+
+    int sizeClass = ArenaClass (&size);
+    char *block = (char *)arena->freeLists[sizeClass];
+    if (block)
+    {
+        arena->freeLists[sizeClass] = *((void **)block);
+        arena->recycled++;
+        return (block);
+    }
+
+    ArenaHeader *header = (ArenaHeader *)ArenaBump (arena, size + ArenaHeaderSize);
+    if (!header)
+        return (NULL);
+    header->size = size;
+    header->arena = arena;
+    return (((char *)header) + ArenaHeaderSize);
+}
+
+void arena_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    ArenaHeader *header = (ArenaHeader *)(((char *)ptr) - ArenaHeaderSize);
+    MemoryArena *arena = header->arena;
+
+    /* A block freed by another thread is left for the arena's release */
+    if (arena->owner != &arenaThreadMarker)
+        return;
+
+    arena->frees++;
+    if (header->size > ArenaLargestSmall)
+    {
+        ArenaLarge *large = (ArenaLarge *)(((char *)ptr) - sizeof (ArenaLarge));
+        if (large->previous)
+            large->previous->next = large->next;
+        else
+            arena->large = large->next;
+        if (large->next)
+            large->next->previous = large->previous;
+        arena->reserved -= large->header.size;
+        ArenaSystemFree (arena, large, sizeof (ArenaLarge) + large->header.size);
+        return;
+    }
+
+    size_t size = header->size;
+    int sizeClass = ArenaClass (&size);
+    *((void **)ptr) = arena->freeLists[sizeClass];
+    arena->freeLists[sizeClass] = ptr;
+    return;
+}
+
+void *arena_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (arena_allocate (clientData, size));
+
+    /* A small block which is already large enough is kept */
+    ArenaHeader *header = (ArenaHeader *)(((char *)pointer) - ArenaHeaderSize);
+    size_t oldSize = header->size;
+    if ((oldSize <= ArenaLargestSmall) && (size <= oldSize))
+        return (pointer);
+
+    void *block = arena_allocate (clientData, size);
+    if (!block)
+        return (NULL);
+    memcpy (block, pointer, oldSize < size ? oldSize : size);
+    arena_free (clientData, pointer);
+    return (block);
+}
+
+size_t arena_remaining (void *clientData)
+{
+    return (1024 * 1024 * 1024 * 1);
+}
+
+
+void arena_master_initialize ()
+{
+    InitCS (arena_stats_lock);
+}
+
+void arena_master_finalize ()
+{
+    DestroyCS (arena_stats_lock);
+}
+
+TKAllocatorProcs *arena_create ()
+{
+    return (arena_create_on_node (-1));
+}
+
+TKAllocatorProcs *arena_create_on_node (int node)
+{
+    MemoryArena *arena = (MemoryArena *)calloc (1, sizeof (MemoryArena));
+    if (!arena)
+        return (NULL);
+    arena->procs.allocProc = arena_allocate;
+    arena->procs.reallocProc = arena_reallocate;
+    arena->procs.freeProc = arena_free;
+    arena->procs.memAvailProc = arena_remaining;
+    arena->procs.clientData = arena;
+    arena->owner = &arenaThreadMarker;
+    arena->node = node;
+    return (&arena->procs);
+}
+
+void arena_release (TKAllocatorProcs *procs)
+{
+    MemoryArena *arena = (MemoryArena *)procs->clientData;
+
+    EnterCS (arena_stats_lock);
+    arenasReleased++;
+    arenaAllocations += arena->allocations;
+    arenaRecycled += arena->recycled;
+    arenaBulkFreed += arena->allocations - arena->frees;
+    arenaChunks += arena->chunkCount;
+    arenaLarge += arena->largeCount;
+    if (arena->highReserved > arenaHighReserved)
+        arenaHighReserved = arena->highReserved;
+    LeaveCS (arena_stats_lock);
+
+    /* Check where the pages of a NUMA arena were placed, before they are released */
+    if (arena->node >= 0)
+    {
+        for (ArenaLarge *large = arena->large; large; large = large->next)
+            numa_count_pages (large, sizeof (ArenaLarge) + large->header.size, arena->node);
+        for (ArenaChunk *chunk = arena->chunks; chunk; chunk = chunk->next)
+            numa_count_pages (chunk, chunk->size, arena->node);
+    }
+
+    while (arena->large)
+    {
+        ArenaLarge *large = arena->large;
+        arena->large = large->next;
+        ArenaSystemFree (arena, large, sizeof (ArenaLarge) + large->header.size);
+    }
+    while (arena->chunks)
+    {
+        ArenaChunk *chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        ArenaSystemFree (arena, chunk, chunk->size);
+    }
+    free (arena);
+}
+
+void arena_report (FILE *logFile)
+{
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "Arenas: %01d released. %01llu blocks allocated, %01llu of them reused from free lists, and %01llu released with their arena.\n",
+        arenasReleased, (unsigned long long)arenaAllocations, (unsigned long long)arenaRecycled, (unsigned long long)arenaBulkFreed);
+    fprintf (logFile, "Arenas: %01llu chunks of %0.5g MB, and %01llu large blocks, were allocated. The largest arena held %0.5g MB.\n",
+        (unsigned long long)arenaChunks, ArenaChunkSize / megabyte, (unsigned long long)arenaLarge, arenaHighReserved / megabyte);
+}
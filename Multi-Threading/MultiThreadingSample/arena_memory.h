@@ -0,0 +1,46 @@
+/* This is an APDFL memory manager which gives each library instance an arena of it's own.
+**
+** When "MemoryManager=arena" is given, each APDFLib instance creates an arena as it
+** starts the library. Memory is carved from large chunks by bumping a pointer, and
+** blocks which are freed are kept on free lists, by size, to be reused by later
+** allocations of the same size. Blocks larger than the largest size class are
+** allocated singly. When the instance terminates the library, the whole arena
+** (every chunk, and every large block) is released at once, whether or not the
+** library freed each block.
+**
+** An arena belongs to the thread which started it's library, and is never locked.
+** A block freed by any other thread is not reused, and is released with the arena.
+** This suits runs in which each thread starts a library of it's own (BaseInit=false,
+** or a library per job, or ThreadPool=true), since memory allocated by one library
+** instance must not be used after that instance is terminated.
+*/
+#ifndef ARENA_MEMORY_h
+#define ARENA_MEMORY_h
+#include <stdio.h>
+#include "PDFInit.h"
+
+/* Call this interface from the mainline, before any library is initialized */
+void arena_master_initialize ();
+
+/* Call this interface from the mainline, after all libraries are terminated */
+void arena_master_finalize ();
+
+/* Create an arena, and return the APDFL memory manager interface for it.
+** Call this in the thread which will initialize the library. Returns NULL if the
+** arena cannot be allocated (The library then uses it's own memory manager).
+*/
+TKAllocatorProcs *arena_create ();
+
+/* Create an arena whose chunks and large blocks are all mapped on a NUMA node (MemoryManager=numa,
+** see numa_memory.h). Call this in the thread which will initialize the library.
+** Returns NULL if the arena cannot be allocated.
+*/
+TKAllocatorProcs *arena_create_on_node (int node);
+
+/* Release the arena, and all memory allocated from it, after the library is terminated */
+void arena_release (TKAllocatorProcs *arena);
+
+/* Write lines describing the arenas released so far to the log */
+void arena_report (FILE *logFile);
+
+#endif
@@ -10,8 +10,14 @@ COMMON_OBJS = PDFLInitCommon.o PDFLInitHFT.o Utilities.o \
 			  Flattener_Worker.o NonAPDFL_Worker.o PDFA_Worker.o \
 			  PDFX_Worker.o Rasterizer_Worker.o \
 			  TextExtract_Worker.o Worker.o XPS2PDF_Worker.o \
-			  RasterizeDoc_Worker.o Access_Worker.o \
-			  malloc_memory.o no_memory.o tcmalloc_memory.o
+			  RasterizeDoc_Worker.o Access_Worker.o InputFileSys.o OutputFileSys.o WriteBehind.o \
+			  malloc_memory.o no_memory.o tcmalloc_memory.o \
+			  loadable_memory.o jemalloc_memory.o mimalloc_memory.o \
+			  rpmalloc.o rpmalloc_memory.o instrumented_memory.o \
+			  arena_memory.o slab_memory.o memory_budget.o allocation_trace.o \
+			  allocation_profile.o WorkerPhase.o large_memory.o numa_memory.o \
+			  soak_monitor.o latency_histogram.o run_sampler.o trace_events.o \
+			  perf_counters.o process_metrics.o Probes.o option_names.o
 			
 
 INCLUDE = ../Include/Headers
@@ -45,9 +51,21 @@ PDFLInitHFT.o : $(SOURCE)/PDFLInitHFT.c
 
 %.cpp : %.o
 
-rpmalloc.c : rpmalloc.o
-	$(CC) $(CPPFLAGS) $(CXXFLAGS) -c $< -o $@
+# rpmalloc is C11, so it is compiled as C. It keeps the statistics reported
+# in the log only when ENABLE_STATISTICS is set.
+RPMALLOC_FLAGS = -DENABLE_STATISTICS=1
+
+rpmalloc.o : rpmalloc.c
+	$(CC) $(CPPFLAGS) $(CFLAGS) $(RPMALLOC_FLAGS) -c $< -o $@
+
+# A benchmark of the memory managers alone, without APDFL ("make allocbench")
+ALLOCBENCH_OBJS = AllocatorBench.o malloc_memory.o slab_memory.o arena_memory.o numa_memory.o \
+			  loadable_memory.o tcmalloc_memory.o jemalloc_memory.o mimalloc_memory.o \
+			  rpmalloc.o rpmalloc_memory.o Probes.o latency_histogram.o option_names.o
+
+allocbench: $(ALLOCBENCH_OBJS)
+	$(CXX) -o AllocatorBench $(ALLOCBENCH_OBJS) $(ARCH_FLAGS) -lpthread -ldl
 
 clean:
-	$(RM) *.o core out.* $(SAMPNAME) 
+	$(RM) *.o core out.* $(SAMPNAME) AllocatorBench 
 
@@ -17,7 +17,8 @@ CCFLAGS  = $(ARCH_FLAGS) -g $(PDF_FDIR_DEF) -DNO_PRAGMA_ONCE -DUNIX_PLATFORM=1 -
 
 CXXFLAGS = $(CCFLAGS)
 
-LDFLAGS = $(ARCH_FLAGS) -L$(PDFL_PATH)
+# -rdynamic lets the allocation profile name the sample's own functions
+LDFLAGS = $(ARCH_FLAGS) -rdynamic -L$(PDFL_PATH)
 LIBS = -lDL150pdfl -lDL150CoolType -lDL150AGM -lDL150BIB -lDL150ACE -lDL150ARE \
 	   -lDL150BIBUtils -lDL150JP2K -lDL150AdobeXMP -lDL150AXE8SharedExpat \
-	   -licucnv -licudata -lpthread
+	   -licucnv -licudata -lpthread -ldl
@@ -0,0 +1,312 @@
+/* This is an APDFL memory manager which counts the use of any other memory manager.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. Here, each method updates
+** the counts for the calling thread, and calls the wrapped allocator (or
+** malloc, when APDFL was to use it's own). The client data is the wrapped allocator.
+**
+** Each block is preceded by a header of 16 bytes, holding it's size. 16 bytes
+** keeps the block given to APDFL aligned as the wrapped allocator aligned it.
+**
+** I can update counts without a mutex, because they are kept for each thread!
+**
+** The library instance whose allocator this is belongs to one thread, and that thread
+** runs one job at a time, so the thread's counts are the counts of the job it is running.
+** The totals for each type of job, and each input document, are kept only by the main line.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include "instrumented_memory.h"
+#include "wrapped_allocator.h"
+#include "allocation_profile.h"
+
+#define InstrumentedHeaderSize 16
+
+/* The memory needed by the jobs of one type, or one input document */
+typedef struct documentMemory
+{
+    ASUns64             jobs;
+    ASInt64             peakTotal;                      /* Sum of the high water mark of each job */
+    ASInt64             peakMost;                       /* Highest high water mark of any job */
+    ASInt64             liveTotal;                      /* Sum of the bytes each job had live at close */
+    ASInt64             liveMost;                       /* Most bytes any job had live at close */
+    ASUns64             allocationsTotal;               /* Sum of the allocations of each job */
+} DocumentMemory;
+
+typedef std::map<std::string, DocumentMemory> DocumentMemoryTable;
+
+static bool                 instrumenting = false;
+
+/* The bytes in use by all threads, when asked for. Changed only with AtomicAdd64 */
+static bool                 countingProcess = false;
+static volatile ASInt64     processInUse = 0;
+
+/* The counts for the job running in this thread */
+static ThreadLocal MemoryCounters threadCounters;
+
+/* The totals for the run, for each type of job, and for each input document (By type, then name) */
+static DocumentMemory       runMemory;
+static DocumentMemoryTable  typeMemory;
+static DocumentMemoryTable  documentMemory;
+
+
+/* Return the size class for an allocation */
+static int SizeClass (size_t size)
+{
+    int sizeClass = 0;
+    while ((sizeClass < (MemorySizeClasses - 1)) && (((size_t)1 << sizeClass) < size))
+        sizeClass++;
+    return (sizeClass);
+}
+
+/* Count bytes coming into use, and move the high water mark */
+static void CountInUse (ASInt64 bytes)
+{
+    if (countingProcess)
+        AtomicAdd64 (&processInUse, bytes);
+    threadCounters.inUse += bytes;
+    if (threadCounters.inUse > threadCounters.highWater)
+        threadCounters.highWater = threadCounters.inUse;
+}
+
+void *instrumented_allocate (void *clientData, size_t size)
+{
+    char *block = (char *)WrappedAllocate ((TKAllocatorProcs *)clientData, size + InstrumentedHeaderSize);
+    if (!block)
+        return (NULL);
+    *((size_t *)block) = size;
+
+    threadCounters.allocations++;
+    threadCounters.bytesAllocated += size;
+    threadCounters.sizeClass[SizeClass (size)]++;
+    CountInUse (size);
+    SampleAllocation (size);
+    return (block + InstrumentedHeaderSize);
+}
+
+void *instrumented_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (instrumented_allocate (clientData, size));
+
+    char *oldBlock = ((char *)pointer) - InstrumentedHeaderSize;
+    size_t oldSize = *((size_t *)oldBlock);
+    char *block = (char *)WrappedReallocate ((TKAllocatorProcs *)clientData, oldBlock, size + InstrumentedHeaderSize);
+    if (!block)
+        return (NULL);
+    *((size_t *)block) = size;
+
+    threadCounters.reallocations++;
+    if (block != oldBlock)
+        threadCounters.reallocMoved++;
+    if (size > oldSize)
+    {
+        threadCounters.reallocGrew++;
+        threadCounters.reallocGrowth += size - oldSize;
+        threadCounters.bytesAllocated += size - oldSize;
+    }
+    else
+    {
+        threadCounters.reallocShrank++;
+        threadCounters.bytesFreed += oldSize - size;
+    }
+    CountInUse ((ASInt64)size - (ASInt64)oldSize);
+    SampleAllocation (size);
+    return (block + InstrumentedHeaderSize);
+}
+
+void instrumented_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    char *block = ((char *)ptr) - InstrumentedHeaderSize;
+    size_t size = *((size_t *)block);
+    threadCounters.frees++;
+    threadCounters.bytesFreed += size;
+    threadCounters.inUse -= size;
+    if (countingProcess)
+        AtomicAdd64 (&processInUse, -(ASInt64)size);
+    WrappedFree ((TKAllocatorProcs *)clientData, block);
+    return;
+}
+
+size_t instrumented_remaining (void *clientData)
+{
+    TKAllocatorProcs *wrapped = (TKAllocatorProcs *)clientData;
+    if (wrapped && wrapped->memAvailProc)
+        return (wrapped->memAvailProc (wrapped->clientData));
+    return (1024 * 1024 * 1024 * 1);
+}
+
+
+void InitializeInstrumentedMemory (attributes *FrameAttributes)
+{
+    instrumenting = FrameAttributes->GetKeyValueBool ("InstrumentMemory");
+}
+
+bool InstrumentingMemory ()
+{
+    return (instrumenting);
+}
+
+void CountProcessMemory ()
+{
+    countingProcess = true;
+}
+
+bool InstrumentedInUse (ASInt64 *inUse)
+{
+    if (!instrumenting || !countingProcess)
+        return (false);
+    *inUse = processInUse;
+    return (true);
+}
+
+TKAllocatorProcs *InstrumentedAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper)
+{
+    if (!instrumenting && !ProfilingAllocations ())
+        return (allocator);
+
+    wrapper->allocProc = instrumented_allocate;
+    wrapper->reallocProc = instrumented_reallocate;
+    wrapper->freeProc = instrumented_free;
+    wrapper->memAvailProc = instrumented_remaining;
+    wrapper->clientData = allocator;
+    return (wrapper);
+}
+
+void StartJobMemoryCounters ()
+{
+    memset (&threadCounters, 0, sizeof (MemoryCounters));
+}
+
+void TakeJobMemoryCounters (MemoryCounters *counters)
+{
+    memcpy (counters, &threadCounters, sizeof (MemoryCounters));
+}
+
+void NoteDocumentClosed ()
+{
+    threadCounters.liveAtClose = threadCounters.inUse;
+    threadCounters.documentsClosed++;
+}
+
+void AddMemoryCounters (MemoryCounters *total, MemoryCounters *job)
+{
+    total->allocations += job->allocations;
+    total->frees += job->frees;
+    total->reallocations += job->reallocations;
+    total->bytesAllocated += job->bytesAllocated;
+    total->bytesFreed += job->bytesFreed;
+    total->reallocGrew += job->reallocGrew;
+    total->reallocShrank += job->reallocShrank;
+    total->reallocMoved += job->reallocMoved;
+    total->reallocGrowth += job->reallocGrowth;
+    total->inUse += job->inUse;
+
+    /* The high water mark of the run is the highest of any one job */
+    if (job->highWater > total->highWater)
+        total->highWater = job->highWater;
+    if (job->liveAtClose > total->liveAtClose)
+        total->liveAtClose = job->liveAtClose;
+    total->documentsClosed += job->documentsClosed;
+    for (int index = 0; index < MemorySizeClasses; index++)
+        total->sizeClass[index] += job->sizeClass[index];
+}
+
+void ReportJobMemory (FILE *logFile, int jobNumber, MemoryCounters *counters)
+{
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "  Thread %01d memory: %01llu allocations, %01llu frees, %01llu reallocations. %0.5g MB allocated, %0.5g MB freed, %0.5g MB high water, %0.5g MB live at close.\n",
+        jobNumber, (unsigned long long)counters->allocations, (unsigned long long)counters->frees, (unsigned long long)counters->reallocations,
+        counters->bytesAllocated / megabyte, counters->bytesFreed / megabyte, counters->highWater / megabyte, counters->liveAtClose / megabyte);
+}
+
+void ReportMemoryCounters (FILE *logFile, MemoryCounters *total, int jobs)
+{
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "\nMemory: %01llu allocations, %01llu frees, %01llu reallocations in %01d jobs. %0.5g MB allocated, %0.5g MB freed.\n",
+        (unsigned long long)total->allocations, (unsigned long long)total->frees, (unsigned long long)total->reallocations, jobs,
+        total->bytesAllocated / megabyte, total->bytesFreed / megabyte);
+    fprintf (logFile, "Memory: the highest high water mark of any job was %0.5g MB. %0.5g MB were left in use by the jobs.\n",
+        total->highWater / megabyte, total->inUse / megabyte);
+    if (total->reallocations)
+        fprintf (logFile, "Memory: %01llu reallocations grew (by %0.5g bytes on average), %01llu shrank, and %01llu moved their block.\n",
+            (unsigned long long)total->reallocGrew, total->reallocGrew ? ((total->reallocGrowth * 1.0) / total->reallocGrew) : 0.0,
+            (unsigned long long)total->reallocShrank, (unsigned long long)total->reallocMoved);
+
+    fprintf (logFile, "Memory: allocations by size (up to, in bytes):\n");
+    for (int index = 0; index < MemorySizeClasses; index++)
+    {
+        if (!total->sizeClass[index])
+            continue;
+        if (index < (MemorySizeClasses - 1))
+            fprintf (logFile, "    %12llu  %12llu  %0.3g%%\n", (unsigned long long)1 << index, (unsigned long long)total->sizeClass[index],
+                (total->sizeClass[index] * 100.0) / total->allocations);
+        else
+            fprintf (logFile, "    %12s  %12llu  %0.3g%%\n", "larger", (unsigned long long)total->sizeClass[index],
+                (total->sizeClass[index] * 100.0) / total->allocations);
+    }
+}
+
+/* Add one job to a total */
+static void AddJob (DocumentMemory *total, MemoryCounters *job)
+{
+    total->jobs++;
+    total->peakTotal += job->highWater;
+    if (job->highWater > total->peakMost)
+        total->peakMost = job->highWater;
+    total->liveTotal += job->liveAtClose;
+    if (job->liveAtClose > total->liveMost)
+        total->liveMost = job->liveAtClose;
+    total->allocationsTotal += job->allocations;
+}
+
+/* Write one line of the table of memory needed */
+static void ReportLine (FILE *logFile, const char *name, DocumentMemory *total)
+{
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "    %10.5g  %10.5g  %10.5g  %10.5g  %12.0f  %6llu  %s\n",
+        (total->peakTotal / megabyte) / total->jobs, total->peakMost / megabyte,
+        (total->liveTotal / megabyte) / total->jobs, total->liveMost / megabyte,
+        (total->allocationsTotal * 1.0) / total->jobs, (unsigned long long)total->jobs, name);
+}
+
+void AddDocumentMemory (const char *workerName, const char *document, MemoryCounters *job)
+{
+    AddJob (&runMemory, job);
+    AddJob (&typeMemory[workerName], job);
+
+    std::string name (workerName);
+    name += " ";
+    name += document ? document : "(none)";
+    AddJob (&documentMemory[name], job);
+}
+
+void ReportDocumentMemory (FILE *logFile)
+{
+    if (!runMemory.jobs)
+        return;
+
+    fprintf (logFile, "\nMemory needed, by type of job, then by input document (MB, and allocations, per job):\n");
+    fprintf (logFile, "    %10s  %10s  %10s  %10s  %12s  %6s\n", "mean peak", "most peak", "mean live", "most live", "allocations", "jobs");
+    for (DocumentMemoryTable::iterator entry = typeMemory.begin (); entry != typeMemory.end (); entry++)
+        ReportLine (logFile, entry->first.c_str (), &entry->second);
+    for (DocumentMemoryTable::iterator entry = documentMemory.begin (); entry != documentMemory.end (); entry++)
+        ReportLine (logFile, entry->first.c_str (), &entry->second);
+    fprintf (logFile, "Memory needed: live is the bytes a job had in use as it closed it's input document.\n");
+}
+
+void WriteDocumentMemoryStatistics (FILE *statFile)
+{
+    double megabyte = 1024.0 * 1024.0;
+    double jobs = runMemory.jobs ? runMemory.jobs : 1;
+    fprintf (statFile, "|%0.5g|%0.5g|%0.5g|%0.5g",
+        (runMemory.peakTotal / megabyte) / jobs, (runMemory.liveTotal / megabyte) / jobs,
+        runMemory.liveMost / megabyte, runMemory.allocationsTotal / jobs);
+}
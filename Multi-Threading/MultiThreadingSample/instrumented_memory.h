@@ -0,0 +1,112 @@
+/* This is an APDFL memory manager which counts the use of any other memory manager.
+**
+** When "InstrumentMemory=true" is given, the allocator APDFL is started with (None, malloc,
+** rpmalloc, and so on) is wrapped by this one. Each block is given a small header holding
+** it's size, so that frees can be counted in bytes, and every call is passed on to the
+** wrapped allocator.
+**
+** Counts are kept for each thread, in thread local storage, so they need no mutex.
+** They are started again as each job starts, and collected as it ends, so they show
+** the allocations made by that job. The counts are:
+**   allocations, frees and reallocations, with the bytes allocated and freed,
+**   how reallocations grew, shrank, or moved their blocks,
+**   the number of allocations in each power of two size class,
+**   and the high water mark of bytes in use.
+**
+** Memory freed by a thread other than the one which allocated it is counted in the
+** thread which freed it, so the bytes in use for a single job may go below zero.
+**
+** For capacity planning, each job also notes the bytes still in use as it closes it's
+** input document (See CloseSampleFile, in Utilities.h). The peak, the bytes live at that
+** close, and the allocations of every job are totalled for each type of job, and each
+** input document, and written to the log at the end of the run. So the memory a document
+** needs may be known before it is scheduled.
+**
+** This wrapper also takes the samples for the allocation profile, when "AllocationSampling="
+** is given (See allocation_profile.h), so it is installed then, even if counts are not asked for.
+*/
+#ifndef INSTRUMENTED_MEMORY_h
+#define INSTRUMENTED_MEMORY_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* Size class N holds allocations of more than 2^(N-1) bytes, up to 2^N bytes.
+** The last class holds everything larger.
+*/
+#define MemorySizeClasses 32
+
+typedef struct memoryCounters
+{
+    ASUns64         allocations;                        /* Calls to allocate (Including reallocations of NULL) */
+    ASUns64         frees;                              /* Calls to free a block */
+    ASUns64         reallocations;                      /* Calls to reallocate a block */
+    ASUns64         bytesAllocated;                     /* Bytes asked for, by allocations, and by reallocations which grew */
+    ASUns64         bytesFreed;                         /* Bytes released, by frees, and by reallocations which shrank */
+    ASUns64         reallocGrew;                        /* Reallocations to a larger size */
+    ASUns64         reallocShrank;                      /* Reallocations to a smaller (or the same) size */
+    ASUns64         reallocMoved;                       /* Reallocations which returned a different block */
+    ASUns64         reallocGrowth;                      /* Bytes added by reallocations which grew */
+    ASInt64         inUse;                              /* Bytes allocated less bytes freed */
+    ASInt64         highWater;                          /* Highest value of inUse */
+    ASInt64         liveAtClose;                        /* Value of inUse as the last input document was closed */
+    ASUns64         documentsClosed;                    /* Input documents closed */
+    ASUns64         sizeClass[MemorySizeClasses];       /* Allocations in each size class */
+} MemoryCounters;
+
+/* Note whether "InstrumentMemory=true" was given. Call this once, from the main line,
+** before any library is started.
+*/
+void InitializeInstrumentedMemory (attributes *FrameAttributes);
+
+/* True if memory use is being counted */
+bool InstrumentingMemory ();
+
+/* Return the allocator a library should be started with: the wrapper, when memory
+** use is being counted or allocations sampled, otherwise the allocator given. The wrapper is built in the
+** block given, which must last as long as the library, and wraps the allocator given
+** (NULL if APDFL is to use it's own).
+*/
+TKAllocatorProcs *InstrumentedAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper);
+
+/* Also count the bytes in use by the whole process, for the run sampler and the soak monitor.
+** That is an atomic add on every allocation, so it is only done when asked for. Call this
+** from the main line, before any library is started.
+*/
+void CountProcessMemory ();
+
+/* The bytes in use by the whole process, through this wrapper. Returns false if they are not counted. */
+bool InstrumentedInUse (ASInt64 *inUse);
+
+/* Start the counts for a new job in this thread */
+void StartJobMemoryCounters ();
+
+/* Copy the counts for the job ending in this thread */
+void TakeJobMemoryCounters (MemoryCounters *counters);
+
+/* Note that this thread's job has just closed an input document, and the bytes it has in use */
+void NoteDocumentClosed ();
+
+/* Add the counts for one job into a total for the run */
+void AddMemoryCounters (MemoryCounters *total, MemoryCounters *job);
+
+/* Write a line describing the memory use of one job to the log */
+void ReportJobMemory (FILE *logFile, int jobNumber, MemoryCounters *counters);
+
+/* Write lines describing the memory use of the whole run, with the size class histogram, to the log */
+void ReportMemoryCounters (FILE *logFile, MemoryCounters *total, int jobs);
+
+/* Add the counts for one job to the totals for it's type of job, and it's input document.
+** Call this from the main line, as each job completes.
+*/
+void AddDocumentMemory (const char *workerName, const char *document, MemoryCounters *job);
+
+/* Write the memory needed by each type of job, and each input document, to the log */
+void ReportDocumentMemory (FILE *logFile);
+
+/* Write the columns the memory needed by jobs adds to the statistics file: the mean job peak MB,
+** the mean and largest MB live at close, and the mean allocations per job
+*/
+void WriteDocumentMemoryStatistics (FILE *statFile);
+
+#endif
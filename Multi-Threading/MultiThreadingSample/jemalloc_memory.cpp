@@ -0,0 +1,37 @@
+/* This is an APDFL memory manager built using jemalloc, loaded at run time
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. It also contains a
+** reference to a method that may indicate how much memory is available
+** to be allocated. Generally, that last method is not accurately set.
+** When it indicates a lower amount, it triggers cache cleanup.
+**
+** jemalloc is not linked into the framework. The library's own malloc, realloc and free
+** are used (found through the library's handle, not the process's).
+** The library is loaded, and it's entry points found, by the loader in loadable_memory.cpp.
+*/
+#include "jemalloc_memory.h"
+
+static LoadableAllocator jemalloc_allocator =
+{
+    "jemalloc",
+#ifdef WIN_PLATFORM
+    { "jemalloc.dll", NULL },
+#elif defined(MAC_PLATFORM)
+    { "libjemalloc.2.dylib", "libjemalloc.dylib", NULL },
+#else
+    { "libjemalloc.so.2", "libjemalloc.so", NULL },
+#endif
+    "malloc", "realloc", "free"
+};
+
+TKAllocatorProcs *jemalloc_access ()
+{
+    return (loadable_access (&jemalloc_allocator));
+}
+
+const char *jemalloc_describe ()
+{
+    return (loadable_describe (&jemalloc_allocator));
+}
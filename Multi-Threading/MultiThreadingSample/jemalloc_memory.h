@@ -0,0 +1,23 @@
+/* This is an APDFL memory manager built using jemalloc, loaded at run time
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. It also contains a
+** reference to a method that may indicate how much memory is available
+** to be allocated. Generally, that last method is not accurately set.
+** When it indicates a lower amount, it triggers cache cleanup.
+**
+** jemalloc is not linked into the framework. The library's own malloc, realloc and free
+** are used (found through the library's handle, not the process's).
+** The library is loaded, and it's entry points found, by the loader in loadable_memory.cpp.
+*/
+#ifndef JEMALLOC_MEMORY_h
+#define JEMALLOC_MEMORY_h
+#include "PDFInit.h"
+#include "loadable_memory.h"
+
+TKAllocatorProcs *jemalloc_access ();        /* Call this method to acquire an APDFL memory Manager Interface (NULL if jemalloc cannot be loaded) */
+
+const char *jemalloc_describe ();            /* Describes the library loaded, or why it could not be loaded */
+
+#endif
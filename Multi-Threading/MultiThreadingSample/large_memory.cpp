@@ -0,0 +1,326 @@
+/* Large buffers, mapped directly from the operating system.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. Here, each method maps blocks
+** of at least the threshold for themselves, and passes smaller ones to the wrapped
+** allocator (or malloc, when APDFL was to use it's own). The client data is the
+** wrapped allocator.
+**
+** Every block is preceded by a 16 byte tag, giving it's size, and the length of it's
+** mapping (zero when it came from the wrapped allocator). A mapped block starts 64 bytes
+** into it's mapping, so it is aligned to a cache line, and the mapping is found from it.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "large_memory.h"
+#include "option_names.h"
+#include "wrapped_allocator.h"
+#include "Probes.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define LargeTagSize        16
+#define LargeHeaderSize     64
+#define HugePageSize        (2 * 1024 * 1024)
+
+/* The tag before each block */
+typedef struct largeTag
+{
+    size_t              size;                           /* Bytes asked for */
+    size_t              mapped;                         /* Length of the mapping, or zero */
+} LargeTag;
+
+static const char *largeBufferModeNames[NumberOfLargeBufferModes] = { "NONE", "PAGES", "TRANSPARENT", "HUGETLB" };
+
+static LargeBufferModes     largeMode = LargeBuffersNone;
+static size_t               largeThreshold = 1024 * 1024;
+
+/* Usage counts, for the report at the end of the run. Changed only with AtomicAdd64 */
+static volatile ASInt64     largeMapped = 0;            /* Buffers mapped */
+static volatile ASInt64     largeForAPDFL = 0;          /* Of those, the ones APDFL asked for */
+static volatile ASInt64     largeBytes = 0;             /* Bytes mapped in all */
+static volatile ASInt64     largeInUse = 0;             /* Bytes mapped now */
+static ASInt64              largeHighWater = 0;         /* Most mapped at once (Kept without a lock, so approximate) */
+static volatile ASInt64     largeFallbacks = 0;         /* Huge pages asked for, and not given */
+static volatile ASInt64     largeFailures = 0;          /* Mappings refused, so taken from the heap */
+
+
+static LargeTag *TagOf (void *pointer)
+{
+    return ((LargeTag *)(((char *)pointer) - LargeTagSize));
+}
+
+/* Round a length up to a multiple of a page */
+static size_t RoundUp (size_t length, size_t page)
+{
+    return (((length + page - 1) / page) * page);
+}
+
+static size_t SystemPageSize ()
+{
+#ifdef WIN_PLATFORM
+    SYSTEM_INFO info;
+    GetSystemInfo (&info);
+    return (info.dwPageSize);
+#else
+    return ((size_t)sysconf (_SC_PAGESIZE));
+#endif
+}
+
+/* Map length bytes, in the mode selected. Returns NULL if the system will not.
+** The length of the mapping made is returned in mapped.
+*/
+static char *MapBuffer (size_t length, size_t *mapped)
+{
+    char *base = NULL;
+
+#ifdef WIN_PLATFORM
+    if (largeMode == LargeBuffersHugeTLB)
+    {
+        size_t largePage = GetLargePageMinimum ();
+        if (largePage)
+        {
+            *mapped = RoundUp (length, largePage);
+            base = (char *)VirtualAlloc (NULL, *mapped, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+        if (!base)
+        {
+            AtomicAdd64 (&largeFallbacks, 1);
+            Probe2 (large__fallback, probeJob, length);
+        }
+    }
+    if (!base)
+    {
+        *mapped = RoundUp (length, SystemPageSize ());
+        base = (char *)VirtualAlloc (NULL, *mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+#else
+#ifdef MAP_HUGETLB
+    if (largeMode == LargeBuffersHugeTLB)
+    {
+        *mapped = RoundUp (length, HugePageSize);
+        base = (char *)mmap (NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == (char *)MAP_FAILED)
+        {
+            base = NULL;
+            AtomicAdd64 (&largeFallbacks, 1);
+            Probe2 (large__fallback, probeJob, length);
+        }
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    if (largeMode == LargeBuffersTransparent)
+    {
+        /* Map a huge page more than needed, and trim the ends, so the mapping starts on a huge page */
+        *mapped = RoundUp (length, HugePageSize);
+        char *region = (char *)mmap (NULL, *mapped + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region != (char *)MAP_FAILED)
+        {
+            base = (char *)RoundUp ((size_t)region, HugePageSize);
+            if (base != region)
+                munmap (region, base - region);
+            if ((region + HugePageSize) != base)
+                munmap (base + *mapped, (region + HugePageSize) - base);
+            if (madvise (base, *mapped, MADV_HUGEPAGE) != 0)
+            {
+                AtomicAdd64 (&largeFallbacks, 1);
+                Probe2 (large__fallback, probeJob, length);
+            }
+        }
+    }
+#endif
+    if (!base)
+    {
+        *mapped = RoundUp (length, SystemPageSize ());
+        base = (char *)mmap (NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == (char *)MAP_FAILED)
+            base = NULL;
+    }
+#endif
+
+    if (!base)
+    {
+        AtomicAdd64 (&largeFailures, 1);
+        return (NULL);
+    }
+
+    AtomicAdd64 (&largeMapped, 1);
+    AtomicAdd64 (&largeBytes, *mapped);
+    ASInt64 inUse = AtomicAdd64 (&largeInUse, *mapped);
+    if (inUse > largeHighWater)
+        largeHighWater = inUse;
+    Probe3 (large__map, probeJob, length, *mapped);
+    return (base);
+}
+
+/* Return a mapping to the system */
+static void UnmapBuffer (char *base, size_t mapped)
+{
+    AtomicAdd64 (&largeInUse, -(ASInt64)mapped);
+#ifdef WIN_PLATFORM
+    VirtualFree (base, 0, MEM_RELEASE);
+#else
+    munmap (base, mapped);
+#endif
+}
+
+void *large_allocate (void *clientData, size_t size)
+{
+    char *block = NULL;
+    size_t mapped = 0;
+    if (size >= largeThreshold)
+    {
+        char *base = MapBuffer (size + LargeHeaderSize, &mapped);
+        if (base)
+            block = base + LargeHeaderSize;
+    }
+    if (!block)
+    {
+        mapped = 0;
+        block = (char *)WrappedAllocate ((TKAllocatorProcs *)clientData, size + LargeTagSize);
+        if (!block)
+            return (NULL);
+        block += LargeTagSize;
+    }
+
+    LargeTag *tag = TagOf (block);
+    tag->size = size;
+    tag->mapped = mapped;
+    return (block);
+}
+
+void large_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    LargeTag *tag = TagOf (ptr);
+    if (tag->mapped)
+        UnmapBuffer (((char *)ptr) - LargeHeaderSize, tag->mapped);
+    else
+        WrappedFree ((TKAllocatorProcs *)clientData, tag);
+    return;
+}
+
+void *large_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (large_allocate (clientData, size));
+
+    LargeTag *tag = TagOf (pointer);
+
+    /* A small block staying small stays with the wrapped allocator */
+    if (!tag->mapped && size < largeThreshold)
+    {
+        char *block = (char *)WrappedReallocate ((TKAllocatorProcs *)clientData, tag, size + LargeTagSize);
+        if (!block)
+            return (NULL);
+        ((LargeTag *)block)->size = size;
+        return (block + LargeTagSize);
+    }
+
+    /* A large block which still fits it's mapping stays where it is */
+    if (tag->mapped && size >= largeThreshold && (size + LargeHeaderSize) <= tag->mapped)
+    {
+        tag->size = size;
+        return (pointer);
+    }
+
+    /* Otherwise, move it between the wrapped allocator and a mapping of it's own */
+    void *block = large_allocate (clientData, size);
+    if (!block)
+        return (NULL);
+    memcpy (block, pointer, tag->size < size ? tag->size : size);
+    large_free (clientData, pointer);
+    return (block);
+}
+
+size_t large_remaining (void *clientData)
+{
+    TKAllocatorProcs *wrapped = (TKAllocatorProcs *)clientData;
+    if (wrapped && wrapped->memAvailProc)
+        return (wrapped->memAvailProc (wrapped->clientData));
+    return (1024 * 1024 * 1024 * 1);
+}
+
+/* Count the buffers APDFL asks for, apart from the bitmaps */
+static void *large_apdfl_allocate (void *clientData, size_t size)
+{
+    if (size >= largeThreshold)
+        AtomicAdd64 (&largeForAPDFL, 1);
+    return (large_allocate (clientData, size));
+}
+
+
+bool InitializeLargeBuffers (attributes *FrameAttributes)
+{
+    int threshold = FrameAttributes->GetKeyValueInt ("LargeBufferThreshold");
+    if (threshold > 0)
+        largeThreshold = (size_t)threshold * 1024;
+
+    largeMode = LargeBuffersNone;
+    if (FrameAttributes->IsKeyPresent ("LargeBuffers"))
+    {
+        largeMode = (LargeBufferModes)OptionIndex (FrameAttributes->GetKeyValue ("LargeBuffers")->value (0), largeBufferModeNames, NumberOfLargeBufferModes);
+        if (largeMode == NumberOfLargeBufferModes)
+        {
+            largeMode = LargeBuffersNone;
+            return (false);
+        }
+    }
+    return (true);
+}
+
+bool UsingLargeBuffers ()
+{
+    return (largeMode != LargeBuffersNone);
+}
+
+void *AllocateLargeBuffer (size_t size)
+{
+    if (largeMode == LargeBuffersNone)
+        return (malloc (size));
+    return (large_allocate (NULL, size));
+}
+
+void ReleaseLargeBuffer (void *buffer)
+{
+    if (largeMode == LargeBuffersNone)
+        free (buffer);
+    else
+        large_free (NULL, buffer);
+}
+
+TKAllocatorProcs *LargeBufferAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper)
+{
+    if (largeMode == LargeBuffersNone)
+        return (allocator);
+
+    wrapper->allocProc = large_apdfl_allocate;
+    wrapper->reallocProc = large_reallocate;
+    wrapper->freeProc = large_free;
+    wrapper->memAvailProc = large_remaining;
+    wrapper->clientData = allocator;
+    return (wrapper);
+}
+
+void ReportLargeBuffers (FILE *logFile)
+{
+    if (largeMode == LargeBuffersNone)
+        return;
+
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "Large buffers (%s, %01d KB and over): %01lld mapped (%01lld asked for by APDFL), %0.5g MB in all, at most %0.5g MB at once.\n",
+        largeBufferModeNames[largeMode], (int)(largeThreshold / 1024), (long long)largeMapped, (long long)largeForAPDFL,
+        largeBytes / megabyte, largeHighWater / megabyte);
+    if (largeFallbacks || largeFailures)
+        fprintf (logFile, "Large buffers: %01lld could not have huge pages, and %01lld could not be mapped at all (and came from the heap).\n",
+            (long long)largeFallbacks, (long long)largeFailures);
+}
@@ -0,0 +1,60 @@
+/* Large buffers, mapped directly from the operating system.
+**
+** Page bitmaps drawn at high resolution, and the largest blocks APDFL allocates, may be
+** hundreds of megabytes. Taken from the heap, each is touched a 4K page at a time, so drawing
+** one causes a page fault for every page, and a TLB miss for almost every row. When freed, the
+** memory may stay in the heap.
+**
+** When "LargeBuffers=" is given, buffers of at least "LargeBufferThreshold=" kilobytes (Default
+** 1024) are instead mapped for themselves, and unmapped (returned to the system) as soon as they
+** are freed. The buffer given is aligned to 64 bytes (a cache line). "LargeBuffers=" may be:
+**   none           Large buffers come from the heap, as any other (the default).
+**   pages          Large buffers are mapped with ordinary pages.
+**   transparent    Large buffers are mapped on a huge page boundary, and the system is asked to
+**                  back them with transparent huge pages (Linux, madvise MADV_HUGEPAGE).
+**   hugetlb        Large buffers are mapped from the reserved huge page pool (Linux MAP_HUGETLB, or
+**                  large pages on Windows). If the pool is empty, ordinary pages are used.
+**
+** The rasterizer workers take their page bitmaps from AllocateLargeBuffer. APDFL's own allocations
+** go through LargeBufferAllocator, which wraps the memory manager APDFL is started with.
+**
+** The page faults taken by each job, and by the whole run, are written to the log, so the
+** effect may be measured.
+*/
+#ifndef LARGE_MEMORY_h
+#define LARGE_MEMORY_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* The ways large buffers may be mapped */
+typedef enum largeBufferModes
+{
+    LargeBuffersNone,               /* From the heap (LargeBuffers=none) */
+    LargeBuffersPages,              /* Mapped with ordinary pages (LargeBuffers=pages) */
+    LargeBuffersTransparent,        /* Mapped, with transparent huge pages (LargeBuffers=transparent) */
+    LargeBuffersHugeTLB,            /* Mapped from the huge page pool (LargeBuffers=hugetlb) */
+    NumberOfLargeBufferModes
+} LargeBufferModes;
+
+/* Read "LargeBuffers=" and "LargeBufferThreshold=". Call this once, from the main line,
+** before any library is started. Returns false if the mode given is not known.
+*/
+bool InitializeLargeBuffers (attributes *FrameAttributes);
+
+/* True if large buffers are mapped for themselves */
+bool UsingLargeBuffers ();
+
+/* Allocate a buffer, which is mapped when it is large. Release it with ReleaseLargeBuffer. */
+void *AllocateLargeBuffer (size_t size);
+void ReleaseLargeBuffer (void *buffer);
+
+/* Return the allocator a library should be started with: the wrapper, built in the block given
+** (which must last as long as the library), when large buffers are mapped, otherwise the allocator given.
+*/
+TKAllocatorProcs *LargeBufferAllocator (TKAllocatorProcs *allocator, TKAllocatorProcs *wrapper);
+
+/* Write a line describing the large buffers mapped to the log */
+void ReportLargeBuffers (FILE *logFile);
+
+#endif
@@ -0,0 +1,114 @@
+/* Histograms of the time jobs take.
+**
+** A value below LatencySubBuckets is it's own index. Above that, the value is shifted right
+** until it is below LatencySubBuckets (So it's top bit is the top bit of a sub bucket), and
+** the shift picks the group of counts, and the value left picks the count in the group.
+**
+** The histograms are only written by the main line, as jobs complete, so need no lock.
+*/
+
+#include <string.h>
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define LatencyHalfBuckets      (LatencySubBuckets / 2)
+
+
+/* Return the index of the count for a value */
+static int LatencyIndex (ASUns64 value)
+{
+    if (value < LatencySubBuckets)
+        return ((int)value);
+
+    int shift = 0;
+    while ((value >> shift) >= LatencySubBuckets)
+        shift++;
+    if (shift > LatencyShifts)
+        return (LatencyCounts - 1);
+    return (LatencySubBuckets + ((shift - 1) * LatencyHalfBuckets) + (int)((value >> shift) - LatencyHalfBuckets));
+}
+
+/* Return the highest value counted at an index */
+static ASUns64 LatencyValue (int index)
+{
+    if (index < LatencySubBuckets)
+        return ((ASUns64)index);
+
+    int shift = ((index - LatencySubBuckets) / LatencyHalfBuckets) + 1;
+    ASUns64 top = ((index - LatencySubBuckets) % LatencyHalfBuckets) + LatencyHalfBuckets;
+    return (((top + 1) << shift) - 1);
+}
+
+
+double LatencyClock ()
+{
+#ifndef WIN_PLATFORM
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (now.tv_sec + ((now.tv_nsec * 1.0) / 1000000000.0));
+#else
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter (&now);
+    QueryPerformanceFrequency (&frequency);
+    return ((now.QuadPart * 1.0) / frequency.QuadPart);
+#endif
+}
+
+void RecordLatency (LatencyHistogram *histogram, double seconds)
+{
+    ASUns64 value = 0;
+    if (seconds > 0)
+        value = (ASUns64)((seconds * 1000000.0) + 0.5);
+
+    histogram->counts[LatencyIndex (value)]++;
+    histogram->total++;
+    if (value > histogram->largest)
+        histogram->largest = value;
+}
+
+double LatencyPercentile (LatencyHistogram *histogram, double percentile)
+{
+    if (!histogram->total)
+        return (0);
+
+    /* The rank of the value wanted, counting from one */
+    ASUns64 rank = (ASUns64)(((percentile / 100.0) * histogram->total) + 0.999999);
+    if (rank < 1)
+        rank = 1;
+
+    ASUns64 seen = 0;
+    for (int index = 0; index < LatencyCounts; index++)
+    {
+        seen += histogram->counts[index];
+        if (seen >= rank)
+        {
+            /* No value is reported beyond the largest seen */
+            ASUns64 value = LatencyValue (index);
+            if (value > histogram->largest)
+                value = histogram->largest;
+            return (value / 1000000.0);
+        }
+    }
+    return (histogram->largest / 1000000.0);
+}
+
+void ReportLatency (FILE *logFile, const char *name, LatencyHistogram *histogram)
+{
+    if (!histogram->total)
+        return;
+    fprintf (logFile, "  %s: p50 %0.5g, p90 %0.5g, p99 %0.5g, p99.9 %0.5g, max %0.5g seconds.\n", name,
+        LatencyPercentile (histogram, 50), LatencyPercentile (histogram, 90), LatencyPercentile (histogram, 99),
+        LatencyPercentile (histogram, 99.9), histogram->largest / 1000000.0);
+}
+
+void WriteLatencyStatistics (FILE *statFile, LatencyHistogram *histogram)
+{
+    fprintf (statFile, "|%0.5g|%0.5g|%0.5g|%0.5g|%0.5g",
+        LatencyPercentile (histogram, 50), LatencyPercentile (histogram, 90), LatencyPercentile (histogram, 99),
+        LatencyPercentile (histogram, 99.9), histogram->largest / 1000000.0);
+}
@@ -0,0 +1,64 @@
+/* Histograms of the time jobs take, so the tail of the times may be reported, and not only
+** the average.
+**
+** An average hides the few jobs which take many times as long as the rest, and those are the
+** jobs a service is judged by. So, as each job completes, it's wall time, CPU time, and queue
+** time are recorded in a histogram for it's type of job, and in one for the whole run. The 50th,
+** 90th, 99th and 99.9th percentiles, and the largest value, are written to the log, and those
+** of the whole run to the statistics file.
+**
+** The queue time of a job is the time from the pump releasing it (Queueing it for the pool
+** threads, or creating it's thread) until it starts.
+**
+** The histograms are laid out as HdrHistogram lays them out: values (in microseconds) below
+** LatencySubBuckets each have a count of their own, and above that each power of two is
+** split into LatencySubBuckets / 2 counts of equal width. So any value is known to within
+** 1 part in 64 (About 1.6%), from a microsecond to about 25 days, in a fixed array of counts.
+** The largest value is kept exactly.
+*/
+#ifndef LATENCY_HISTOGRAM_h
+#define LATENCY_HISTOGRAM_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+#define LatencySubBucketBits    7
+#define LatencySubBuckets       (1 << LatencySubBucketBits)
+#define LatencyShifts           34                  /* Powers of two above the sub buckets */
+#define LatencyCounts           (LatencySubBuckets + (LatencyShifts * (LatencySubBuckets / 2)))
+
+/* The times recorded for each job */
+typedef enum
+{
+    LatencyWall,
+    LatencyCPU,
+    LatencyQueue,
+    NumberOfLatencies
+} Latencies;
+
+typedef struct latencyHistogram
+{
+    ASUns64         counts[LatencyCounts];
+    ASUns64         total;                              /* Values recorded */
+    ASUns64         largest;                            /* Largest value recorded, in microseconds */
+} LatencyHistogram;
+
+/* A monotonic clock, in seconds. Every time taken in the run (Jobs, phases, sessions, samples,
+** traces and write behind) is read from this one, so that times taken in different threads,
+** and by different modules, may be compared.
+*/
+double LatencyClock ();
+
+/* Record a time, in seconds. Negative times are recorded as zero. */
+void RecordLatency (LatencyHistogram *histogram, double seconds);
+
+/* Return the time, in seconds, at or below which the percentage of values given fall */
+double LatencyPercentile (LatencyHistogram *histogram, double percentile);
+
+/* Write a line giving the percentiles, and largest value, of a histogram to the log */
+void ReportLatency (FILE *logFile, const char *name, LatencyHistogram *histogram);
+
+/* Write the percentiles, and largest value, of a histogram to the statistics file (Five columns) */
+void WriteLatencyStatistics (FILE *statFile, LatencyHistogram *histogram);
+
+#endif
@@ -0,0 +1,130 @@
+/* This is the loader for APDFL memory managers built on an allocator in a shared library
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. Here, those methods simply call
+** the entry points found in the allocator's library.
+**
+** The allocator's descriptor is passed to each method as the client data, so one
+** set of methods serves every loadable allocator.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "loadable_memory.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+static const char *libraryOverride = NULL;
+
+
+void *loadable_allocate (void *clientData, size_t size)
+{
+    return (((LoadableAllocator *)clientData)->mallocProc (size ? size : 1));
+}
+
+void *loadable_reallocate (void *clientData, void *pointer, size_t size)
+{
+    LoadableAllocator *allocator = (LoadableAllocator *)clientData;
+    if (!pointer)
+        return (allocator->mallocProc (size ? size : 1));
+    return (allocator->reallocProc (pointer, size ? size : 1));
+}
+
+void loadable_free (void *clientData, void *ptr)
+{
+    if (ptr)
+        ((LoadableAllocator *)clientData)->freeProc (ptr);
+    return;
+}
+
+size_t loadable_remaining (void *clientData)
+{
+    return (1024 * 1024 * 1024 * 1);
+}
+
+/* Find an entry point in the library loaded */
+static void *FindEntry (void *library, const char *entryName)
+{
+#ifdef WIN_PLATFORM
+    return ((void *)GetProcAddress ((HMODULE)library, entryName));
+#else
+    /* Looking up through the library's own handle finds the library's definition,
+    ** even where the same name (as with "malloc") is also defined by the C library.
+    */
+    return (dlsym (library, entryName));
+#endif
+}
+
+/* Load a library by name. It is loaded local, so it does not replace the C library's
+** allocator for the rest of the process.
+*/
+static void *LoadLibraryNamed (const char *libraryName)
+{
+#ifdef WIN_PLATFORM
+    return ((void *)LoadLibraryA (libraryName));
+#else
+    return (dlopen (libraryName, RTLD_NOW | RTLD_LOCAL));
+#endif
+}
+
+void loadable_set_library (const char *library)
+{
+    libraryOverride = library;
+}
+
+TKAllocatorProcs *loadable_access (LoadableAllocator *allocator)
+{
+    if (!allocator->tried)
+    {
+        allocator->tried = true;
+        allocator->description[0] = 0;
+
+        const char *overrideList[2] = { libraryOverride, NULL };
+        const char **names = libraryOverride ? overrideList : allocator->libraries;
+        const char *loadedName = NULL;
+        for (int index = 0; names[index] && !allocator->library; index++)
+        {
+            allocator->library = LoadLibraryNamed (names[index]);
+            loadedName = names[index];
+        }
+
+        if (!allocator->library)
+        {
+            sprintf (allocator->description, "The %s library (%s%s) could not be loaded.", allocator->name,
+                names[0], names[1] ? ", or it's alternates" : "");
+            return (NULL);
+        }
+
+        allocator->mallocProc = (LoadableMallocProc)FindEntry (allocator->library, allocator->mallocName);
+        allocator->reallocProc = (LoadableReallocProc)FindEntry (allocator->library, allocator->reallocName);
+        allocator->freeProc = (LoadableFreeProc)FindEntry (allocator->library, allocator->freeName);
+        if (!allocator->mallocProc || !allocator->reallocProc || !allocator->freeProc)
+        {
+            sprintf (allocator->description, "The %s library (%s) was loaded, but does not define %s, %s and %s.", allocator->name,
+                loadedName, allocator->mallocName, allocator->reallocName, allocator->freeName);
+            allocator->mallocProc = NULL;
+            return (NULL);
+        }
+
+        allocator->accessBlock.allocProc = loadable_allocate;
+        allocator->accessBlock.reallocProc = loadable_reallocate;
+        allocator->accessBlock.freeProc = loadable_free;
+        allocator->accessBlock.memAvailProc = loadable_remaining;
+        allocator->accessBlock.clientData = allocator;
+        sprintf (allocator->description, "The %s library was loaded from %s.", allocator->name, loadedName);
+    }
+
+    if (!allocator->mallocProc)
+        return (NULL);
+    return (&allocator->accessBlock);
+}
+
+const char *loadable_describe (LoadableAllocator *allocator)
+{
+    return (allocator->description);
+}
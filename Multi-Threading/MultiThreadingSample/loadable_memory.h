@@ -0,0 +1,54 @@
+/* This is the loader for APDFL memory managers built on an allocator in a shared library
+**
+** Allocators such as tcmalloc, jemalloc and mimalloc are not linked into the framework.
+** Instead, when one is selected, it's shared library is loaded at run time (dlopen, or
+** LoadLibrary on Windows), and the allocation, reallocation and free entry points
+** are found by name. These entry points fill in a TKAllocatorProcs block, as for any
+** other memory manager. So a new allocator may be evaluated without relinking, as long
+** as it's library can be found by the system loader (or is named with "MemoryManagerLibrary=").
+**
+** The library is loaded once, from the main line, before any APDFL library is started
+** (See InitializeAllMemoryManagers), and is never unloaded, as memory it allocated may
+** still be in use until the process ends.
+*/
+#ifndef LOADABLE_MEMORY_h
+#define LOADABLE_MEMORY_h
+#include "PDFInit.h"
+
+typedef void *(*LoadableMallocProc) (size_t size);
+typedef void *(*LoadableReallocProc) (void *pointer, size_t size);
+typedef void (*LoadableFreeProc) (void *pointer);
+
+/* Describes one allocator library, and holds what was found in it */
+typedef struct loadableAllocator
+{
+    const char         *name;               /* Name of the allocator, for messages */
+    const char         *libraries[6];       /* Library names to try, in order, ending with NULL */
+    const char         *mallocName;         /* Names of the entry points */
+    const char         *reallocName;
+    const char         *freeName;
+
+    bool                tried;              /* Filled in by the loader */
+    void               *library;
+    LoadableMallocProc  mallocProc;
+    LoadableReallocProc reallocProc;
+    LoadableFreeProc    freeProc;
+    TKAllocatorProcs    accessBlock;
+    char                description[4096];
+} LoadableAllocator;
+
+/* Load the allocator library (the first time only), and return the APDFL memory
+** manager interface for it. Returns NULL if the library, or any of it's entry points,
+** cannot be found. The first call must be made from the main line.
+*/
+TKAllocatorProcs *loadable_access (LoadableAllocator *allocator);
+
+/* Name a library to load in place of the allocator's usual library names ("MemoryManagerLibrary=").
+** Call this from the main line, before the first call to loadable_access.
+*/
+void loadable_set_library (const char *library);
+
+/* Return a description of the library loaded, or of why it could not be loaded */
+const char *loadable_describe (LoadableAllocator *allocator);
+
+#endif
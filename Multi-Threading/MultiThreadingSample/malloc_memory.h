@@ -13,6 +13,7 @@
 **
 ** To keep any usage information at all would require a mutex to protect updates to that information!
 ** I do not want to introduce a mutex for that here. So I iwllkeep no information.
+** (When "InstrumentMemory=true" is given, counts are kept, per thread, by the wrapper in instrumented_memory.h)
 */
 #ifndef MALLOC_MEMORY_h
 #define MALLOC_MEMORY_h
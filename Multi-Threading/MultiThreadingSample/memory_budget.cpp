@@ -0,0 +1,188 @@
+/* This is an APDFL memory manager which holds any other memory manager to a budget.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. It also contains a
+** reference to a method that indicates how much memory is available. Here, that
+** method is accurate: it is the budget, less the bytes in use.
+**
+** The client data is the MemoryBudget of the library instance. Each block is preceded
+** by a 16 byte header, holding it's size, and the account it was counted against,
+** so a block freed by another thread, or another library instance, is still taken
+** from the right account. Accounts are changed with atomic adds, not a mutex.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "memory_budget.h"
+#include "option_names.h"
+#include "wrapped_allocator.h"
+
+#define BudgetHeaderSize 16
+
+typedef struct budgetHeader
+{
+    size_t              size;
+    BudgetAccount      *account;
+} BudgetHeader;
+
+static const char *budgetScopeNames[NumberOfBudgetScopes] =
+{ "THREAD", "PROCESS" };
+
+static bool                 budgeting = false;
+static BudgetScopes         budgetScope = BudgetPerProcess;
+static ASInt64              budgetLimit = 0;
+static BudgetAccount        processAccount;
+
+/* Totals for the budgets of library instances, kept as each is released */
+static CSMutex              budgetLock;
+static int                  budgetsReleased = 0;
+static ASInt64              budgetHighWater = 0, budgetAvailableCalls = 0, budgetPressureCalls = 0;
+
+
+/* Count bytes against an account */
+static void BudgetCount (BudgetAccount *account, ASInt64 bytes)
+{
+    ASInt64 inUse = AtomicAdd64 (&account->inUse, bytes);
+    if (inUse > account->highWater)
+        account->highWater = inUse;
+}
+
+void *budget_allocate (void *clientData, size_t size)
+{
+    MemoryBudget *budget = (MemoryBudget *)clientData;
+    BudgetHeader *header = (BudgetHeader *)WrappedAllocate (budget->wrapped, size + BudgetHeaderSize);
+    if (!header)
+        return (NULL);
+    header->size = size;
+    header->account = budget->account;
+    BudgetCount (budget->account, size);
+    return (((char *)header) + BudgetHeaderSize);
+}
+
+void *budget_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (budget_allocate (clientData, size));
+
+    MemoryBudget *budget = (MemoryBudget *)clientData;
+    BudgetHeader *header = (BudgetHeader *)(((char *)pointer) - BudgetHeaderSize);
+    size_t oldSize = header->size;
+    BudgetAccount *account = header->account;
+    header = (BudgetHeader *)WrappedReallocate (budget->wrapped, header, size + BudgetHeaderSize);
+    if (!header)
+        return (NULL);
+    header->size = size;
+    BudgetCount (account, (ASInt64)size - (ASInt64)oldSize);
+    return (((char *)header) + BudgetHeaderSize);
+}
+
+void budget_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    MemoryBudget *budget = (MemoryBudget *)clientData;
+    BudgetHeader *header = (BudgetHeader *)(((char *)ptr) - BudgetHeaderSize);
+    AtomicAdd64 (&header->account->inUse, -(ASInt64)header->size);
+    WrappedFree (budget->wrapped, header);
+    return;
+}
+
+size_t budget_remaining (void *clientData)
+{
+    BudgetAccount *account = ((MemoryBudget *)clientData)->account;
+    ASInt64 remaining = account->limit - account->inUse;
+    AtomicAdd64 (&account->availableCalls, 1);
+    if (remaining < (account->limit / 10))
+        AtomicAdd64 (&account->pressureCalls, 1);
+    return (remaining > 0 ? (size_t)remaining : 0);
+}
+
+
+bool InitializeMemoryBudget (attributes *FrameAttributes)
+{
+    budgeting = FrameAttributes->IsKeyPresent ("MemoryBudget");
+    budgetLimit = (ASInt64)FrameAttributes->GetKeyValueInt ("MemoryBudget") * 1024 * 1024;
+
+    budgetScope = BudgetPerProcess;
+    if (FrameAttributes->IsKeyPresent ("MemoryBudgetScope"))
+    {
+        budgetScope = (BudgetScopes)OptionIndex (FrameAttributes->GetKeyValue ("MemoryBudgetScope")->value (0), budgetScopeNames, NumberOfBudgetScopes);
+        if (budgetScope == NumberOfBudgetScopes)
+        {
+            budgetScope = BudgetPerProcess;
+            return (false);
+        }
+    }
+
+    memset (&processAccount, 0, sizeof (BudgetAccount));
+    processAccount.limit = budgetLimit;
+    InitCS (budgetLock);
+    return (true);
+}
+
+bool UsingMemoryBudget ()
+{
+    return (budgeting);
+}
+
+bool MemoryBudgetInUse (ASInt64 *inUse)
+{
+    if (!budgeting || budgetScope != BudgetPerProcess)
+        return (false);
+    *inUse = processAccount.inUse;
+    return (true);
+}
+
+TKAllocatorProcs *BudgetedAllocator (TKAllocatorProcs *allocator, MemoryBudget *budget)
+{
+    memset (budget, 0, sizeof (MemoryBudget));
+    if (!budgeting)
+        return (allocator);
+
+    budget->wrapped = allocator;
+    budget->ownAccount.limit = budgetLimit;
+    budget->account = (budgetScope == BudgetPerThread) ? &budget->ownAccount : &processAccount;
+    budget->procs.allocProc = budget_allocate;
+    budget->procs.reallocProc = budget_reallocate;
+    budget->procs.freeProc = budget_free;
+    budget->procs.memAvailProc = budget_remaining;
+    budget->procs.clientData = budget;
+    return (&budget->procs);
+}
+
+void ReleaseMemoryBudget (MemoryBudget *budget)
+{
+    if (!budgeting || (budget->account != &budget->ownAccount))
+        return;
+
+    EnterCS (budgetLock);
+    budgetsReleased++;
+    if (budget->ownAccount.highWater > budgetHighWater)
+        budgetHighWater = budget->ownAccount.highWater;
+    budgetAvailableCalls += budget->ownAccount.availableCalls;
+    budgetPressureCalls += budget->ownAccount.pressureCalls;
+    LeaveCS (budgetLock);
+}
+
+void ReportMemoryBudget (FILE *logFile)
+{
+    if (!budgeting)
+        return;
+
+    double megabyte = 1024.0 * 1024.0;
+    if (budgetScope == BudgetPerProcess)
+        fprintf (logFile, "Memory budget: %0.5g MB for the process. The highest use was %0.5g MB. APDFL asked for the memory available %01lld times, %01lld of them with less than a tenth of the budget left.\n",
+            budgetLimit / megabyte, processAccount.highWater / megabyte,
+            (long long)processAccount.availableCalls, (long long)processAccount.pressureCalls);
+    else
+        fprintf (logFile, "Memory budget: %0.5g MB for each of %01d libraries. The highest use by one was %0.5g MB. APDFL asked for the memory available %01lld times, %01lld of them with less than a tenth of the budget left.\n",
+            budgetLimit / megabyte, budgetsReleased, budgetHighWater / megabyte,
+            (long long)budgetAvailableCalls, (long long)budgetPressureCalls);
+}
+
+void FinalizeMemoryBudget ()
+{
+    DestroyCS (budgetLock);
+}
@@ -0,0 +1,80 @@
+/* This is an APDFL memory manager which holds any other memory manager to a budget.
+**
+** When "MemoryBudget=" is given (in megabytes), the allocator APDFL is started with is
+** wrapped by this one. Each block is given a small header holding it's size and the
+** budget it is counted against, and the bytes in use are tracked exactly, as blocks
+** are allocated, reallocated and freed (by any thread).
+**
+** APDFL asks how much memory is available (memAvailProc) to decide when to trim it's
+** caches. Here, the answer is the budget less the bytes in use, so APDFL purges it's
+** caches as the budget is approached. Allocations beyond the budget are still made,
+** so a job is never failed by the budget, only made to use less cache.
+**
+** A block is taken from the account it was counted against when it is freed, so with
+** a budget for each thread, a library instance's blocks must all be freed before that
+** instance is terminated (as APDFL does).
+**
+** "MemoryBudgetScope=" may be thread or process. Default is process.
+**   thread     Each library instance (so each thread which starts a library) has a budget of it's own.
+**   process    All library instances share a single budget.
+*/
+#ifndef MEMORY_BUDGET_h
+#define MEMORY_BUDGET_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* The scopes a budget may have */
+typedef enum budgetScopes
+{
+    BudgetPerThread,                /* A budget for each library instance (MemoryBudgetScope=thread) */
+    BudgetPerProcess,               /* One budget for all (MemoryBudgetScope=process) */
+    NumberOfBudgetScopes
+} BudgetScopes;
+
+/* The bytes counted against a budget */
+typedef struct budgetAccount
+{
+    volatile ASInt64    inUse;                          /* Bytes in use. Changed only with AtomicAdd64 */
+    ASInt64             limit;                          /* The budget, in bytes */
+    ASInt64             highWater;                      /* Highest value of inUse (Kept without a lock, so approximate) */
+    volatile ASInt64    availableCalls;                 /* Times APDFL asked for the memory available */
+    volatile ASInt64    pressureCalls;                  /* Times less than a tenth of the budget was left */
+} BudgetAccount;
+
+/* The wrapper used by one library instance */
+typedef struct memoryBudget
+{
+    TKAllocatorProcs    procs;                          /* The interface given to APDFL */
+    TKAllocatorProcs   *wrapped;                        /* The allocator wrapped, NULL if APDFL's own */
+    BudgetAccount      *account;                        /* The account counted against */
+    BudgetAccount       ownAccount;                     /* The instance's account, for MemoryBudgetScope=thread */
+} MemoryBudget;
+
+/* Read "MemoryBudget=" and "MemoryBudgetScope=". Call this once, from the main line,
+** before any library is started. Returns false if the scope given is not known.
+*/
+bool InitializeMemoryBudget (attributes *FrameAttributes);
+
+/* True if a budget was given */
+bool UsingMemoryBudget ();
+
+/* Return the bytes in use by all libraries, when the budget is for the process. Returns false otherwise. */
+bool MemoryBudgetInUse (ASInt64 *inUse);
+
+/* Return the allocator a library should be started with: the budget wrapper, built in the
+** block given (which must last as long as the library) when a budget was given, otherwise
+** the allocator given.
+*/
+TKAllocatorProcs *BudgetedAllocator (TKAllocatorProcs *allocator, MemoryBudget *budget);
+
+/* Add the use of a library instance's budget to the totals for the run, after the library is terminated */
+void ReleaseMemoryBudget (MemoryBudget *budget);
+
+/* Write lines describing the use of the budget to the log */
+void ReportMemoryBudget (FILE *logFile);
+
+/* Release the budget's mutex, after all libraries are terminated */
+void FinalizeMemoryBudget ();
+
+#endif
@@ -0,0 +1,36 @@
+/* This is an APDFL memory manager built using mimalloc, loaded at run time
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. It also contains a
+** reference to a method that may indicate how much memory is available
+** to be allocated. Generally, that last method is not accurately set.
+** When it indicates a lower amount, it triggers cache cleanup.
+**
+** mimalloc is not linked into the framework.
+** The library is loaded, and it's entry points found, by the loader in loadable_memory.cpp.
+*/
+#include "mimalloc_memory.h"
+
+static LoadableAllocator mimalloc_allocator =
+{
+    "mimalloc",
+#ifdef WIN_PLATFORM
+    { "mimalloc.dll", "mimalloc-override.dll", NULL },
+#elif defined(MAC_PLATFORM)
+    { "libmimalloc.2.dylib", "libmimalloc.dylib", NULL },
+#else
+    { "libmimalloc.so.2", "libmimalloc.so", NULL },
+#endif
+    "mi_malloc", "mi_realloc", "mi_free"
+};
+
+TKAllocatorProcs *mimalloc_access ()
+{
+    return (loadable_access (&mimalloc_allocator));
+}
+
+const char *mimalloc_describe ()
+{
+    return (loadable_describe (&mimalloc_allocator));
+}
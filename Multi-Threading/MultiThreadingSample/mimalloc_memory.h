@@ -0,0 +1,22 @@
+/* This is an APDFL memory manager built using mimalloc, loaded at run time
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. It also contains a
+** reference to a method that may indicate how much memory is available
+** to be allocated. Generally, that last method is not accurately set.
+** When it indicates a lower amount, it triggers cache cleanup.
+**
+** mimalloc is not linked into the framework.
+** The library is loaded, and it's entry points found, by the loader in loadable_memory.cpp.
+*/
+#ifndef MIMALLOC_MEMORY_h
+#define MIMALLOC_MEMORY_h
+#include "PDFInit.h"
+#include "loadable_memory.h"
+
+TKAllocatorProcs *mimalloc_access ();        /* Call this method to acquire an APDFL memory Manager Interface (NULL if mimalloc cannot be loaded) */
+
+const char *mimalloc_describe ();            /* Describes the library loaded, or why it could not be loaded */
+
+#endif
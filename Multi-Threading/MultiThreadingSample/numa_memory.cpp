@@ -0,0 +1,312 @@
+/* This is an APDFL memory manager which keeps each library instance's memory on the NUMA node
+** of the processor it's thread runs on.
+**
+** The memory manager itself is an arena (arena_create_on_node), which takes it's chunks from
+** numa_node_allocate. This file finds the nodes and their processors, pins threads, maps memory
+** on a node, and counts where pages are placed.
+**
+** On Linux, the nodes are found in /sys/devices/system/node, and memory is bound with the mbind
+** system call, and checked with move_pages, so libnuma is not needed. The policy is "preferred",
+** so that a node which is full spills to another, rather than failing the allocation.
+** On Windows, the nodes are found with GetNumaProcessorNode, and memory is mapped with
+** VirtualAllocExNuma. Elsewhere, there is one node.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "numa_memory.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define NumaMaxProcessors   1024
+#define NumaPolicyPreferred 1               /* MPOL_PREFERRED */
+#define NumaPageSample      16              /* Check one page in this many, in each region */
+
+static int                  numaNodes = 1;
+static int                  numaProcessors = 0;
+static int                  processorNode[NumaMaxProcessors];
+static int                  pinOrder[NumaMaxProcessors];    /* Processors, taking each node in turn */
+static bool                 pinning = false;
+
+/* Counts, for the report at the end of the run */
+static CSMutex              numaLock;
+static volatile ASInt64     threadsPinned = 0;
+static volatile ASInt64     threadsNotPinned = 0;       /* Threads the system would not pin */
+static volatile ASInt64     regionsMapped[NumaMaxNodes];
+static ASUns64              pagesLocal = 0, pagesRemote = 0, pagesUntouched = 0;
+static ASUns64              startLocal = 0, startOther = 0;
+
+
+#ifdef __linux__
+/* Parse a list of processors (as "0-3,8-11"), and note the node of each */
+static void ParseProcessorList (char *list, int node)
+{
+    char *next = list;
+    while (*next)
+    {
+        int first = (int)strtol (next, &next, 10), last = first;
+        if (*next == '-')
+            last = (int)strtol (next + 1, &next, 10);
+        for (int processor = first; processor <= last && processor < NumaMaxProcessors; processor++)
+        {
+            processorNode[processor] = node;
+            if (processor >= numaProcessors)
+                numaProcessors = processor + 1;
+        }
+        if (*next != ',')
+            break;
+        next++;
+    }
+}
+
+/* Total the system's counts of pages allocated on the node the allocating thread ran on, and on others */
+static void ReadNumaStat (ASUns64 *local, ASUns64 *other)
+{
+    *local = *other = 0;
+    for (int node = 0; node < numaNodes; node++)
+    {
+        char name[128], line[128];
+        sprintf (name, "/sys/devices/system/node/node%01d/numastat", node);
+        FILE *file = fopen (name, "r");
+        if (!file)
+            continue;
+        while (fgets (line, sizeof (line), file))
+        {
+            unsigned long long value = 0;
+            if (sscanf (line, "local_node %llu", &value) == 1)
+                *local += value;
+            else if (sscanf (line, "other_node %llu", &value) == 1)
+                *other += value;
+        }
+        fclose (file);
+    }
+}
+#endif
+
+/* Find the nodes, and the node of each processor */
+static void FindNodes ()
+{
+    memset (processorNode, 0, sizeof (processorNode));
+    numaNodes = 1;
+    numaProcessors = 0;
+
+#ifdef WIN_PLATFORM
+    ULONG highest = 0;
+    GetNumaHighestNodeNumber (&highest);
+    numaNodes = (int)highest + 1;
+    SYSTEM_INFO info;
+    GetSystemInfo (&info);
+    numaProcessors = (int)info.dwNumberOfProcessors;
+    for (int processor = 0; processor < numaProcessors && processor < 64; processor++)
+    {
+        UCHAR node = 0;
+        GetNumaProcessorNode ((UCHAR)processor, &node);
+        processorNode[processor] = node;
+    }
+#else
+#ifdef __linux__
+    for (int node = 0; node < NumaMaxNodes; node++)
+    {
+        char name[128], list[1024];
+        sprintf (name, "/sys/devices/system/node/node%01d/cpulist", node);
+        FILE *file = fopen (name, "r");
+        if (!file)
+            continue;
+        if (fgets (list, sizeof (list), file))
+            ParseProcessorList (list, node);
+        fclose (file);
+        if (node >= numaNodes)
+            numaNodes = node + 1;
+    }
+#endif
+    if (!numaProcessors)
+        numaProcessors = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+    if (numaProcessors > NumaMaxProcessors)
+        numaProcessors = NumaMaxProcessors;
+    if (numaNodes > NumaMaxNodes)
+        numaNodes = NumaMaxNodes;
+
+    /* Order the processors so that successive threads go to successive nodes */
+    int ordered = 0;
+    for (int round = 0; ordered < numaProcessors; round++)
+        for (int node = 0; node < numaNodes; node++)
+        {
+            int seen = 0;
+            for (int processor = 0; processor < numaProcessors; processor++)
+                if (processorNode[processor] == node && seen++ == round)
+                {
+                    pinOrder[ordered++] = processor;
+                    break;
+                }
+        }
+}
+
+
+void numa_master_initialize (attributes *FrameAttributes, bool pin)
+{
+    InitCS (numaLock);
+    FindNodes ();
+    pinning = pin || FrameAttributes->GetKeyValueBool ("PinThreads");
+#ifdef __linux__
+    ReadNumaStat (&startLocal, &startOther);
+#endif
+}
+
+void numa_master_finalize ()
+{
+    DestroyCS (numaLock);
+}
+
+void numa_pin_thread (int threadNumber)
+{
+    if (!pinning || numaProcessors < 1)
+        return;
+
+    int processor = pinOrder[threadNumber % numaProcessors];
+    bool pinned = false;
+#ifdef WIN_PLATFORM
+    if (processor < 64)
+        pinned = SetThreadAffinityMask (GetCurrentThread (), ((DWORD_PTR)1) << processor) != 0;
+#else
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    CPU_SET (processor, &set);
+    pinned = sched_setaffinity (0, sizeof (set), &set) == 0;
+#endif
+#endif
+    if (pinned)
+        AtomicAdd64 (&threadsPinned, 1);
+    else
+        AtomicAdd64 (&threadsNotPinned, 1);
+}
+
+bool numa_pinning ()
+{
+    return (pinning);
+}
+
+int numa_current_node ()
+{
+    int processor = 0;
+#ifdef WIN_PLATFORM
+    processor = (int)GetCurrentProcessorNumber ();
+#else
+#ifdef __linux__
+    processor = sched_getcpu ();
+#endif
+#endif
+    if (processor < 0 || processor >= numaProcessors)
+        return (0);
+    return (processorNode[processor]);
+}
+
+void *numa_node_allocate (size_t size, int node)
+{
+    if (node < 0 || node >= NumaMaxNodes)
+        node = 0;
+    AtomicAdd64 (&regionsMapped[node], 1);
+
+#ifdef WIN_PLATFORM
+    return (VirtualAllocExNuma (GetCurrentProcess (), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)node));
+#else
+    void *region = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return (NULL);
+#ifdef __linux__
+    /* Bind before the first touch, so the pages are placed on the node whichever thread touches them */
+    unsigned long mask = 1UL << node;
+    syscall (SYS_mbind, region, size, NumaPolicyPreferred, &mask, (unsigned long)NumaMaxNodes + 1, 0);
+#endif
+    return (region);
+#endif
+}
+
+void numa_node_free (void *pointer, size_t size)
+{
+#ifdef WIN_PLATFORM
+    VirtualFree (pointer, 0, MEM_RELEASE);
+#else
+    munmap (pointer, size);
+#endif
+}
+
+void numa_count_pages (void *pointer, size_t size, int node)
+{
+#ifdef __linux__
+    size_t pageSize = (size_t)sysconf (_SC_PAGESIZE);
+    size_t count = (size / pageSize + NumaPageSample - 1) / NumaPageSample;
+    if (!count)
+        return;
+
+    void **pages = (void **)malloc (count * sizeof (void *));
+    int *status = (int *)malloc (count * sizeof (int));
+    for (size_t index = 0; index < count; index++)
+        pages[index] = ((char *)pointer) + (index * NumaPageSample * pageSize);
+
+    /* With no nodes given, move_pages moves nothing, and returns the node of each page */
+    ASUns64 local = 0, remote = 0, untouched = 0;
+    if (syscall (SYS_move_pages, 0, count, pages, NULL, status, 0) == 0)
+        for (size_t index = 0; index < count; index++)
+        {
+            if (status[index] < 0)
+                untouched++;
+            else if (status[index] == node)
+                local++;
+            else
+                remote++;
+        }
+    free (pages);
+    free (status);
+
+    EnterCS (numaLock);
+    pagesLocal += local;
+    pagesRemote += remote;
+    pagesUntouched += untouched;
+    LeaveCS (numaLock);
+#endif
+}
+
+void numa_report (FILE *logFile)
+{
+    fprintf (logFile, "NUMA: %01d nodes, %01d processors. %01lld threads were pinned.\n", numaNodes, numaProcessors, (long long)threadsPinned);
+    if (threadsNotPinned)
+        fprintf (logFile, "NUMA: %01lld threads could not be pinned, and ran where the system placed them.\n", (long long)threadsNotPinned);
+
+    bool mapped = false;
+    for (int node = 0; node < numaNodes; node++)
+        if (regionsMapped[node])
+        {
+            if (!mapped)
+                fprintf (logFile, "NUMA: regions mapped for arenas, by node:");
+            fprintf (logFile, " %01d: %01lld", node, (long long)regionsMapped[node]);
+            mapped = true;
+        }
+    if (mapped)
+        fprintf (logFile, ".\n");
+
+    ASUns64 checked = pagesLocal + pagesRemote;
+    if (checked)
+        fprintf (logFile, "NUMA: of the arena pages checked, %01llu were on the arena's node, and %01llu (%0.3g%%) were remote. %01llu were never touched.\n",
+            (unsigned long long)pagesLocal, (unsigned long long)pagesRemote, (pagesRemote * 100.0) / checked, (unsigned long long)pagesUntouched);
+
+#ifdef __linux__
+    ASUns64 local, other;
+    ReadNumaStat (&local, &other);
+    local -= startLocal;
+    other -= startOther;
+    if (local + other)
+        fprintf (logFile, "NUMA: the system allocated %01llu pages on the node of the thread asking, and %01llu (%0.3g%%) on another node, during the run.\n",
+            (unsigned long long)local, (unsigned long long)other, (other * 100.0) / (local + other));
+#endif
+}
@@ -0,0 +1,63 @@
+/* This is an APDFL memory manager which keeps each library instance's memory on the NUMA node
+** of the processor it's thread runs on.
+**
+** On a host with more than one NUMA node (socket), memory is fastest to reach from the
+** processors of the node it is on. A library instance whose heap is on another node pays
+** for the remote access on every allocation, and every touch of a page it draws or parses.
+**
+** "PinThreads=true" pins each worker thread (or pool thread) to a processor, chosen from it's
+** number so that successive threads go to successive nodes. Then, whatever memory manager is
+** used, the pages a thread touches first are placed on it's own node.
+**
+** "MemoryManager=numa" gives each library instance an arena (See arena_memory.h), created on
+** the node of the processor it's thread is pinned to. The arena is the client data of the
+** TKAllocatorProcs block APDFL is given, and every chunk of it is mapped, and bound to that
+** node (mbind on Linux, VirtualAllocExNuma on Windows), so it's pages are local whichever
+** thread touches them first. The numa memory manager pins threads, whether or not
+** "PinThreads=true" is given.
+**
+** The log shows the placement of the pages of each numa arena, checked as it is released,
+** and (on Linux) the system's counts of pages allocated on the node a thread ran on, and on
+** other nodes, during the run. So the remote ratio of a run may be compared with, and without,
+** pinning and numa arenas.
+*/
+#ifndef NUMA_MEMORY_h
+#define NUMA_MEMORY_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+#define NumaMaxNodes        64              /* Nodes beyond this are treated as node 0 */
+
+/* Find the NUMA nodes, and their processors, and read "PinThreads=". Threads are pinned when
+** it is true, or when pin is true (as it is when the numa memory manager is selected).
+** Call this once, from the main line, before any worker thread is started.
+*/
+void numa_master_initialize (attributes *FrameAttributes, bool pin);
+
+/* Call this interface from the mainline, after all libraries are terminated */
+void numa_master_finalize ();
+
+/* Pin the calling thread to a processor, chosen from it's number, when threads are pinned.
+** A thread the system will not pin (as when the processor is outside the process's allowed
+** set) runs unpinned, and is counted in the report.
+*/
+void numa_pin_thread (int threadNumber);
+
+/* True if threads are pinned */
+bool numa_pinning ();
+
+/* Return the NUMA node of the processor the calling thread is running on */
+int numa_current_node ();
+
+/* Map memory, bound to a node, and release it. The size must be given to release it. */
+void *numa_node_allocate (size_t size, int node);
+void numa_node_free (void *pointer, size_t size);
+
+/* Count the pages of a region which are on the node given, and on other nodes, for the report */
+void numa_count_pages (void *pointer, size_t size, int node);
+
+/* Write lines describing the placement of threads and memory to the log */
+void numa_report (FILE *logFile);
+
+#endif
@@ -0,0 +1,25 @@
+/* Options whose value names one of a set of choices.
+**
+** The value is compared a character at a time, so a value of any length may be given.
+*/
+
+#include <ctype.h>
+#include "option_names.h"
+
+bool OptionIs (const char *value, const char *choice)
+{
+    while (*value && toupper ((unsigned char)*value) == *choice)
+    {
+        value++;
+        choice++;
+    }
+    return (!*value && !*choice);
+}
+
+int OptionIndex (const char *value, const char *const *choices, int count)
+{
+    for (int index = 0; index < count; index++)
+        if (OptionIs (value, choices[index]))
+            return (index);
+    return (count);
+}
@@ -0,0 +1,14 @@
+/* Options whose value names one of a set of choices, such as "OutputSink=memory".
+**
+** The names of the choices are kept in upper case, and a value names one whatever it's case.
+*/
+#ifndef OPTION_NAMES_h
+#define OPTION_NAMES_h
+
+/* True if the value names the choice given */
+bool OptionIs (const char *value, const char *choice);
+
+/* Return the index of the choice the value names, or count if it names none of them */
+int OptionIndex (const char *value, const char *const *choices, int count);
+
+#endif
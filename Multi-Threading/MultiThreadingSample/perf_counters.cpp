@@ -0,0 +1,225 @@
+/* Hardware performance counters for each job.
+**
+** Each counter is opened on it's own, not as a group, so that one the host cannot count
+** (Often the cache misses, in a virtual machine) does not stop the others being read.
+** The counters are opened as each job starts, and closed as it ends, so a pool thread
+** holds none between jobs. That is a dozen system calls a job, which is nothing beside
+** the work of a job.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *counterNames[NumberOfCounters] = { "cycles", "instructions", "cache misses", "branch misses",
+                                                      "context switches", "migrations" };
+
+static bool                     countingPerf = false;
+static bool                     counterAvailable[NumberOfCounters];
+
+/* The pages closed by the job running in this thread */
+static ThreadLocal bool         threadCounting = false;
+static ThreadLocal ASUns64      threadPages = 0;
+
+
+#ifdef __linux__
+/* The event of each counter */
+static const ASUns32 counterTypes[NumberOfCounters] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                         PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE };
+static const ASUns64 counterEvents[NumberOfCounters] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                                                         PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS };
+
+/* Count only user time, for the counters where kernel time may not be counted */
+static bool                     counterUserOnly[NumberOfCounters];
+
+/* The counters open on the job running in this thread, -1 where not open */
+static ThreadLocal int          threadCounters[NumberOfCounters];
+
+/* Open a counter on the calling thread, counting from now. Returns -1 (With errno set) if it cannot be. */
+static int OpenCounter (int counter, bool userOnly)
+{
+    struct perf_event_attr attr;
+    memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = counterTypes[counter];
+    attr.config = counterEvents[counter];
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = userOnly ? 1 : 0;
+    attr.exclude_hv = 1;
+    return ((int)syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+/* Read a counter, scaled up for any time it was not running, and close it. Returns false if it could not be read. */
+static bool ReadCounter (int fd, ASUns64 *value)
+{
+    ASUns64 readings[3];                                /* Value, time enabled, time running */
+    bool read = (::read (fd, readings, sizeof (readings)) == (ssize_t)sizeof (readings)) && readings[2];
+    close (fd);
+    if (!read)
+        return (false);
+    if (readings[2] < readings[1])
+        readings[0] = (ASUns64)((readings[0] * 1.0 * readings[1]) / readings[2]);
+    *value = readings[0];
+    return (true);
+}
+#endif
+
+
+bool InitializePerfCounters (attributes *FrameAttributes, FILE *logFile)
+{
+    countingPerf = false;
+    if (!FrameAttributes->GetKeyValueBool ("PerfCounters"))
+        return (false);
+
+#ifdef __linux__
+    for (int counter = 0; counter < NumberOfCounters; counter++)
+    {
+        counterUserOnly[counter] = false;
+        int fd = OpenCounter (counter, false);
+        if (fd < 0 && (errno == EACCES || errno == EPERM))
+        {
+            counterUserOnly[counter] = true;
+            fd = OpenCounter (counter, true);
+        }
+        counterAvailable[counter] = (fd >= 0);
+        if (fd >= 0)
+        {
+            close (fd);
+            countingPerf = true;
+        }
+        else
+            fprintf (logFile, "  The performance counter for %s is not available (%s).\n", counterNames[counter], strerror (errno));
+    }
+    if (!countingPerf)
+    {
+        fprintf (logFile, "  No performance counter could be opened, so none will be read (See /proc/sys/kernel/perf_event_paranoid).\n\n");
+        return (false);
+    }
+    fprintf (logFile, "  We will read performance counters around the work of each job.\n\n");
+    return (true);
+#else
+    memset (counterAvailable, 0, sizeof (counterAvailable));
+    fprintf (logFile, "  Performance counters are only read on Linux, so none will be read.\n\n");
+    return (false);
+#endif
+}
+
+bool CountingPerf ()
+{
+    return (countingPerf);
+}
+
+void StartJobPerfCounters ()
+{
+    if (!countingPerf)
+        return;
+    threadPages = 0;
+    threadCounting = true;
+#ifdef __linux__
+    for (int counter = 0; counter < NumberOfCounters; counter++)
+        threadCounters[counter] = counterAvailable[counter] ? OpenCounter (counter, counterUserOnly[counter]) : -1;
+#endif
+}
+
+void TakeJobPerfCounters (PerfCounts *counts)
+{
+    memset (counts, 0, sizeof (PerfCounts));
+    if (!threadCounting)
+        return;
+    threadCounting = false;
+#ifdef __linux__
+    for (int counter = 0; counter < NumberOfCounters; counter++)
+        if (threadCounters[counter] >= 0 && ReadCounter (threadCounters[counter], &counts->values[counter]))
+            counts->counted[counter] = 1;
+#endif
+    counts->pages = threadPages;
+    counts->jobs = 1;
+}
+
+void NoteJobPages (ASInt32 pages)
+{
+    if (threadCounting && pages > 0)
+        threadPages += pages;
+}
+
+void AddPerfCounts (PerfCounts *total, PerfCounts *job)
+{
+    for (int counter = 0; counter < NumberOfCounters; counter++)
+    {
+        total->values[counter] += job->values[counter];
+        total->counted[counter] += job->counted[counter];
+    }
+    total->pages += job->pages;
+    total->jobs += job->jobs;
+}
+
+/* The count of a counter, over all the jobs in a total (Scaled up, where it was not read in some).
+** Returns -1 if it was read in none.
+*/
+static double CounterTotal (PerfCounts *total, int counter)
+{
+    if (!total->counted[counter])
+        return (-1);
+    return ((total->values[counter] * 1.0 * total->jobs) / total->counted[counter]);
+}
+
+void ReportPerfCounts (FILE *logFile, const char *name, PerfCounts *total)
+{
+    if (!countingPerf || !total->jobs)
+        return;
+
+    double cycles = CounterTotal (total, CounterCycles);
+    double instructions = CounterTotal (total, CounterInstructions);
+    double units = total->pages ? (double)total->pages : (double)total->jobs;
+    const char *unit = total->pages ? "page" : "job";
+
+    fprintf (logFile, "  %s:", name);
+    if (cycles > 0 && instructions >= 0)
+        fprintf (logFile, " %0.3g instructions per cycle.", instructions / cycles);
+    bool first = true;
+    for (int counter = CounterCycles; counter <= CounterBranchMisses; counter++)
+    {
+        double count = CounterTotal (total, counter);
+        if (count < 0 || counter == CounterInstructions)
+            continue;
+        if (first)
+            fprintf (logFile, " Per %s:", unit);
+        fprintf (logFile, "%s %0.4g %s", first ? "" : ",", count / units, counterNames[counter]);
+        first = false;
+    }
+    if (!first)
+        fprintf (logFile, ".");
+    first = true;
+    for (int counter = CounterContextSwitches; counter <= CounterMigrations; counter++)
+    {
+        double count = CounterTotal (total, counter);
+        if (count < 0)
+            continue;
+        fprintf (logFile, "%s %0.4g %s", first ? " Per job:" : ",", count / total->jobs, counterNames[counter]);
+        first = false;
+    }
+    if (!first)
+        fprintf (logFile, ".");
+    fprintf (logFile, " (%01llu pages in %01u jobs)\n", (unsigned long long)total->pages, (unsigned int)total->jobs);
+}
+
+void WritePerfStatistics (FILE *statFile, PerfCounts *total)
+{
+    if (!countingPerf)
+    {
+        fprintf (statFile, "||");
+        return;
+    }
+    double cycles = CounterTotal (total, CounterCycles);
+    double instructions = CounterTotal (total, CounterInstructions);
+    double misses = CounterTotal (total, CounterCacheMisses);
+    double units = total->pages ? (double)total->pages : (double)(total->jobs ? total->jobs : 1);
+    fprintf (statFile, "|%0.5g|%0.5g", (cycles > 0 && instructions >= 0) ? instructions / cycles : 0, (misses >= 0) ? misses / units : 0);
+}
@@ -0,0 +1,76 @@
+/* Hardware performance counters for each job.
+**
+** When adding threads stops making a run faster, the times alone do not say why. The counters
+** do: instructions per cycle falling, as threads are added, with last level cache misses per
+** page rising, says the threads are fighting over the cache, or the memory bandwidth behind it.
+** Context switches per job rising says they are blocked, on a lock or on I/O. Migrations say the
+** scheduler is moving them between processors.
+**
+** When "PerfCounters=true" is given, counters are opened (Linux perf_event_open) on the thread
+** running each job, around the worker's own work (Not the library start and end), for:
+**   cycles, instructions, last level cache misses, branch misses,
+**   context switches, and CPU migrations.
+** The pages of the documents each job closes (See CloseSampleFile) are counted, and the log
+** gives, for each type of worker, the instructions per cycle, and cycles and misses per page
+** (Per job, for workers which close no documents).
+**
+** Where a counter cannot be opened (No PMU in a virtual machine, perf_event_paranoid too high,
+** or not Linux), that counter is reported as not available, and the run goes on without it.
+** Kernel time is counted where it is allowed, and otherwise only user time is.
+** Where the kernel has had to share the counters out between events, the counts are scaled up
+** by the time each was running.
+*/
+#ifndef PERF_COUNTERS_h
+#define PERF_COUNTERS_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* The counters */
+typedef enum
+{
+    CounterCycles,
+    CounterInstructions,
+    CounterCacheMisses,
+    CounterBranchMisses,
+    CounterContextSwitches,
+    CounterMigrations,
+    NumberOfCounters
+} PerfCounterIDs;
+
+/* The counts of a job, or a total of jobs */
+typedef struct perfCounts
+{
+    ASUns64         values[NumberOfCounters];
+    ASUns32         counted[NumberOfCounters];          /* Jobs in which the counter was read */
+    ASUns64         pages;                              /* Pages of the documents closed */
+    ASUns32         jobs;
+} PerfCounts;
+
+/* Read "PerfCounters=", and find which counters may be opened. Call this once, from the main line,
+** before any thread is started. Returns true if any counter will be read.
+*/
+bool InitializePerfCounters (attributes *FrameAttributes, FILE *logFile);
+
+/* True when counters are being read */
+bool CountingPerf ();
+
+/* Open the counters on the calling thread, for the job starting in it */
+void StartJobPerfCounters ();
+
+/* Read, and close, the counters of the job ending in the calling thread */
+void TakeJobPerfCounters (PerfCounts *counts);
+
+/* Count the pages of a document closed by the job running in the calling thread */
+void NoteJobPages (ASInt32 pages);
+
+/* Add the counts of one job into a total */
+void AddPerfCounts (PerfCounts *total, PerfCounts *job);
+
+/* Write a line giving the counts, per cycle and per page, of a total of jobs to the log */
+void ReportPerfCounts (FILE *logFile, const char *name, PerfCounts *total);
+
+/* Write the instructions per cycle, and cache misses per page, to the statistics file (Two columns, empty when not counting) */
+void WritePerfStatistics (FILE *statFile, PerfCounts *total);
+
+#endif
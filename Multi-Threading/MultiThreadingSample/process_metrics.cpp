@@ -0,0 +1,127 @@
+/* The resources used by the run, and by each job.
+*/
+
+#include <string.h>
+#include "process_metrics.h"
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+
+#ifdef WIN_PLATFORM
+/* Seconds in a FILETIME interval */
+static double FileTimeSeconds (FILETIME *time)
+{
+    return ((*((ASUns64 *)time) * 1.0) / 10000000);
+}
+#else
+/* Copy the figures of getrusage */
+static void CopyUsage (ResourceUse *use, struct rusage *usage)
+{
+    use->user = usage->ru_utime.tv_sec + (usage->ru_utime.tv_usec / 1000000.0);
+    use->system = usage->ru_stime.tv_sec + (usage->ru_stime.tv_usec / 1000000.0);
+    use->voluntarySwitches = usage->ru_nvcsw;
+    use->involuntarySwitches = usage->ru_nivcsw;
+}
+#endif
+
+
+void ProcessResourceUse (ResourceUse *use)
+{
+    memset (use, 0, sizeof (ResourceUse));
+    use->wall = LatencyClock ();
+#ifdef WIN_PLATFORM
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes (GetCurrentProcess (), &created, &exited, &kernel, &user))
+    {
+        use->user = FileTimeSeconds (&user);
+        use->system = FileTimeSeconds (&kernel);
+    }
+#else
+    struct rusage usage;
+    if (getrusage (RUSAGE_SELF, &usage) == 0)
+        CopyUsage (use, &usage);
+#endif
+}
+
+void ThreadResourceUse (ResourceUse *use)
+{
+    memset (use, 0, sizeof (ResourceUse));
+    use->wall = LatencyClock ();
+#if defined (WIN_PLATFORM)
+    FILETIME created, exited, kernel, user;
+    if (GetThreadTimes (GetCurrentThread (), &created, &exited, &kernel, &user))
+    {
+        use->user = FileTimeSeconds (&user);
+        use->system = FileTimeSeconds (&kernel);
+    }
+#elif defined (RUSAGE_THREAD)
+    struct rusage usage;
+    if (getrusage (RUSAGE_THREAD, &usage) == 0)
+        CopyUsage (use, &usage);
+#else
+    /* Only the CPU time of a thread may be found here, and not how it divides */
+    struct timespec cpuTime;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+    use->user = cpuTime.tv_sec + ((cpuTime.tv_nsec * 1.0) / 1000000000.0);
+#endif
+
+#if defined (__linux__) && defined (SYS_gettid)
+    /* The second field of schedstat is the time runnable, waiting for a processor, in nanoseconds */
+    char schedstat[64];
+    sprintf (schedstat, "/proc/self/task/%01ld/schedstat", (long)syscall (SYS_gettid));
+    FILE *stats = fopen (schedstat, "r");
+    if (stats)
+    {
+        unsigned long long running = 0, waiting = 0;
+        if (fscanf (stats, "%llu %llu", &running, &waiting) == 2)
+            use->runDelay = waiting / 1000000000.0;
+        fclose (stats);
+    }
+#endif
+}
+
+void ResourceUsed (ResourceUse *used, ResourceUse *start, ResourceUse *end)
+{
+    used->wall = end->wall - start->wall;
+    used->user = end->user - start->user;
+    used->system = end->system - start->system;
+    used->voluntarySwitches = end->voluntarySwitches - start->voluntarySwitches;
+    used->involuntarySwitches = end->involuntarySwitches - start->involuntarySwitches;
+    used->runDelay = end->runDelay - start->runDelay;
+}
+
+void AddResourceUse (ResourceUse *total, ResourceUse *job)
+{
+    total->wall += job->wall;
+    total->user += job->user;
+    total->system += job->system;
+    total->voluntarySwitches += job->voluntarySwitches;
+    total->involuntarySwitches += job->involuntarySwitches;
+    total->runDelay += job->runDelay;
+}
+
+void ReportResourceUse (FILE *logFile, const char *name, ResourceUse *total, int jobs)
+{
+    if (!jobs)
+        return;
+    fprintf (logFile, "  %s: %0.5g seconds user, %0.5g seconds system CPU, %0.5g voluntary and %0.5g involuntary context switches, %0.5g seconds waiting for a processor.\n",
+        name, total->user / jobs, total->system / jobs, (total->voluntarySwitches * 1.0) / jobs, (total->involuntarySwitches * 1.0) / jobs,
+        total->runDelay / jobs);
+}
+
+void WriteResourceStatistics (FILE *statFile, ResourceUse *use)
+{
+    fprintf (statFile, "|%0.5g|%0.5g|%01llu|%01llu|%0.5g", use->user, use->system,
+        (unsigned long long)use->voluntarySwitches, (unsigned long long)use->involuntarySwitches, use->runDelay);
+}
@@ -0,0 +1,51 @@
+/* The resources used by the run, and by each job.
+**
+** The concurrency of a run is the CPU time it used over the wall time it took, so both must
+** be right. Wall time is read from the monotonic clock, which does not jump when the system
+** time is set. CPU time is read from getrusage (GetProcessTimes, on Windows), which counts the
+** threads which have ended too, and splits it into user and system time.
+**
+** CPU time alone does not say why a run is not faster. The context switches do: voluntary
+** ones are a thread blocking (On a lock, or I/O), and involuntary ones the scheduler taking
+** the processor away. On Linux, the scheduler also keeps the time each thread spent runnable,
+** but waiting for a processor (The run delay, in /proc/self/task/<thread>/schedstat). Where that
+** is large, there are more threads ready to run than processors to run them.
+**
+** A thread's figures are lost when it ends, so the run delay of the run is that of each job,
+** taken as it ends, and that of the pump. Where a figure cannot be found, it is zero.
+*/
+#ifndef PROCESS_METRICS_h
+#define PROCESS_METRICS_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+typedef struct resourceUse
+{
+    double          wall;                               /* Seconds, by the monotonic clock */
+    double          user;                               /* Seconds of CPU time, in user mode */
+    double          system;                             /* Seconds of CPU time, in the kernel */
+    ASUns64         voluntarySwitches;                  /* Context switches, waiting on something */
+    ASUns64         involuntarySwitches;                /* Context switches, made by the scheduler */
+    double          runDelay;                           /* Seconds runnable, waiting for a processor (Threads only) */
+} ResourceUse;
+
+/* Read the resources used so far by the process (All it's threads) */
+void ProcessResourceUse (ResourceUse *use);
+
+/* Read the resources used so far by the calling thread */
+void ThreadResourceUse (ResourceUse *use);
+
+/* The resources used from start to end */
+void ResourceUsed (ResourceUse *used, ResourceUse *start, ResourceUse *end);
+
+/* Add the resources used by a job into a total */
+void AddResourceUse (ResourceUse *total, ResourceUse *job);
+
+/* Write a line giving the resources used, on average, by a number of jobs, to the log */
+void ReportResourceUse (FILE *logFile, const char *name, ResourceUse *total, int jobs);
+
+/* Write the user and system CPU time, the context switches and the run delay to the statistics file (Five columns) */
+void WriteResourceStatistics (FILE *statFile, ResourceUse *use);
+
+#endif
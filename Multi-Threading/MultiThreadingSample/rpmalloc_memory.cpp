@@ -16,6 +16,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "rpmalloc_memory.h"
 #include "PDFInit.h"
 #include "MTHeader.h"
@@ -24,6 +25,17 @@
 
 static TKAllocatorProcs    rpmalloc_access_block;
 
+/* Thread statistics, totalled over every thread that ends.
+** These are updated as each thread ends, so they need a mutex.
+*/
+static CSMutex             rpmalloc_stats_lock;
+static int                 rpmalloc_threads = 0;
+static double              rpmalloc_thread_to_global = 0;
+static double              rpmalloc_global_to_thread = 0;
+static size_t              rpmalloc_largest_thread_cache = 0;
+static size_t              rpmalloc_largest_requested = 0;
+static size_t              rpmalloc_largest_allocated = 0;
+
 
 void *rpmalloc_allocate (void * cleintData, size_t size)
 {
@@ -60,6 +72,7 @@ TKAllocatorProcs *rpmalloc_access ()
 */
 void rpmalloc_master_initialize ()
 {
+    InitCS (rpmalloc_stats_lock);
     rpmalloc_initialize ();
 }
 
@@ -69,18 +82,59 @@ void rpmalloc_master_initialize ()
 void rpmalloc_master_finalize ()
 {
     rpmalloc_finalize ();
+    DestroyCS (rpmalloc_stats_lock);
 }
 
-/* Call this interface before APDFL initialization for each library initialized. */
+/* Call this interface in each thread, before APDFL is initialized in that thread. */
 void rpmalloc_init ()
 {
-    rpmalloc_thread_initialize ();
+    if (!rpmalloc_is_thread_initialized ())
+        rpmalloc_thread_initialize ();
 }
 
-/* Call this interface after APDFL termination, for each library terminated. */
+/* Call this interface in each thread, after APDFL is terminated in that thread. */
 void rpmalloc_term ()
 {
+    if (!rpmalloc_is_thread_initialized ())
+        return;
+
+    rpmalloc_thread_statistics_t stats;
+    memset (&stats, 0, sizeof (stats));
+    rpmalloc_thread_statistics (&stats);
+
+    EnterCS (rpmalloc_stats_lock);
+    rpmalloc_threads++;
+    rpmalloc_thread_to_global += stats.thread_to_global;
+    rpmalloc_global_to_thread += stats.global_to_thread;
+    if ((stats.sizecache + stats.spancache) > rpmalloc_largest_thread_cache)
+        rpmalloc_largest_thread_cache = stats.sizecache + stats.spancache;
+    if (stats.requested > rpmalloc_largest_requested)
+        rpmalloc_largest_requested = stats.requested;
+    if (stats.allocated > rpmalloc_largest_allocated)
+        rpmalloc_largest_allocated = stats.allocated;
+    LeaveCS (rpmalloc_stats_lock);
+
     rpmalloc_thread_finalize ();
 }
 
+/* Write rpmalloc's statistics to the log.
+** The mapped amounts, and the thread's requested and allocated amounts, are only
+** kept when rpmalloc.c is compiled with ENABLE_STATISTICS=1 (as the makefile does).
+*/
+void rpmalloc_report (FILE *logFile)
+{
+    rpmalloc_global_statistics_t global;
+    memset (&global, 0, sizeof (global));
+    rpmalloc_global_statistics (&global);
+
+    double megabyte = 1024.0 * 1024.0;
+    fprintf (logFile, "rpmalloc: %01d threads ended. %0.5g MB moved from thread caches to the global cache, and %0.5g MB back.\n",
+        rpmalloc_threads, rpmalloc_thread_to_global / megabyte, rpmalloc_global_to_thread / megabyte);
+    fprintf (logFile, "rpmalloc: the largest thread cache held %0.5g MB. The largest thread had %0.5g MB requested, in %0.5g MB allocated, as it ended.\n",
+        rpmalloc_largest_thread_cache / megabyte, rpmalloc_largest_requested / megabyte, rpmalloc_largest_allocated / megabyte);
+    fprintf (logFile, "rpmalloc: %0.5g MB mapped now, %0.5g MB mapped and %0.5g MB unmapped in all. Global caches hold %0.5g MB (%0.5g MB large).\n",
+        global.mapped / megabyte, global.mapped_total / megabyte, global.unmapped_total / megabyte,
+        (global.cached + global.cached_large) / megabyte, global.cached_large / megabyte);
+}
+
 #endif
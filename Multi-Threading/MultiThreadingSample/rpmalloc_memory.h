@@ -19,6 +19,7 @@
 
 #ifndef MAC_ENV
 
+#include <stdio.h>
 #include "PDFInit.h"
 #include "rpmalloc.h"
 
@@ -34,11 +35,18 @@ void rpmalloc_master_initialize ();
 */
 void rpmalloc_master_finalize ();
 
-/* Call this interface before APDFL initialization for each library initialized. */
+/* Call this interface in each thread, before APDFL is initialized in that thread. */
 void rpmalloc_init ();
 
-/* Call this interface after APDFL termination, for each library terminated. */
-void rpmalloc_finalize ();
+/* Call this interface in each thread, after APDFL is terminated in that thread.
+** The thread's statistics are added to the totals for the run, before it's caches are released.
+*/
+void rpmalloc_term ();
+
+/* Call this interface from the mainline, after all threads are complete, and before
+** rpmalloc_master_finalize, to write rpmalloc's global and thread statistics to the log.
+*/
+void rpmalloc_report (FILE *logFile);
 
 
 
@@ -0,0 +1,201 @@
+/* A time series of the run, sampled by a thread of it's own.
+**
+** The thread polls (as the soak monitor does), so it can be stopped promptly, and writes each
+** line as it is taken, so a run which fails still leaves it's series behind. The pump's counts
+** are read without a lock: a line may be a job behind, which does not matter here.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "run_sampler.h"
+#include "memory_budget.h"
+#include "instrumented_memory.h"
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+/* The sampling thread */
+typedef struct samplerThread
+{
+    SDKThreadID         threadID;
+    bool                threadCompleted;
+} SamplerThread;
+
+static int                      sampleInterval = 0;     /* Milliseconds, zero when not sampling */
+static FILE                    *sampleFile = NULL;
+static double                   sampleStart = 0;
+static double                   lastSeconds = 0;
+static int                      lastCompleted = 0;
+static volatile int             jobsCompleted = 0;
+static volatile int             jobsRunning = 0;
+static volatile bool            samplerStopping = false;
+static bool                     mallocLive = false;
+static SamplerThread            sampler;
+
+
+void SampleProcess (ProcessSample *sample)
+{
+    memset (sample, 0, sizeof (ProcessSample));
+
+#ifdef WIN_PLATFORM
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes (GetCurrentProcess (), &created, &exited, &kernel, &user))
+        sample->cpuSeconds = ((*((ASUns64 *)&kernel) + *((ASUns64 *)&user)) * 1.0) / 10000000;
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof (counters)))
+    {
+        sample->residentMB = counters.WorkingSetSize / (1024.0 * 1024.0);
+        sample->minorFaults = counters.PageFaultCount;
+    }
+#else
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    sample->cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ((usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0);
+    sample->minorFaults = usage.ru_minflt;
+    sample->majorFaults = usage.ru_majflt;
+    sample->contextSwitches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+    FILE *statm = fopen ("/proc/self/statm", "r");
+    if (statm)
+    {
+        unsigned long long size = 0, resident = 0;
+        if (fscanf (statm, "%llu %llu", &size, &resident) == 2)
+            sample->residentMB = (resident * (double)sysconf (_SC_PAGESIZE)) / (1024.0 * 1024.0);
+        fclose (statm);
+    }
+#endif
+
+    /* Malloc cannot see the memory other allocators keep, so it's figures are used only when
+    ** every library allocates from it.
+    */
+    ASInt64 inUse = 0;
+    if (MemoryBudgetInUse (&inUse) || InstrumentedInUse (&inUse))
+    {
+        sample->liveMB = inUse / (1024.0 * 1024.0);
+        sample->liveKnown = true;
+    }
+    else if (mallocLive)
+    {
+#if defined (__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 info = mallinfo2 ();
+        sample->liveMB = (info.uordblks + info.hblkhd) / (1024.0 * 1024.0);
+        sample->liveKnown = true;
+#elif defined (__GLIBC__)
+        struct mallinfo info = mallinfo ();
+        sample->liveMB = ((unsigned int)info.uordblks + (unsigned int)info.hblkhd) / (1024.0 * 1024.0);
+        sample->liveKnown = true;
+#endif
+    }
+}
+
+/* Write a line for the run as it is now */
+static void WriteSample ()
+{
+    ProcessSample sample;
+    SampleProcess (&sample);
+    double seconds = LatencyClock () - sampleStart;
+    int completed = jobsCompleted;
+    double rate = (seconds > lastSeconds) ? ((completed - lastCompleted) / (seconds - lastSeconds)) : 0;
+    lastSeconds = seconds;
+    lastCompleted = completed;
+
+    fprintf (sampleFile, "%0.3f,%01d,%0.5g,%01d,%0.5g,%0.5g,%01llu,%01llu,%01llu,",
+        seconds, completed, rate, (int)jobsRunning, sample.cpuSeconds, sample.residentMB,
+        (unsigned long long)sample.minorFaults, (unsigned long long)sample.majorFaults,
+        (unsigned long long)sample.contextSwitches);
+    if (sample.liveKnown)
+        fprintf (sampleFile, "%0.5g", sample.liveMB);
+    fprintf (sampleFile, "\n");
+    fflush (sampleFile);
+}
+
+/* The sampling thread. Write a line at each interval, until stopped */
+ThreadFuncReturnType runSampler (SamplerThread *thread)
+{
+    double next = LatencyClock () + (sampleInterval / 1000.0);
+    int nap = (sampleInterval < 100) ? 1 : 10;
+    while (!samplerStopping)
+    {
+        if (LatencyClock () >= next)
+        {
+            WriteSample ();
+            next += sampleInterval / 1000.0;
+        }
+        ThreadSleep (nap);
+    }
+    thread->threadCompleted = true;
+    return (0);
+}
+
+
+void InitializeSampler (attributes *FrameAttributes, FILE *logFile)
+{
+    sampleInterval = FrameAttributes->GetKeyValueInt ("SampleInterval");
+    if (sampleInterval <= 0)
+    {
+        sampleInterval = 0;
+        return;
+    }
+
+    const char *fileName = "samples.csv";
+    if (FrameAttributes->IsKeyPresent ("SampleFile"))
+        fileName = FrameAttributes->GetKeyValue ("SampleFile")->value (0);
+    sampleFile = fopen (fileName, "w");
+    if (!sampleFile)
+    {
+        fprintf (logFile, "  The sample file \"%s\" could not be opened, so the run will not be sampled.\n\n", fileName);
+        sampleInterval = 0;
+        return;
+    }
+    fprintf (sampleFile, "seconds,jobs,jobsPerSecond,running,cpuSeconds,residentMB,minorFaults,majorFaults,contextSwitches,liveMB\n");
+    CountProcessMemory ();
+    fprintf (logFile, "  We will sample the run every %01d milliseconds, into \"%s\".\n\n", sampleInterval, fileName);
+}
+
+void NoteMallocLive (bool live)
+{
+    mallocLive = live;
+}
+
+void StartSampler ()
+{
+    if (!sampleInterval)
+        return;
+    sampleStart = LatencyClock ();
+    lastSeconds = 0;
+    lastCompleted = 0;
+    samplerStopping = false;
+    memset (&sampler, 0, sizeof (sampler));
+    WriteSample ();
+    createThread (runSampler, sampler);
+}
+
+void StopSampler ()
+{
+    if (!sampleInterval)
+        return;
+    samplerStopping = true;
+    while (!sampler.threadCompleted)
+        ThreadSleep (1);
+    destroyThread ((&sampler));
+    WriteSample ();
+    fclose (sampleFile);
+    sampleFile = NULL;
+}
+
+void SamplerProgress (int completed, int running)
+{
+    jobsCompleted = completed;
+    jobsRunning = running;
+}
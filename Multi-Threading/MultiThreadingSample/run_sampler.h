@@ -0,0 +1,59 @@
+/* A time series of the run, sampled by a thread of it's own.
+**
+** The summary at the end of a run gives one figure for the whole of it. The bursts of a
+** "PauseEvery=" run, the storm of library starts as the first threads begin, and memory
+** which creeps up job after job, are all averaged away. A line every few milliseconds shows them.
+**
+** When "SampleInterval=" is given (In milliseconds), a thread writes a line of comma separated
+** values to "SampleFile=" (Default "samples.csv") at each interval, with these fields:
+**   seconds        since the pump started,
+**   jobs           completed,
+**   jobsPerSecond  completed since the last line,
+**   running        jobs running (Threads, or pool threads with a job),
+**   cpuSeconds     user and system CPU time of the process,
+**   residentMB     resident set size of the process,
+**   minorFaults, majorFaults  page faults taken by the process (All are minor, on Windows),
+**   contextSwitches           voluntary and involuntary (Zero on Windows),
+**   liveMB         bytes the libraries have in use: those counted against the budget, when
+**                  "MemoryBudget=" is given for the process, or those counted when "InstrumentMemory=true".
+**                  Otherwise, those malloc has in use, when every library allocates from malloc (The malloc
+**                  memory manager, or APDFL's own, without "LargeBuffers="), and glibc can say. Where the
+**                  bytes are not known (Another allocator keeps memory malloc cannot see), the field is empty.
+*/
+#ifndef RUN_SAMPLER_h
+#define RUN_SAMPLER_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* The state of the process at a moment. Fields which cannot be found are zero. */
+typedef struct processSample
+{
+    double          cpuSeconds;
+    double          residentMB;
+    double          liveMB;
+    bool            liveKnown;                          /* False when liveMB could not be found */
+    ASUns64         minorFaults;
+    ASUns64         majorFaults;
+    ASUns64         contextSwitches;
+} ProcessSample;
+
+/* Take a sample of the process (Used by the soak monitor too) */
+void SampleProcess (ProcessSample *sample);
+
+/* Read "SampleInterval=" and "SampleFile=". Call this once, from the main line, before any thread is started. */
+void InitializeSampler (attributes *FrameAttributes, FILE *logFile);
+
+/* Say whether every library in the run allocates from malloc, so that malloc's own figures are the
+** bytes live. Call this from the main line, once the memory managers of the run are known.
+*/
+void NoteMallocLive (bool mallocLive);
+
+/* Start and stop the thread which samples the run. Stopping writes a last line. */
+void StartSampler ();
+void StopSampler ();
+
+/* Call this from the pump whenever the jobs completed, or running, change */
+void SamplerProgress (int completed, int running);
+
+#endif
@@ -0,0 +1,333 @@
+/* This is an APDFL memory manager built from slabs of fixed size blocks.
+**
+** Memory management is accomplished through the APDFL interface element
+** TKAllocatorProcs. This structure identifies methods to be used for
+** allocating, reallocating, and freeing memory. 
+**
+** Slabs are 64K, and 64K aligned, so the slab a block belongs to is found by masking
+** the block's address. The first 64 bytes of each slab are it's header, giving the size
+** class of it's blocks. Every block in a slab is at a multiple of 64 bytes from the slab's
+** start.
+**
+** A large block is allocated with malloc, and placed 32 bytes past a 64 byte boundary,
+** where no block in a slab can be, so the low bits of it's address say it is large. It's
+** own header, just before it, holds the address malloc returned and it's size. Aligning
+** large blocks to the slab size instead would waste up to 64K on each.
+**
+** A free block holds the link to the next free block in it's first word, both in the
+** depot and while it is carried between the depot and a magazine.
+**
+** I can use the magazines without a mutex, because each thread has it's own!
+** The depot is shared by all threads, so it needs one.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "slab_memory.h"
+#include "MTHeader.h"
+#include "Probes.h"
+
+#define SlabSize            (64 * 1024)         /* Bytes in each slab, and it's alignment */
+#define SlabHeaderSize      64                  /* Bytes at the start of each slab */
+#define SlabClasses         19                  /* 64 byte classes up to 1K, then 2K, 4K and 8K */
+#define SlabLargestBlock    8192
+#define SlabBlockAlign      64                  /* Every block in a slab is at a multiple of this */
+#define SlabLargeOffset     32                  /* Where a large block is, past a multiple of SlabBlockAlign */
+#define SlabMagazineSize    64                  /* Most blocks in a thread's magazine, for each class */
+
+static const size_t slabClassSize[SlabClasses] =
+{ 64, 128, 192, 256, 320, 384, 448, 512, 576, 640, 704, 768, 832, 896, 960, 1024, 2048, 4096, 8192 };
+
+/* The header at the start of each slab */
+typedef struct slabHeader
+{
+    int                 sizeClass;              /* Class of the blocks */
+    struct slabHeader  *next;                   /* All slabs, for release at the end of the run */
+} SlabHeader;
+
+/* The header just before a large block */
+typedef struct slabLargeHeader
+{
+    void               *memory;                 /* The address malloc returned */
+    size_t              size;                   /* Size of the block */
+} SlabLargeHeader;
+
+/* A thread's free blocks of one class */
+typedef struct slabMagazine
+{
+    int                 count;
+    void               *blocks[SlabMagazineSize];
+} SlabMagazine;
+
+static struct slabDepot
+{
+    CSMutex             lock;
+    void               *freeBlocks[SlabClasses];        /* Free blocks, linked through their first word */
+    char               *carve[SlabClasses];             /* Space not yet made into blocks, in the newest slab of each class */
+    char               *carveEnd[SlabClasses];
+    SlabHeader         *slabs;
+
+    /* Usage counts, for the report at the end of the run */
+    ASUns64             slabCount, refills, flushes, largeCount, largeBytes;
+} slabDepot;
+
+static TKAllocatorProcs     slab_access_block;
+
+/* This thread's magazines, one for each class, made when the thread first allocates */
+static ThreadLocal SlabMagazine *threadMagazines = NULL;
+
+
+/* Allocate and free memory aligned to the slab size */
+static void *SlabAlignedAllocate (size_t size)
+{
+#ifdef WIN_PLATFORM
+    return (_aligned_malloc (size, SlabSize));
+#else
+    void *memory = NULL;
+    if (posix_memalign (&memory, SlabSize, size))
+        return (NULL);
+    return (memory);
+#endif
+}
+
+static void SlabAlignedFree (void *memory)
+{
+#ifdef WIN_PLATFORM
+    _aligned_free (memory);
+#else
+    free (memory);
+#endif
+}
+
+/* Return the size class for a size */
+static int SlabClass (size_t size)
+{
+    if (size <= 1024)
+        return (size ? (int)((size + 63) / 64) - 1 : 0);
+    if (size <= 2048)
+        return (16);
+    if (size <= 4096)
+        return (17);
+    return (18);
+}
+
+/* True if a block is large, rather than in a slab */
+static bool SlabIsLarge (void *block)
+{
+    return ((((size_t)block) & (SlabBlockAlign - 1)) == SlabLargeOffset);
+}
+
+/* Return the header of a large block */
+static SlabLargeHeader *SlabLargeOf (void *block)
+{
+    return (((SlabLargeHeader *)block) - 1);
+}
+
+/* Return the header of the slab holding a block */
+static SlabHeader *SlabOf (void *block)
+{
+    return ((SlabHeader *)(((size_t)block) & ~((size_t)(SlabSize - 1))));
+}
+
+/* Fill a magazine with up to half it's size from the depot.
+** Blocks freed to the depot are used first, then new blocks are carved from a slab.
+*/
+static bool SlabRefill (SlabMagazine *magazine, int sizeClass)
+{
+    size_t blockSize = slabClassSize[sizeClass];
+    Probe3 (slab__refill, probeJob, sizeClass, blockSize);
+    EnterCS (slabDepot.lock);
+    slabDepot.refills++;
+    while (magazine->count < (SlabMagazineSize / 2))
+    {
+        void *block = slabDepot.freeBlocks[sizeClass];
+        if (block)
+        {
+            slabDepot.freeBlocks[sizeClass] = *((void **)block);
+            magazine->blocks[magazine->count++] = block;
+            continue;
+        }
+
+        if ((size_t)(slabDepot.carveEnd[sizeClass] - slabDepot.carve[sizeClass]) < blockSize)
+        {
+            Probe3 (slab__new, probeJob, sizeClass, (size_t)SlabSize);
+            SlabHeader *slab = (SlabHeader *)SlabAlignedAllocate (SlabSize);
+            if (!slab)
+                break;
+            slab->sizeClass = sizeClass;
+            slab->next = slabDepot.slabs;
+            slabDepot.slabs = slab;
+            slabDepot.slabCount++;
+            slabDepot.carve[sizeClass] = ((char *)slab) + SlabHeaderSize;
+            slabDepot.carveEnd[sizeClass] = ((char *)slab) + SlabSize;
+        }
+        magazine->blocks[magazine->count++] = slabDepot.carve[sizeClass];
+        slabDepot.carve[sizeClass] += blockSize;
+    }
+    LeaveCS (slabDepot.lock);
+    return (magazine->count != 0);
+}
+
+/* Return the oldest blocks in a magazine (or all of them) to the depot */
+static void SlabFlush (SlabMagazine *magazine, int sizeClass, int count)
+{
+    if (!count)
+        return;
+
+    /* Link the blocks first, so the depot is held only to add the chain */
+    for (int index = 0; index < (count - 1); index++)
+        *((void **)magazine->blocks[index]) = magazine->blocks[index + 1];
+
+    EnterCS (slabDepot.lock);
+    slabDepot.flushes++;
+    *((void **)magazine->blocks[count - 1]) = slabDepot.freeBlocks[sizeClass];
+    slabDepot.freeBlocks[sizeClass] = magazine->blocks[0];
+    LeaveCS (slabDepot.lock);
+
+    magazine->count -= count;
+    memmove (&magazine->blocks[0], &magazine->blocks[count], magazine->count * sizeof (void *));
+}
+
+static SlabMagazine *SlabMagazines ()
+{
+    if (!threadMagazines)
+        threadMagazines = (SlabMagazine *)calloc (SlabClasses, sizeof (SlabMagazine));
+    return (threadMagazines);
+}
+
+
+/* Allocate a large block, with room before it for it's header, and to move it past a
+** multiple of SlabBlockAlign
+*/
+static void *SlabLargeAllocate (size_t size)
+{
+    char *memory = (char *)malloc (size + SlabBlockAlign + sizeof (SlabLargeHeader));
+    if (!memory)
+        return (NULL);
+    char *block = memory + sizeof (SlabLargeHeader);
+    block += (SlabLargeOffset - (((size_t)block) & (SlabBlockAlign - 1))) & (SlabBlockAlign - 1);
+    SlabLargeOf (block)->memory = memory;
+    SlabLargeOf (block)->size = size;
+    EnterCS (slabDepot.lock);
+    slabDepot.largeCount++;
+    slabDepot.largeBytes += size;
+    LeaveCS (slabDepot.lock);
+    return (block);
+}
+
+void *slab_allocate (void *clientData, size_t size)
+{
+    if (size > SlabLargestBlock)
+        return (SlabLargeAllocate (size));
+
+    SlabMagazine *magazines = SlabMagazines ();
+    if (!magazines)
+        return (NULL);
+    int sizeClass = SlabClass (size);
+    SlabMagazine *magazine = &magazines[sizeClass];
+    if (!magazine->count && !SlabRefill (magazine, sizeClass))
+        return (NULL);
+    return (magazine->blocks[--magazine->count]);
+}
+
+void slab_free (void *clientData, void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (SlabIsLarge (ptr))
+    {
+        free (SlabLargeOf (ptr)->memory);
+        return;
+    }
+
+    SlabHeader *slab = SlabOf (ptr);
+    SlabMagazine *magazines = SlabMagazines ();
+    if (!magazines)
+    {
+        /* With no magazines, the block goes straight back to the depot */
+        EnterCS (slabDepot.lock);
+        *((void **)ptr) = slabDepot.freeBlocks[slab->sizeClass];
+        slabDepot.freeBlocks[slab->sizeClass] = ptr;
+        LeaveCS (slabDepot.lock);
+        return;
+    }
+
+    SlabMagazine *magazine = &magazines[slab->sizeClass];
+    if (magazine->count == SlabMagazineSize)
+        SlabFlush (magazine, slab->sizeClass, SlabMagazineSize / 2);
+    magazine->blocks[magazine->count++] = ptr;
+    return;
+}
+
+void *slab_reallocate (void *clientData, void *pointer, size_t size)
+{
+    if (!pointer)
+        return (slab_allocate (clientData, size));
+
+    /* Keep the block if it is large enough, and not much too large */
+    bool large = SlabIsLarge (pointer);
+    size_t oldSize = large ? SlabLargeOf (pointer)->size : slabClassSize[SlabOf (pointer)->sizeClass];
+    if ((size <= oldSize) && (!large || (size > (oldSize / 2))))
+        return (pointer);
+
+    void *block = slab_allocate (clientData, size);
+    if (!block)
+        return (NULL);
+    memcpy (block, pointer, oldSize < size ? oldSize : size);
+    slab_free (clientData, pointer);
+    return (block);
+}
+
+size_t slab_remaining (void *clientData)
+{
+    return (1024 * 1024 * 1024 * 1);
+}
+
+
+void slab_master_initialize ()
+{
+    memset (&slabDepot, 0, sizeof (slabDepot));
+    InitCS (slabDepot.lock);
+}
+
+void slab_master_finalize ()
+{
+    slab_thread_finalize ();
+    while (slabDepot.slabs)
+    {
+        SlabHeader *slab = slabDepot.slabs;
+        slabDepot.slabs = slab->next;
+        SlabAlignedFree (slab);
+    }
+    DestroyCS (slabDepot.lock);
+}
+
+TKAllocatorProcs *slab_access ()
+{
+    slab_access_block.allocProc = slab_allocate;
+    slab_access_block.reallocProc = slab_reallocate;
+    slab_access_block.freeProc = slab_free;
+    slab_access_block.memAvailProc = slab_remaining;
+    slab_access_block.clientData = NULL;
+    return &slab_access_block;
+}
+
+void slab_thread_finalize ()
+{
+    if (!threadMagazines)
+        return;
+    for (int sizeClass = 0; sizeClass < SlabClasses; sizeClass++)
+        SlabFlush (&threadMagazines[sizeClass], sizeClass, threadMagazines[sizeClass].count);
+    free (threadMagazines);
+    threadMagazines = NULL;
+}
+
+void slab_report (FILE *logFile)
+{
+    fprintf (logFile, "Slabs: %01llu slabs (%0.5g MB) were made. Magazines were refilled from the depot %01llu times, and returned to it %01llu times.\n",
+        (unsigned long long)slabDepot.slabCount, (slabDepot.slabCount * (double)SlabSize) / (1024.0 * 1024.0),
+        (unsigned long long)slabDepot.refills, (unsigned long long)slabDepot.flushes);
+    fprintf (logFile, "Slabs: %01llu large blocks (%0.5g MB) were allocated singly.\n",
+        (unsigned long long)slabDepot.largeCount, slabDepot.largeBytes / (1024.0 * 1024.0));
+}
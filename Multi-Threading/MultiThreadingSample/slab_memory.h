@@ -0,0 +1,41 @@
+/* This is an APDFL memory manager built from slabs of fixed size blocks.
+**
+** When "MemoryManager=slab" is given, allocations up to 8K are rounded to one of a
+** set of size classes, and taken from 64K slabs, each holding blocks of one class only.
+** Every block is 64 byte aligned, so small objects which are used together (as APDFL's
+** Cos and PDE objects are) do not share cache lines with blocks of other sizes.
+**
+** Each thread keeps a magazine of free blocks for each class, and allocates from, and
+** frees to, it's own magazines without any lock. When a magazine is empty, it is filled
+** from a global depot, and when it is full, half of it is returned to the depot. The
+** depot is protected by a mutex, and is where blocks freed by a thread other than the
+** one which allocated them find their way back to other threads.
+**
+** Larger allocations are given a block of their own, from malloc, and are freed at once.
+** Slabs are kept until the run ends (slab_master_finalize).
+*/
+#ifndef SLAB_MEMORY_h
+#define SLAB_MEMORY_h
+#include <stdio.h>
+#include "PDFInit.h"
+
+/* Call this interface from the mainline, before any library is initialized */
+void slab_master_initialize ();
+
+/* Call this interface from the mainline, after all libraries are terminated.
+** Every slab is released.
+*/
+void slab_master_finalize ();
+
+/* Return the APDFL memory manager interface */
+TKAllocatorProcs *slab_access ();
+
+/* Call this interface in each thread, after APDFL is terminated in that thread,
+** to return the thread's magazines to the depot.
+*/
+void slab_thread_finalize ();
+
+/* Write lines describing the use of the slabs and the depot to the log */
+void slab_report (FILE *logFile);
+
+#endif
@@ -0,0 +1,296 @@
+/* A soak run: jobs are run, over and over, for a time rather than a count, while the
+** growth of the process is watched.
+**
+** The samples are taken by a thread of their own, which polls (as the write behind
+** threads do) so it can be stopped promptly. The samples are kept in a vector, built
+** with the C++ library's allocator, and fitted only at the end of the run.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "soak_monitor.h"
+#include "run_sampler.h"
+#include "instrumented_memory.h"
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+/* One sample of the process */
+typedef struct soakSample
+{
+    double              minutes;            /* Since the soak started */
+    double              residentMB;         /* Resident set size */
+    double              liveMB;             /* Bytes the allocator has in use */
+    bool                liveKnown;          /* False when they could not be found (See run_sampler.h) */
+    int                 descriptors;        /* Open file descriptors */
+    ASUns64             jobs;               /* Jobs completed */
+} SoakSample;
+
+/* The sampling thread */
+typedef struct soakThread
+{
+    SDKThreadID         threadID;
+    bool                threadCompleted;
+} SoakThread;
+
+static bool                     soaking = false;
+static double                   soakMinutes = 0, sampleSeconds = 60, warmupMinutes = 0;
+static double                   growthLimit = 16, descriptorLimit = 10;
+static bool                     soakTrim = false;
+static FILE                    *soakLog = NULL;
+static FILE                    *soakFile = NULL;
+static double                   soakStart = 0;
+static volatile ASInt64         jobsCompleted = 0;
+static volatile bool            soakStopping = false;
+static SoakThread               sampler;
+static CSMutex                  soakLock;
+static std::vector<SoakSample>  samples;
+static bool                     liveMeasured = true;    /* False once any sample could not find the live bytes */
+
+
+/* The number of open file descriptors (Handles, on Windows) */
+static int OpenDescriptors ()
+{
+#ifdef WIN_PLATFORM
+    DWORD handles = 0;
+    GetProcessHandleCount (GetCurrentProcess (), &handles);
+    return ((int)handles);
+#else
+    int count = 0;
+    DIR *directory = opendir ("/proc/self/fd");
+    if (!directory)
+        return (0);
+    struct dirent *entry;
+    while ((entry = readdir (directory)) != NULL)
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir (directory);
+
+    /* Less the one used to read the directory */
+    return (count - 1);
+#endif
+}
+
+static void TakeSample ()
+{
+    SoakSample sample;
+    ProcessSample process;
+    SampleProcess (&process);
+    sample.minutes = (LatencyClock () - soakStart) / 60.0;
+    sample.residentMB = process.residentMB;
+    sample.liveMB = process.liveMB;
+    sample.liveKnown = process.liveKnown;
+    sample.descriptors = OpenDescriptors ();
+    sample.jobs = (ASUns64)jobsCompleted;
+
+    EnterCS (soakLock);
+    samples.push_back (sample);
+    if (!sample.liveKnown)
+        liveMeasured = false;
+    LeaveCS (soakLock);
+
+    char live[32] = "";
+    if (sample.liveKnown)
+        sprintf (live, "%0.5g", sample.liveMB);
+    fprintf (soakLog, "Soak at %0.4g minutes: %01llu jobs, %0.5g MB resident, %s MB live, %01d descriptors.\n",
+        sample.minutes, (unsigned long long)sample.jobs, sample.residentMB, sample.liveKnown ? live : "unknown", sample.descriptors);
+    fflush (soakLog);
+    if (soakFile)
+    {
+        fprintf (soakFile, "%0.4g|%01llu|%0.5g|%s|%01d\n",
+            sample.minutes, (unsigned long long)sample.jobs, sample.residentMB, live, sample.descriptors);
+        fflush (soakFile);
+    }
+}
+
+/* The sampling thread. Take a sample at each interval, until stopped */
+ThreadFuncReturnType soakSampler (SoakThread *thread)
+{
+    double next = LatencyClock () + sampleSeconds;
+    while (!soakStopping)
+    {
+        if (LatencyClock () >= next)
+        {
+            TakeSample ();
+            next += sampleSeconds;
+        }
+        ThreadSleep (100);
+    }
+    thread->threadCompleted = true;
+    return (0);
+}
+
+/* Fit a line (least squares) to the values given, over the samples after the warm up.
+** Returns the slope in units an hour, or zero if there are too few samples.
+*/
+static double FitSlope (double (*value) (const SoakSample &), int *used)
+{
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    int count = 0;
+    for (size_t index = 0; index < samples.size (); index++)
+    {
+        if (samples[index].minutes < warmupMinutes)
+            continue;
+        double x = samples[index].minutes / 60.0, y = value (samples[index]);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+        count++;
+    }
+    *used = count;
+    double divisor = (count * sumXX) - (sumX * sumX);
+    if (count < 3 || divisor <= 0)
+        return (0);
+    return (((count * sumXY) - (sumX * sumY)) / divisor);
+}
+
+static double SampleResident (const SoakSample &sample) { return (sample.residentMB); }
+static double SampleLive (const SoakSample &sample) { return (sample.liveMB); }
+static double SampleDescriptors (const SoakSample &sample) { return (sample.descriptors); }
+
+
+void InitializeSoak (attributes *FrameAttributes, FILE *logFile)
+{
+    soakMinutes = FrameAttributes->GetKeyValueDouble ("SoakMinutes");
+    soaking = (soakMinutes > 0);
+    if (!soaking)
+        return;
+
+    if (FrameAttributes->GetKeyValueDouble ("SoakSampleSeconds") > 0)
+        sampleSeconds = FrameAttributes->GetKeyValueDouble ("SoakSampleSeconds");
+    warmupMinutes = soakMinutes / 10;
+    if (FrameAttributes->IsKeyPresent ("SoakWarmupMinutes"))
+        warmupMinutes = FrameAttributes->GetKeyValueDouble ("SoakWarmupMinutes");
+    if (FrameAttributes->GetKeyValueDouble ("SoakGrowthLimit") > 0)
+        growthLimit = FrameAttributes->GetKeyValueDouble ("SoakGrowthLimit");
+    if (FrameAttributes->GetKeyValueDouble ("SoakDescriptorLimit") > 0)
+        descriptorLimit = FrameAttributes->GetKeyValueDouble ("SoakDescriptorLimit");
+    soakTrim = FrameAttributes->GetKeyValueBool ("SoakTrim");
+    if (FrameAttributes->IsKeyPresent ("SoakFile"))
+    {
+        soakFile = fopen (FrameAttributes->GetKeyValue ("SoakFile")->value (0), "w");
+        if (soakFile)
+            fprintf (soakFile, "minutes|jobs|residentMB|liveMB|descriptors\n");
+    }
+
+    soakLog = logFile;
+    CountProcessMemory ();
+    InitCS (soakLock);
+    fprintf (logFile, "  We will soak for %0.5g minutes, sampling every %0.5g seconds, and fail if memory grows by more than %0.5g MB an hour.\n",
+        soakMinutes, sampleSeconds, growthLimit);
+    if (soakTrim)
+        fprintf (logFile, "  We will return free heap memory to the system after each job.\n");
+    fprintf (logFile, "\n");
+}
+
+bool Soaking ()
+{
+    return (soaking);
+}
+
+bool SoakContinues ()
+{
+    return (soaking && ((LatencyClock () - soakStart) < (soakMinutes * 60)));
+}
+
+void StartSoakMonitor ()
+{
+    if (!soaking)
+        return;
+    soakStart = LatencyClock ();
+    soakStopping = false;
+    liveMeasured = true;
+    memset (&sampler, 0, sizeof (sampler));
+    TakeSample ();
+    createThread (soakSampler, sampler);
+}
+
+void StopSoakMonitor ()
+{
+    if (!soaking)
+        return;
+    soakStopping = true;
+    while (!sampler.threadCompleted)
+        ThreadSleep (1);
+    destroyThread ((&sampler));
+    TakeSample ();
+}
+
+void SoakJobCompleted ()
+{
+    AtomicAdd64 (&jobsCompleted, 1);
+    if (!soakTrim)
+        return;
+#ifdef WIN_PLATFORM
+    _heapmin ();
+#elif defined (__GLIBC__)
+    malloc_trim (0);
+#endif
+}
+
+int ReportSoak (FILE *logFile)
+{
+    if (!soaking)
+        return (0);
+
+    int used = 0;
+    double resident = FitSlope (SampleResident, &used);
+    double live = liveMeasured ? FitSlope (SampleLive, &used) : 0;
+    double descriptors = FitSlope (SampleDescriptors, &used);
+    if (used < 3)
+    {
+        fprintf (logFile, "Soak: only %01d samples were taken after the warm up, too few to fit.\n", used);
+        return (0);
+    }
+    if (liveMeasured)
+        fprintf (logFile, "Soak: over %01d samples after %0.4g minutes, resident memory grew %0.4g MB an hour, live memory %0.4g MB an hour, and descriptors %0.4g an hour.\n",
+            used, warmupMinutes, resident, live, descriptors);
+    else
+        fprintf (logFile, "Soak: over %01d samples after %0.4g minutes, resident memory grew %0.4g MB an hour, and descriptors %0.4g an hour. Live memory is not known for the allocators used.\n",
+            used, warmupMinutes, resident, descriptors);
+
+    /* Compare the rate jobs completed in the first and last halves of the samples after the warm up */
+    size_t first = 0;
+    while (first < samples.size () && samples[first].minutes < warmupMinutes)
+        first++;
+    size_t middle = first + ((samples.size () - first) / 2), last = samples.size () - 1;
+    if (middle > first && last > middle)
+    {
+        double early = (samples[middle].jobs - samples[first].jobs) / (samples[middle].minutes - samples[first].minutes);
+        double late = (samples[last].jobs - samples[middle].jobs) / (samples[last].minutes - samples[middle].minutes);
+        if (early > 0)
+            fprintf (logFile, "Soak: %0.5g jobs a minute in the first half, and %0.5g in the second (%+0.3g%%).\n",
+                early, late, ((late - early) * 100.0) / early);
+    }
+
+    int result = 0;
+    if (resident > growthLimit || live > growthLimit)
+    {
+        fprintf (logFile, "Soak: FAILED. Memory grew by more than %0.5g MB an hour.\n", growthLimit);
+        if (liveMeasured && live <= growthLimit)
+            fprintf (logFile, "Soak: resident memory grew while live memory did not, which points to fragmentation or cache, rather than a leak.\n");
+        result = SoakGrowthFailed;
+    }
+    if (descriptors > descriptorLimit)
+    {
+        fprintf (logFile, "Soak: FAILED. Descriptors grew by more than %0.5g an hour.\n", descriptorLimit);
+        result = SoakGrowthFailed;
+    }
+
+    if (soakFile)
+        fclose (soakFile);
+    soakFile = NULL;
+    DestroyCS (soakLock);
+    return (result);
+}
@@ -0,0 +1,58 @@
+/* A soak run: jobs are run, over and over, for a time rather than a count, while the
+** growth of the process is watched.
+**
+** Services such as the MT* watch folder applications run for weeks. Memory or file
+** descriptors lost by a job, or heap fragmentation, cost nothing in a short run, but
+** slowly degrade one that runs for weeks. A soak run shows which.
+**
+** When "SoakMinutes=" is given, the list of jobs ("TotalThreads=") is run again and again,
+** until that many minutes have passed. Every "SoakSampleSeconds=" seconds (Default 60), a
+** thread samples:
+**   the resident set size of the process,
+**   the live bytes the allocator reports (As the run sampler finds them, see run_sampler.h.
+**     Where they cannot be found, for the allocators used, they are left out),
+**   the number of open file descriptors (handles, on Windows),
+**   and the jobs completed.
+** Each sample is written to the log, and to "SoakFile=" (When given) as a line of values
+** separated by '|'.
+**
+** At the end of the run, a straight line is fitted (least squares) to each, over the samples
+** taken after the first "SoakWarmupMinutes=" (Default a tenth of the run), while caches fill.
+** The run fails (See SoakGrowthFailed) when resident or live memory grows by more than
+** "SoakGrowthLimit=" megabytes an hour (Default 16), or descriptors by more than
+** "SoakDescriptorLimit=" an hour (Default 10). The change in throughput over the run is
+** reported too.
+**
+** "SoakTrim=true" returns free heap memory to the system (malloc_trim) after each job, so the
+** resident size follows the live bytes. Then resident growth which live bytes do not show is
+** fragmentation, or cache, rather than a leak (Said only where the live bytes are known).
+*/
+#ifndef SOAK_MONITOR_h
+#define SOAK_MONITOR_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* The result of a soak run in which memory, or descriptors, grew too fast */
+#define SoakGrowthFailed    10
+
+/* Read the soak options. Call this once, from the main line, before any thread is started. */
+void InitializeSoak (attributes *FrameAttributes, FILE *logFile);
+
+/* True if this is a soak run */
+bool Soaking ();
+
+/* True until the soak time has passed */
+bool SoakContinues ();
+
+/* Start and stop the thread which samples the process */
+void StartSoakMonitor ();
+void StopSoakMonitor ();
+
+/* Call this from the main line as each job completes. It trims the heap, when asked. */
+void SoakJobCompleted ();
+
+/* Write the growth of the process to the log. Returns SoakGrowthFailed if it was too fast, otherwise zero. */
+int ReportSoak (FILE *logFile);
+
+#endif
@@ -1,23 +1,22 @@
-/* This is a basic APDFL memory manager built using system malloc
+/* This is an APDFL memory manager built using tcmalloc (gperftools), loaded at run time
 **
 ** Memory management is accomplished through the APDFL interface element
-* TKAllocatorProcs. This structure identies methods to be used for 
+** TKAllocatorProcs. This structure identifies methods to be used for
 ** allocating, reallocating, and freeing memory. It also contains a
-** reference to a method that may indicate how much memory is avaialable
-** to be allcoated. Generally, that last method is not accurately set.
+** reference to a method that may indicate how much memory is available
+** to be allocated. Generally, that last method is not accurately set.
 ** When it indicates a lower amount, it triggers cache cleanup.
 **
-** Allocators used in the MT Framework should be fairly minimal. 
-** Keep a current and highwater count only. Force alignment to 
-** 64 bit bounds.
-**
-** To keep any usage information at all would require a mutex to protect updates to that information!
-** I do not want to introduce a mutex for that here. So I iwllkeep no information.
+** tcmalloc is not linked into the framework.
+** The library is loaded, and it's entry points found, by the loader in loadable_memory.cpp.
 */
 #ifndef TCMALLOC_MEMORY_h
 #define TCMALLOC_MEMORY_h
 #include "PDFInit.h"
+#include "loadable_memory.h"
+
+TKAllocatorProcs *tcmalloc_access ();        /* Call this method to acquire an APDFL memory Manager Interface (NULL if tcmalloc cannot be loaded) */
 
-TKAllocatorProcs *tcmalloc_access ();
+const char *tcmalloc_describe ();            /* Describes the library loaded, or why it could not be loaded */
 
-#endif 
+#endif
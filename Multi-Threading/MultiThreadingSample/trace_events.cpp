@@ -0,0 +1,201 @@
+/* A timeline of the run, written as a Chrome trace.
+**
+** Each event is written as one line of the "traceEvents" array, under a lock, so lines from
+** different threads are never mixed. The array is closed by FinishTrace. Times are written in
+** microseconds from the start of the trace. Names are written as JSON strings, escaped, since
+** they may hold file names.
+*/
+
+#include <string.h>
+#include <string>
+#include "trace_events.h"
+#include "latency_histogram.h"
+
+#ifdef WIN_PLATFORM
+#include <windows.h>
+#else
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+static FILE                    *traceFile = NULL;
+static CSMutex                  traceLock;
+static double                   traceStart = 0;
+static bool                     firstEvent = true;
+static int                      processID = 0;
+static ASInt64                  threadsSeen = 0;
+
+/* The id of the calling thread's track, zero until it is found */
+static ThreadLocal ASInt64      threadTrack = 0;
+
+
+/* Return the id of the calling thread, as the OS knows it where that may be found,
+** so the tracks match those of other tools. Otherwise, number the threads as they are seen.
+*/
+static ASInt64 TraceThreadID ()
+{
+    if (!threadTrack)
+    {
+#if defined (WIN_PLATFORM)
+        threadTrack = GetCurrentThreadId ();
+#elif defined (__linux__) && defined (SYS_gettid)
+        threadTrack = syscall (SYS_gettid);
+#else
+        threadTrack = AtomicAdd64 (&threadsSeen, 1);
+#endif
+    }
+    return (threadTrack);
+}
+
+/* Microseconds from the start of the trace to a LatencyClock () time */
+static double TraceTime (double when)
+{
+    return ((when - traceStart) * 1000000.0);
+}
+
+/* Return a text as a quoted JSON string, escaping quotes, back slashes and control characters */
+static std::string JSONString (const char *text)
+{
+    std::string quoted = "\"";
+    for (const unsigned char *scan = (const unsigned char *)text; *scan; scan++)
+    {
+        switch (*scan)
+        {
+        case '"':  quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if (*scan < 0x20)
+            {
+                char escape[8];
+                sprintf (escape, "\\u%04x", *scan);
+                quoted += escape;
+            }
+            else
+                quoted += (char)*scan;
+        }
+    }
+    quoted += "\"";
+    return (quoted);
+}
+
+/* Start an event. Call with the lock held. */
+static void StartEvent ()
+{
+    fprintf (traceFile, firstEvent ? "\n" : ",\n");
+    firstEvent = false;
+}
+
+
+void InitializeTrace (attributes *FrameAttributes, FILE *logFile)
+{
+    if (!FrameAttributes->IsKeyPresent ("TraceFile"))
+        return;
+
+    const char *fileName = FrameAttributes->GetKeyValue ("TraceFile")->value (0);
+    traceFile = fopen (fileName, "w");
+    if (!traceFile)
+    {
+        fprintf (logFile, "  The trace file \"%s\" could not be opened, so the run will not be traced.\n\n", fileName);
+        return;
+    }
+
+#ifdef WIN_PLATFORM
+    processID = GetCurrentProcessId ();
+#else
+    processID = getpid ();
+#endif
+    InitCS (traceLock);
+    traceStart = LatencyClock ();
+    firstEvent = true;
+    fprintf (traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%01d,\"tid\":0,\"args\":{\"name\":\"MultiThreadingSample\"}}", processID);
+    fprintf (logFile, "  We will write a timeline of the run into \"%s\".\n\n", fileName);
+}
+
+void FinishTrace ()
+{
+    if (!traceFile)
+        return;
+    fprintf (traceFile, "\n]}\n");
+    fclose (traceFile);
+    traceFile = NULL;
+    DestroyCS (traceLock);
+}
+
+bool Tracing ()
+{
+    return (traceFile != NULL);
+}
+
+void TraceThreadName (const char *name)
+{
+    if (!traceFile)
+        return;
+    ASInt64 thread = TraceThreadID ();
+    std::string threadName = JSONString (name);
+    EnterCS (traceLock);
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%01d,\"tid\":%01lld,\"args\":{\"name\":%s}}",
+        processID, (long long)thread, threadName.c_str ());
+    LeaveCS (traceLock);
+}
+
+void TraceSpan (const char *category, const char *name, double start, double end)
+{
+    if (!traceFile)
+        return;
+    ASInt64 thread = TraceThreadID ();
+    std::string spanCategory = JSONString (category), spanName = JSONString (name);
+    EnterCS (traceLock);
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"X\",\"cat\":%s,\"name\":%s,\"pid\":%01d,\"tid\":%01lld,\"ts\":%0.3f,\"dur\":%0.3f}",
+        spanCategory.c_str (), spanName.c_str (), processID, (long long)thread, TraceTime (start), (end - start) * 1000000.0);
+    LeaveCS (traceLock);
+}
+
+void TraceJob (const char *name, int job, double start, double end)
+{
+    if (!traceFile)
+        return;
+    ASInt64 thread = TraceThreadID ();
+    std::string jobName = JSONString (name);
+    EnterCS (traceLock);
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"X\",\"cat\":\"job\",\"name\":%s,\"pid\":%01d,\"tid\":%01lld,\"ts\":%0.3f,\"dur\":%0.3f,\"args\":{\"job\":%01d}}",
+        jobName.c_str (), processID, (long long)thread, TraceTime (start), (end - start) * 1000000.0, job + 1);
+    LeaveCS (traceLock);
+}
+
+void TraceProgress (const char *name, int page, int pages, double percent)
+{
+    if (!traceFile)
+        return;
+    ASInt64 thread = TraceThreadID ();
+    double now = LatencyClock ();
+    std::string progressName = JSONString (name);
+    EnterCS (traceLock);
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"i\",\"s\":\"t\",\"cat\":\"progress\",\"name\":%s,\"pid\":%01d,\"tid\":%01lld,\"ts\":%0.3f,\"args\":{\"page\":%01d,\"pages\":%01d,\"percent\":%0.4g}}",
+        progressName.c_str (), processID, (long long)thread, TraceTime (now), page + 1, pages, percent);
+    LeaveCS (traceLock);
+}
+
+void TraceCounter (const char *name, int value)
+{
+    if (!traceFile)
+        return;
+    ASInt64 thread = TraceThreadID ();
+    std::string counterName = JSONString (name);
+    EnterCS (traceLock);
+    double now = LatencyClock ();
+    StartEvent ();
+    fprintf (traceFile, "{\"ph\":\"C\",\"name\":%s,\"pid\":%01d,\"tid\":%01lld,\"ts\":%0.3f,\"args\":{%s:%01d}}",
+        counterName.c_str (), processID, (long long)thread, TraceTime (now), counterName.c_str (), value);
+    LeaveCS (traceLock);
+}
@@ -0,0 +1,52 @@
+/* A timeline of the run, written as a Chrome trace.
+**
+** The statistics line says how long the run took, and the phase times say where each type
+** of job spent it's time, but neither shows what the threads were doing at the same moment:
+** whether they all started the library at once, or queued behind each other to save.
+** A timeline shows that at a glance.
+**
+** When "TraceFile=" is given, the run is written to it as a JSON trace, in the Trace Event
+** Format read by chrome://tracing and ui.perfetto.dev. Each OS thread has a track of it's own
+** (Named for the job, or the pool thread, it runs), holding:
+**   a span for each job, named for the type of worker,
+**   a span for each phase of the work inside it (See WorkerPhase.h). The library start and
+**      end are the "start" and "end" phases, so they appear too, in pool threads as well,
+**   an instant for each page reported by the progress monitors (When "UseProgressMonitor=true").
+** The pump's track holds counters of the jobs running, and (When "ThreadPool=true") of the
+** jobs waiting in the queue for a pool thread.
+**
+** Events are written as they happen, under a lock. There are only a few to a job (More with
+** a progress monitor), so the lock is seldom contended, and when no trace is asked for,
+** each call returns at once.
+*/
+#ifndef TRACE_EVENTS_h
+#define TRACE_EVENTS_h
+#include <stdio.h>
+#include "PDFInit.h"
+#include "MTHeader.h"
+
+/* Read "TraceFile=". Call this once, from the main line, before any thread is started. */
+void InitializeTrace (attributes *FrameAttributes, FILE *logFile);
+
+/* Close the trace. Call this once, from the main line, after every thread has ended. */
+void FinishTrace ();
+
+/* True when a trace is being written */
+bool Tracing ();
+
+/* Name the track of the calling thread */
+void TraceThreadName (const char *name);
+
+/* A span of time in the calling thread. Times are LatencyClock () values (See latency_histogram.h). */
+void TraceSpan (const char *category, const char *name, double start, double end);
+
+/* A span for a job, in the calling thread */
+void TraceJob (const char *name, int job, double start, double end);
+
+/* A page reported by a progress monitor, in the calling thread (The page counts from zero) */
+void TraceProgress (const char *name, int page, int pages, double percent);
+
+/* The value of a counter, now */
+void TraceCounter (const char *name, int value);
+
+#endif
@@ -0,0 +1,37 @@
+/* Calls from a memory manager which wraps another, to the one it wraps.
+**
+** The memory budget, the allocation trace, the instrumented counts and the large buffers are
+** each an APDFL memory manager which wraps the one APDFL was started with. Each gives every
+** block a header of it's own, and passes the call on through these. The manager wrapped is NULL
+** where APDFL was to use it's own, and then malloc is called.
+**
+** These are inline, as they are called on every allocation.
+*/
+#ifndef WRAPPED_ALLOCATOR_h
+#define WRAPPED_ALLOCATOR_h
+#include <stdlib.h>
+#include "PDFInit.h"
+
+static inline void *WrappedAllocate (TKAllocatorProcs *wrapped, size_t size)
+{
+    if (wrapped)
+        return (wrapped->allocProc (wrapped->clientData, size));
+    return (malloc (size));
+}
+
+static inline void *WrappedReallocate (TKAllocatorProcs *wrapped, void *pointer, size_t size)
+{
+    if (wrapped)
+        return (wrapped->reallocProc (wrapped->clientData, pointer, size));
+    return (realloc (pointer, size));
+}
+
+static inline void WrappedFree (TKAllocatorProcs *wrapped, void *pointer)
+{
+    if (wrapped)
+        wrapped->freeProc (wrapped->clientData, pointer);
+    else
+        free (pointer);
+}
+
+#endif